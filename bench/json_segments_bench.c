@@ -0,0 +1,840 @@
+// json_segments_bench.c
+//
+// Benchmark suite for the hot paths of the library: splitting, ingest
+// (json_segments_parse_input / json_segments_parse_raw), json_segments_add,
+// merging of completed messages, json_segments_check_timeout and deletes.
+//
+// Every scenario reports throughput, p50/p99 latency per operation, heap
+// allocations per operation and, where perf events are available, L1 data
+// cache misses per operation. Results can additionally be written as JSON for
+// regression tracking.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_bench.c json_segments.c json_segments_escape.c json_segments_parallel.c json_segments_journal.c -lcjson -lpthread -o json_segments_bench
+// Usage:
+//   json_segments_bench [--full] [--json FILE|-] [--filter SUBSTRING]
+//
+// The default run keeps every scenario small enough to finish in about a
+// minute; --full adds payloads up to 100 MB and larger tables.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+#include "json_segments_parallel.h"
+#include "json_segments_journal.h"
+
+// Count heap allocations by interposing malloc on glibc. The library, cJSON
+// and libc helpers such as strdup all allocate through these.
+#if defined(__GLIBC__) && !defined(JSON_SEGMENTS_BENCH_NO_MALLOC_HOOK)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static size_t bench_allocation_count;
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&bench_allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&bench_allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&bench_allocation_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static size_t bench_allocations(void) {
+    return __atomic_load_n(&bench_allocation_count, __ATOMIC_RELAXED);
+}
+#define BENCH_COUNTS_ALLOCATIONS 1
+#else
+static size_t bench_allocations(void) {
+    return 0;
+}
+#define BENCH_COUNTS_ALLOCATIONS 0
+#endif
+
+// Count L1 data cache read misses of the benchmark thread with a perf
+// counter. Where perf events are unavailable (other systems, containers,
+// perf_event_paranoid) the column reads n/a.
+#if defined(__linux__) && !defined(JSON_SEGMENTS_BENCH_NO_PERF)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int bench_perf_fd = -1;
+
+static void bench_cache_open(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    bench_perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static size_t bench_cache_misses(void) {
+    unsigned long long count;
+    if (bench_perf_fd < 0 || read(bench_perf_fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+        return 0;
+    }
+    return (size_t)count;
+}
+#else
+static int bench_perf_fd = -1;
+
+static void bench_cache_open(void) {
+}
+
+static size_t bench_cache_misses(void) {
+    return 0;
+}
+#endif
+
+#define BENCH_MAX_RESULTS 512
+
+typedef struct {
+    char scenario[32];
+    char parameters[160];
+    size_t operations;
+    size_t bytes;
+    double seconds;
+    double p50_ns;
+    double p99_ns;
+    double allocations_per_operation;
+    double cache_misses_per_operation;
+} BenchResult;
+
+typedef struct {
+    double *values;
+    size_t count;
+    size_t capacity;
+} BenchSamples;
+
+static BenchResult bench_results[BENCH_MAX_RESULTS];
+static size_t bench_result_count;
+static int bench_full;
+static const char *bench_filter;
+static size_t bench_completed_messages;
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_samples_push(BenchSamples *samples, double value) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        double *values = realloc(samples->values, capacity * sizeof(double));
+        if (values == NULL) {
+            return;
+        }
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value;
+}
+
+static int bench_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile(BenchSamples *samples, double percentile) {
+    if (samples->count == 0) {
+        return 0;
+    }
+    size_t index = (size_t)(percentile / 100.0 * (double)(samples->count - 1) + 0.5);
+    return samples->values[index];
+}
+
+static int bench_enabled(const char *scenario) {
+    return bench_filter == NULL || strstr(scenario, bench_filter) != NULL;
+}
+
+// Record a finished scenario and print it as a table row.
+static void bench_record(const char *scenario, const char *parameters, BenchSamples *samples, size_t bytes, size_t allocations,
+                         size_t cache_misses) {
+    if (bench_result_count == BENCH_MAX_RESULTS) {
+        return;
+    }
+
+    BenchResult *result = &bench_results[bench_result_count++];
+    double total_ns = 0;
+    for (size_t i = 0; i < samples->count; i++) {
+        total_ns += samples->values[i];
+    }
+    qsort(samples->values, samples->count, sizeof(double), bench_compare_doubles);
+
+    snprintf(result->scenario, sizeof(result->scenario), "%s", scenario);
+    snprintf(result->parameters, sizeof(result->parameters), "%s", parameters);
+    result->operations = samples->count;
+    result->bytes = bytes;
+    result->seconds = total_ns / 1e9;
+    result->p50_ns = bench_percentile(samples, 50);
+    result->p99_ns = bench_percentile(samples, 99);
+    result->allocations_per_operation = samples->count ? (double)allocations / (double)samples->count : 0;
+    result->cache_misses_per_operation = samples->count ? (double)cache_misses / (double)samples->count : 0;
+
+    char misses[24] = "n/a";
+    if (bench_perf_fd >= 0) {
+        snprintf(misses, sizeof(misses), "%.1f", result->cache_misses_per_operation);
+    }
+    printf("%-14s %-52s %10.1f MB/s %12.0f op/s  p50 %10.0f ns  p99 %10.0f ns  %8.2f alloc/op  %8s L1d miss/op\n",
+           result->scenario, result->parameters,
+           result->seconds > 0 ? (double)bytes / result->seconds / 1e6 : 0,
+           result->seconds > 0 ? (double)result->operations / result->seconds : 0,
+           result->p50_ns, result->p99_ns, result->allocations_per_operation, misses);
+    fflush(stdout);
+
+    samples->count = 0;
+}
+
+static void bench_write_json(FILE *out) {
+    fprintf(out, "{\n  \"counts_allocations\": %s,\n  \"counts_cache_misses\": %s,\n  \"results\": [\n",
+            BENCH_COUNTS_ALLOCATIONS ? "true" : "false", bench_perf_fd >= 0 ? "true" : "false");
+    for (size_t i = 0; i < bench_result_count; i++) {
+        const BenchResult *r = &bench_results[i];
+        fprintf(out, "    {\"scenario\": \"%s\", \"parameters\": \"%s\", \"operations\": %zu, \"bytes\": %zu, "
+                     "\"seconds\": %.9f, \"bytes_per_second\": %.1f, \"operations_per_second\": %.1f, "
+                     "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"allocations_per_operation\": %.3f, \"cache_misses_per_operation\": %.3f}%s\n",
+                r->scenario, r->parameters, r->operations, r->bytes, r->seconds,
+                r->seconds > 0 ? (double)r->bytes / r->seconds : 0,
+                r->seconds > 0 ? (double)r->operations / r->seconds : 0,
+                r->p50_ns, r->p99_ns, r->allocations_per_operation, r->cache_misses_per_operation,
+                i + 1 < bench_result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Deterministic xorshift generator so every run sees the same workload.
+static unsigned long long bench_random_state = 0x9E3779B97F4A7C15ull;
+
+static unsigned long long bench_random(void) {
+    bench_random_state ^= bench_random_state << 13;
+    bench_random_state ^= bench_random_state >> 7;
+    bench_random_state ^= bench_random_state << 17;
+    return bench_random_state;
+}
+
+static double bench_random_unit(void) {
+    return (double)(bench_random() >> 11) / (double)(1ull << 53);
+}
+
+// Build a syntactically valid JSON document of exactly 'length' bytes
+// (length >= 16), so completed messages also exercise cJSON_Parse.
+static char *bench_make_payload(size_t length) {
+    static const char head[] = "{\"data\":\"";
+    static const char tail[] = "\"}";
+    char *payload = malloc(length + 1);
+
+    if (payload == NULL) {
+        return NULL;
+    }
+    memcpy(payload, head, sizeof(head) - 1);
+    for (size_t i = sizeof(head) - 1; i < length - (sizeof(tail) - 1); i++) {
+        payload[i] = (char)('a' + i % 26);
+    }
+    memcpy(payload + length - (sizeof(tail) - 1), tail, sizeof(tail) - 1);
+    payload[length] = '\0';
+    return payload;
+}
+
+static void bench_count_completion(cJSON *json) {
+    (void)json;
+    bench_completed_messages++;
+}
+
+static void bench_format_size(char *out, size_t size, size_t bytes) {
+    if (bytes >= (1u << 20) && bytes % (1u << 20) == 0) {
+        snprintf(out, size, "%zuMB", bytes >> 20);
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        snprintf(out, size, "%zuKB", bytes >> 10);
+    } else {
+        snprintf(out, size, "%zuB", bytes);
+    }
+}
+
+// Number of timed repetitions for an operation over 'bytes' of payload:
+// roughly 'budget' bytes in total, at least 3 runs.
+static size_t bench_repetitions(size_t bytes, size_t budget) {
+    size_t repetitions = budget / (bytes ? bytes : 1);
+    return repetitions < 3 ? 3 : repetitions > 2000 ? 2000 : repetitions;
+}
+
+static void bench_split(void) {
+    static const size_t payload_sizes[] = { 1u << 10, 64u << 10, 1u << 20, 16u << 20, 100u << 20 };
+    static const int segment_sizes[] = { 64, 250, 1400, 64 << 10 };
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char size_name[24];
+
+    for (size_t p = 0; p < sizeof(payload_sizes) / sizeof(payload_sizes[0]); p++) {
+        size_t payload_size = payload_sizes[p];
+        if (!bench_full && payload_size > (16u << 20)) {
+            continue;
+        }
+        char *payload = bench_make_payload(payload_size);
+        bench_format_size(size_name, sizeof(size_name), payload_size);
+
+        for (size_t s = 0; s < sizeof(segment_sizes) / sizeof(segment_sizes[0]); s++) {
+            size_t segment_length;
+            int total_segments;
+            if (json_segments_layout("bench-uid", payload_size, segment_sizes[s], &segment_length, &total_segments) != 0 ||
+                total_segments > (bench_full ? 8000000 : 1000000)) {
+                continue;
+            }
+            size_t repetitions = bench_repetitions(payload_size, bench_full ? (256u << 20) : (64u << 20));
+            snprintf(parameters, sizeof(parameters), "payload=%s segment=%d segments=%d", size_name, segment_sizes[s], total_segments);
+
+            if (bench_enabled("split")) {
+                size_t allocations = bench_allocations();
+                size_t cache_misses = bench_cache_misses();
+                for (size_t r = 0; r < repetitions; r++) {
+                    double start = bench_now_ns();
+                    cJSON **segments = json_segments_split_string(payload, "bench-uid", segment_sizes[s]);
+                    json_segments_free_segments_array(segments);
+                    bench_samples_push(&samples, bench_now_ns() - start);
+                }
+                bench_record("split", parameters, &samples, payload_size * repetitions, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+            }
+
+            if (bench_enabled("split_iterator")) {
+                JsonSegmentsIterator iterator;
+                json_segments_iterator_init(&iterator, payload, payload_size, "bench-uid", segment_sizes[s]);
+                size_t capacity = json_segments_frame_capacity("bench-uid", iterator.segment_length, iterator.total_segments);
+                char *frame = malloc(capacity);
+                size_t allocations = bench_allocations();
+                size_t cache_misses = bench_cache_misses();
+                for (size_t r = 0; r < repetitions; r++) {
+                    double start = bench_now_ns();
+                    json_segments_iterator_seek(&iterator, 1);
+                    while (json_segments_iterator_next(&iterator, frame, capacity) > 0) {
+                    }
+                    bench_samples_push(&samples, bench_now_ns() - start);
+                }
+                bench_record("split_iterator", parameters, &samples, payload_size * repetitions, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+                free(frame);
+            }
+        }
+        free(payload);
+    }
+
+    free(samples.values);
+}
+
+static void bench_split_threads(void) {
+    static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    size_t payload_size = bench_full ? (100u << 20) : (16u << 20);
+    char *payload = bench_make_payload(payload_size);
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char size_name[24];
+
+    if (!bench_enabled("split_parallel")) {
+        free(payload);
+        return;
+    }
+
+    bench_format_size(size_name, sizeof(size_name), payload_size);
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        size_t allocations = bench_allocations();
+        size_t cache_misses = bench_cache_misses();
+        for (int r = 0; r < 3; r++) {
+            double start = bench_now_ns();
+            cJSON **segments = json_segments_split_string_parallel(payload, "bench-uid", 1400, thread_counts[t], NULL, NULL);
+            json_segments_free_segments_array(segments);
+            bench_samples_push(&samples, bench_now_ns() - start);
+        }
+        snprintf(parameters, sizeof(parameters), "payload=%s segment=1400 threads=%d", size_name, thread_counts[t]);
+        bench_record("split_parallel", parameters, &samples, payload_size * 3, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+    }
+
+    free(samples.values);
+    free(payload);
+}
+
+// A precomputed stream of frames for 'in_flight' interleaved messages, with
+// some frames swapped (reordering) and some repeated (duplicates).
+typedef struct {
+    char **frames;
+    size_t *frame_lengths;
+    size_t count;
+    size_t payload_bytes;
+    size_t messages;
+} BenchWorkload;
+
+static void bench_workload_push(BenchWorkload *workload, size_t *capacity, const char *frame, size_t length) {
+    if (workload->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4096;
+        workload->frames = realloc(workload->frames, *capacity * sizeof(char *));
+        workload->frame_lengths = realloc(workload->frame_lengths, *capacity * sizeof(size_t));
+    }
+    workload->frames[workload->count] = malloc(length + 1);
+    memcpy(workload->frames[workload->count], frame, length + 1);
+    workload->frame_lengths[workload->count] = length;
+    workload->count++;
+}
+
+static void bench_build_workload(BenchWorkload *workload, size_t message_size, int segment_size, size_t in_flight, size_t messages,
+                                 double reorder_rate, double duplicate_rate) {
+    char *payload = bench_make_payload(message_size);
+    JsonSegmentsIterator *iterators = calloc(in_flight, sizeof(JsonSegmentsIterator));
+    char (*uids)[24] = calloc(in_flight, sizeof(*uids));
+    size_t capacity = 0;
+    size_t next_message = 0;
+    size_t active = 0;
+    char *frame = NULL;
+
+    memset(workload, 0, sizeof(*workload));
+
+    // Round-robin over 'in_flight' concurrent messages; a finished slot
+    // starts the next message until 'messages' have been emitted.
+    for (size_t i = 0; i < in_flight && next_message < messages; i++, next_message++, active++) {
+        snprintf(uids[i], sizeof(uids[i]), "m%08zu", next_message);
+        json_segments_iterator_init(&iterators[i], payload, message_size, uids[i], segment_size);
+    }
+    size_t frame_capacity = json_segments_frame_capacity("m00000000", iterators[0].segment_length, iterators[0].total_segments);
+    frame = malloc(frame_capacity);
+
+    while (active > 0) {
+        for (size_t i = 0; i < in_flight; i++) {
+            if (iterators[i].source == NULL) {
+                continue;
+            }
+            int length = json_segments_iterator_next(&iterators[i], frame, frame_capacity);
+            if (length > 0) {
+                bench_workload_push(workload, &capacity, frame, (size_t)length);
+                if (bench_random_unit() < duplicate_rate) {
+                    bench_workload_push(workload, &capacity, frame, (size_t)length);
+                }
+                continue;
+            }
+            if (next_message < messages) {
+                snprintf(uids[i], sizeof(uids[i]), "m%08zu", next_message++);
+                json_segments_iterator_init(&iterators[i], payload, message_size, uids[i], segment_size);
+            } else {
+                iterators[i].source = NULL;
+                active--;
+            }
+        }
+    }
+
+    // Reordering: swap frames with a random frame at most 16 positions later
+    for (size_t i = 0; i + 1 < workload->count; i++) {
+        if (bench_random_unit() < reorder_rate) {
+            size_t j = i + 1 + bench_random() % 16;
+            if (j < workload->count) {
+                char *f = workload->frames[i];
+                size_t l = workload->frame_lengths[i];
+                workload->frames[i] = workload->frames[j];
+                workload->frame_lengths[i] = workload->frame_lengths[j];
+                workload->frames[j] = f;
+                workload->frame_lengths[j] = l;
+            }
+        }
+    }
+
+    workload->payload_bytes = message_size * messages;
+    workload->messages = messages;
+    free(frame);
+    free(uids);
+    free(iterators);
+    free(payload);
+}
+
+static void bench_free_workload(BenchWorkload *workload) {
+    for (size_t i = 0; i < workload->count; i++) {
+        free(workload->frames[i]);
+    }
+    free(workload->frames);
+    free(workload->frame_lengths);
+}
+
+static void bench_ingest(void) {
+    static const size_t message_sizes[] = { 1u << 10, 64u << 10, 1u << 20 };
+    static const int segment_sizes[] = { 250, 1400 };
+    static const size_t in_flight_counts[] = { 1, 16, 256 };
+    static const double rates[][2] = { { 0.0, 0.0 }, { 0.1, 0.01 }, { 0.5, 0.1 } };
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char size_name[24];
+
+    for (size_t m = 0; m < sizeof(message_sizes) / sizeof(message_sizes[0]); m++) {
+        for (size_t s = 0; s < sizeof(segment_sizes) / sizeof(segment_sizes[0]); s++) {
+            for (size_t f = 0; f < sizeof(in_flight_counts) / sizeof(in_flight_counts[0]); f++) {
+                for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+                    BenchWorkload workload;
+                    size_t budget = bench_full ? (64u << 20) : (8u << 20);
+                    size_t messages = budget / message_sizes[m];
+                    if (messages < in_flight_counts[f]) {
+                        messages = in_flight_counts[f];
+                    }
+                    if (message_sizes[m] * in_flight_counts[f] > budget * 4) {
+                        continue; // the interleaved workload alone would not fit the memory budget
+                    }
+
+                    bench_build_workload(&workload, message_sizes[m], segment_sizes[s], in_flight_counts[f], messages, rates[r][0], rates[r][1]);
+                    bench_format_size(size_name, sizeof(size_name), message_sizes[m]);
+                    snprintf(parameters, sizeof(parameters), "message=%s segment=%d in_flight=%zu reorder=%.2f dup=%.2f",
+                             size_name, segment_sizes[s], in_flight_counts[f], rates[r][0], rates[r][1]);
+
+                    if (bench_enabled("ingest_cjson")) {
+                        // cJSON_Parse of the frame is part of the receive path
+                        size_t allocations = bench_allocations();
+                        size_t cache_misses = bench_cache_misses();
+                        for (size_t i = 0; i < workload.count; i++) {
+                            double start = bench_now_ns();
+                            cJSON *json = cJSON_Parse(workload.frames[i]);
+                            json_segments_parse_input(json);
+                            cJSON_Delete(json);
+                            bench_samples_push(&samples, bench_now_ns() - start);
+                        }
+                        bench_record("ingest_cjson", parameters, &samples, workload.payload_bytes, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+                        json_segments_check_timeout(-1); // drop entries recreated by late duplicates
+                    }
+
+                    if (bench_enabled("ingest_raw")) {
+                        size_t allocations = bench_allocations();
+                        size_t cache_misses = bench_cache_misses();
+                        for (size_t i = 0; i < workload.count; i++) {
+                            double start = bench_now_ns();
+                            json_segments_parse_raw(workload.frames[i], workload.frame_lengths[i]);
+                            bench_samples_push(&samples, bench_now_ns() - start);
+                        }
+                        bench_record("ingest_raw", parameters, &samples, workload.payload_bytes, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+                        json_segments_check_timeout(-1);
+                    }
+
+                    bench_free_workload(&workload);
+                }
+            }
+        }
+    }
+
+    free(samples.values);
+}
+
+// json_segments_add directly, with 'in_flight' partially received messages
+// in the table so the uid lookup cost is visible. add_borrowed lends the
+// same segments with json_segments_context_add_borrowed instead of copying,
+// add_journaled appends every segment to a journal without flushing it.
+static void bench_add(void) {
+    static const size_t in_flight_counts[] = { 1, 100, 1000, 10000 };
+    static const char segment[] = "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"
+                                  "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789";
+    // Sensor-sized segments fit the inline storage of a segment record, the larger ones are copied to the heap
+    static const size_t segment_lengths[] = { 32, sizeof(segment) - 1 };
+    static const char *const scenarios[] = { "add", "add_borrowed", "add_journaled" };
+    static const char journal_path[] = "/tmp/json_segments_bench.journal";
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char uid[32];
+    char content[sizeof(segment)];
+
+    for (int mode = 0; mode < 3; mode++) {
+        const char *scenario = scenarios[mode];
+        int borrowed = mode == 1;
+        JsonSegmentsJournal *journal = NULL;
+        if (!bench_enabled(scenario)) {
+            continue;
+        }
+        if (mode == 2) {
+            unlink(journal_path);
+            journal = json_segments_journal_open(journal_path, 0);
+            if (journal == NULL) {
+                continue;
+            }
+            json_segments_context_set_persist(&json_segments_default_context, json_segments_journal_persist, journal);
+        }
+
+        for (size_t l = 0; l < sizeof(segment_lengths) / sizeof(segment_lengths[0]); l++) {
+            size_t segment_length = segment_lengths[l];
+            memcpy(content, segment, segment_length);
+            content[segment_length] = '\0';
+
+            for (size_t f = 0; f < sizeof(in_flight_counts) / sizeof(in_flight_counts[0]); f++) {
+                size_t in_flight = in_flight_counts[f];
+                int segments_per_message = 8;
+                size_t allocations = bench_allocations();
+                size_t cache_misses = bench_cache_misses();
+
+                // Segments 1..7 of every message; nothing completes
+                for (int seq = 1; seq < segments_per_message; seq++) {
+                    for (size_t i = 0; i < in_flight; i++) {
+                        snprintf(uid, sizeof(uid), "add-%zu", i);
+                        double start = bench_now_ns();
+                        if (borrowed) {
+                            json_segments_context_add_borrowed(&json_segments_default_context, uid, strlen(uid), seq, segments_per_message,
+                                                               content, segment_length, NULL, NULL);
+                        } else {
+                            json_segments_add(uid, seq, segments_per_message, content);
+                        }
+                        bench_samples_push(&samples, bench_now_ns() - start);
+                    }
+                }
+                snprintf(parameters, sizeof(parameters), "in_flight=%zu segment=%zuB", in_flight, segment_length);
+                bench_record(scenario, parameters, &samples, samples.count * segment_length, bench_allocations() - allocations,
+                             bench_cache_misses() - cache_misses);
+
+                json_segments_check_timeout(-1);
+            }
+        }
+
+        if (journal != NULL) {
+            json_segments_context_set_persist(&json_segments_default_context, NULL, NULL);
+            json_segments_journal_close(journal);
+            unlink(journal_path);
+        }
+    }
+
+    free(samples.values);
+}
+
+// Vector function of merge_vector: a forwarder would hand the payloads to writev.
+static void bench_count_vector(const char *unique_id, size_t unique_id_length, const struct iovec *segments, int count, size_t length,
+                               void *user_data) {
+    (void)unique_id;
+    (void)unique_id_length;
+    (void)segments;
+    (void)count;
+    (void)length;
+    (void)user_data;
+    bench_completed_messages++;
+}
+
+// Spill function of merge_spill; the file is deleted when it returns.
+static void bench_count_spill(const char *unique_id, size_t unique_id_length, int fd, const char *path, size_t length, void *user_data) {
+    (void)unique_id;
+    (void)unique_id_length;
+    (void)fd;
+    (void)path;
+    (void)length;
+    (void)user_data;
+    bench_completed_messages++;
+}
+
+// The completing json_segments_add: lookup, sort, concatenate, cJSON_Parse
+// and the processing callback, i.e. the full json_segments_merge path.
+// merge_vector delivers the sorted payloads to a vector function instead,
+// and merge_spill writes every segment to a spill file as it arrives.
+static void bench_merge(void) {
+    static const char *const scenarios[] = { "merge", "merge_vector", "merge_spill" };
+    static const size_t message_sizes[] = { 1u << 10, 64u << 10, 1u << 20, 16u << 20 };
+    static const int segment_sizes[] = { 250, 1400, 64 << 10 };
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char size_name[24];
+
+    for (int mode = 0; mode < 3; mode++) {
+        const char *scenario = scenarios[mode];
+        if (!bench_enabled(scenario)) {
+            continue;
+        }
+        json_segments_context_set_vector_function(&json_segments_default_context, mode == 1 ? bench_count_vector : NULL, NULL);
+        json_segments_context_set_spill(&json_segments_default_context, NULL, 0, mode == 2 ? bench_count_spill : NULL, NULL);
+
+        for (size_t m = 0; m < sizeof(message_sizes) / sizeof(message_sizes[0]); m++) {
+            if (!bench_full && message_sizes[m] > (1u << 20)) {
+                continue;
+            }
+            char *payload = bench_make_payload(message_sizes[m]);
+            bench_format_size(size_name, sizeof(size_name), message_sizes[m]);
+
+            for (size_t s = 0; s < sizeof(segment_sizes) / sizeof(segment_sizes[0]); s++) {
+                size_t segment_length;
+                int total;
+                // Reverse delivery makes the insertion sort quadratic in the segment count, cap it to keep runs bounded
+                // Single-segment messages never reach json_segments_merge, see bench_ingest for their cost
+                if (json_segments_layout("merge", message_sizes[m], segment_sizes[s], &segment_length, &total) != 0 || total < 2 || total > 20000) {
+                    continue;
+                }
+                cJSON **segments = json_segments_split_string(payload, "merge", segment_sizes[s]);
+                size_t repetitions = bench_repetitions(message_sizes[m], 8u << 20);
+                size_t allocations = 0;
+                size_t cache_misses = 0;
+
+                for (size_t r = 0; r < repetitions; r++) {
+                    // Deliver in reverse order so the insertion sort does real work
+                    for (int i = total - 1; i > 0; i--) {
+                        json_segments_parse_input(segments[i]);
+                    }
+                    size_t before = bench_allocations();
+                    size_t misses_before = bench_cache_misses();
+                    double start = bench_now_ns();
+                    json_segments_parse_input(segments[0]);
+                    bench_samples_push(&samples, bench_now_ns() - start);
+                    allocations += bench_allocations() - before;
+                    cache_misses += bench_cache_misses() - misses_before;
+                }
+                snprintf(parameters, sizeof(parameters), "message=%s segment=%d segments=%d", size_name, segment_sizes[s], total);
+                bench_record(scenario, parameters, &samples, message_sizes[m] * repetitions, allocations, cache_misses);
+                json_segments_free_segments_array(segments);
+            }
+            free(payload);
+        }
+    }
+    json_segments_context_set_vector_function(&json_segments_default_context, NULL, NULL);
+    json_segments_context_set_spill(&json_segments_default_context, NULL, 0, NULL, NULL);
+
+    free(samples.values);
+}
+
+static void bench_timeout(void) {
+    static const size_t table_sizes[] = { 100, 1000, 10000, 100000 };
+    BenchSamples samples = { 0 };
+    char parameters[160];
+    char uid[32];
+
+    if (!bench_enabled("check_timeout")) {
+        return;
+    }
+
+    for (size_t t = 0; t < sizeof(table_sizes) / sizeof(table_sizes[0]); t++) {
+        size_t entries = table_sizes[t];
+        if (!bench_full && entries > 10000) {
+            continue;
+        }
+        for (size_t i = 0; i < entries; i++) {
+            snprintf(uid, sizeof(uid), "timeout-%zu", i);
+            json_segments_add(uid, 1, 2, "x");
+        }
+
+        // Scan without expiring anything
+        size_t allocations = bench_allocations();
+        size_t cache_misses = bench_cache_misses();
+        for (int r = 0; r < 20; r++) {
+            double start = bench_now_ns();
+            json_segments_check_timeout(3600);
+            bench_samples_push(&samples, bench_now_ns() - start);
+        }
+        snprintf(parameters, sizeof(parameters), "entries=%zu expired=none", entries);
+        bench_record("check_timeout", parameters, &samples, 0, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+
+        // Expire the whole table in one call
+        allocations = bench_allocations();
+        cache_misses = bench_cache_misses();
+        double start = bench_now_ns();
+        json_segments_check_timeout(-1);
+        bench_samples_push(&samples, bench_now_ns() - start);
+        snprintf(parameters, sizeof(parameters), "entries=%zu expired=all", entries);
+        bench_record("check_timeout", parameters, &samples, 0, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+    }
+
+    free(samples.values);
+}
+
+// Deleting a whole table from the front, by uid and through the handles
+// returned by json_segments_context_add_handle.
+static void bench_delete(void) {
+    static const size_t table_sizes[] = { 100, 1000, 10000, 100000 };
+    BenchSamples samples = { 0 };
+    JsonSegmentsContext context;
+    char parameters[160];
+    char uid[32];
+
+    if (!bench_enabled("delete")) {
+        return;
+    }
+
+    json_segments_context_init(&context, NULL, NULL);
+    for (size_t t = 0; t < sizeof(table_sizes) / sizeof(table_sizes[0]); t++) {
+        size_t entries = table_sizes[t];
+        JsonSegmentsHandle *handles = malloc(sizeof(JsonSegmentsHandle) * entries);
+        if (handles == NULL || (!bench_full && entries > 10000)) {
+            free(handles);
+            continue;
+        }
+
+        // By uid; the lookup is a linear scan, so only for the smaller tables
+        if (entries <= 10000) {
+            for (size_t i = 0; i < entries; i++) {
+                int length = snprintf(uid, sizeof(uid), "delete-%zu", i);
+                json_segments_context_add(&context, uid, (size_t)length, 1, 2, "x", 1);
+            }
+            size_t allocations = bench_allocations();
+            size_t cache_misses = bench_cache_misses();
+            for (size_t i = 0; i < entries; i++) {
+                int length = snprintf(uid, sizeof(uid), "delete-%zu", i);
+                double start = bench_now_ns();
+                json_segments_context_delete_segments(&context, uid, (size_t)length);
+                bench_samples_push(&samples, bench_now_ns() - start);
+            }
+            snprintf(parameters, sizeof(parameters), "entries=%zu by=uid", entries);
+            bench_record("delete", parameters, &samples, 0, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+        }
+
+        for (size_t i = 0; i < entries; i++) {
+            int length = snprintf(uid, sizeof(uid), "delete-%zu", i);
+            json_segments_context_add_handle(&context, uid, (size_t)length, 1, 2, "x", 1, &handles[i]);
+        }
+        size_t allocations = bench_allocations();
+        size_t cache_misses = bench_cache_misses();
+        for (size_t i = 0; i < entries; i++) {
+            double start = bench_now_ns();
+            json_segments_context_delete_handle(&context, handles[i]);
+            bench_samples_push(&samples, bench_now_ns() - start);
+        }
+        snprintf(parameters, sizeof(parameters), "entries=%zu by=handle", entries);
+        bench_record("delete", parameters, &samples, 0, bench_allocations() - allocations, bench_cache_misses() - cache_misses);
+        free(handles);
+    }
+
+    json_segments_context_free(&context);
+    free(samples.values);
+}
+
+int main(int argc, char **argv) {
+    const char *json_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--full") == 0) {
+            bench_full = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            bench_filter = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--full] [--json FILE|-] [--filter SUBSTRING]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    current_json_processing_function = bench_count_completion;
+    bench_cache_open();
+
+    bench_split();
+    bench_split_threads();
+    bench_ingest();
+    bench_add();
+    bench_merge();
+    bench_timeout();
+    bench_delete();
+
+    if (json_path != NULL) {
+        FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (out == NULL) {
+            perror(json_path);
+            return 1;
+        }
+        bench_write_json(out);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,497 @@
+// json_segments_channel_sim.c
+//
+// Deterministic lossy-channel simulator for end-to-end measurements of the
+// reassembler. A sender splits messages with a JsonSegmentsIterator, frames
+// cross a simulated radio link (loss, Gilbert-Elliott burst loss, reordering,
+// duplication, corruption, bandwidth and latency limits) and are fed to
+// json_segments_parse_raw on the receiving side. Time is virtual: the library
+// clock is driven by the simulation through current_json_segments_clock_function,
+// so timeouts behave exactly as on hardware, just without the waiting.
+//
+// Reported: goodput, completion latency percentiles and histogram, timeouts,
+// corrupted deliveries and peak reassembly memory.
+//
+// The exit status is 1 if a message was delivered twice, a message was
+// delivered with wrong content although --corrupt is 0, or fewer than
+// --min-completed (a fraction of --messages) were delivered, so a seeded run
+// can serve as a regression test.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_channel_sim.c json_segments.c json_segments_escape.c -lcjson -o channel_sim
+// Usage:
+//   channel_sim [--seed N] [--messages N] [--message-size BYTES] [--segment-size BYTES]
+//               [--interval-ms MS] [--loss P] [--burst-enter P] [--burst-exit P] [--burst-loss P]
+//               [--reorder P] [--reorder-delay-ms MS] [--duplicate P] [--corrupt P]
+//               [--bandwidth BYTES_PER_S] [--latency-ms MS] [--jitter-ms MS]
+//               [--timeout S] [--check-interval-ms MS] [--min-completed FRACTION]
+//               [--json FILE|-] [--verbose]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+typedef struct {
+    double seed;
+    double messages;
+    double message_size;
+    double segment_size;
+    double interval_ms;
+    double loss;
+    double burst_enter;         // P(good -> bad) per frame
+    double burst_exit;          // P(bad -> good) per frame
+    double burst_loss;          // loss probability while in the bad state
+    double reorder;
+    double reorder_delay_ms;
+    double duplicate;
+    double corrupt;
+    double bandwidth;           // bytes per second
+    double latency_ms;
+    double jitter_ms;
+    double timeout;             // seconds, passed to json_segments_check_timeout
+    double check_interval_ms;
+    double min_completed;       // fraction of messages that must be delivered for exit status 0
+} SimConfig;
+
+typedef struct {
+    const char *name;
+    size_t offset;
+} SimOption;
+
+static const SimOption sim_options[] = {
+    { "--seed", offsetof(SimConfig, seed) },
+    { "--messages", offsetof(SimConfig, messages) },
+    { "--message-size", offsetof(SimConfig, message_size) },
+    { "--segment-size", offsetof(SimConfig, segment_size) },
+    { "--interval-ms", offsetof(SimConfig, interval_ms) },
+    { "--loss", offsetof(SimConfig, loss) },
+    { "--burst-enter", offsetof(SimConfig, burst_enter) },
+    { "--burst-exit", offsetof(SimConfig, burst_exit) },
+    { "--burst-loss", offsetof(SimConfig, burst_loss) },
+    { "--reorder", offsetof(SimConfig, reorder) },
+    { "--reorder-delay-ms", offsetof(SimConfig, reorder_delay_ms) },
+    { "--duplicate", offsetof(SimConfig, duplicate) },
+    { "--corrupt", offsetof(SimConfig, corrupt) },
+    { "--bandwidth", offsetof(SimConfig, bandwidth) },
+    { "--latency-ms", offsetof(SimConfig, latency_ms) },
+    { "--jitter-ms", offsetof(SimConfig, jitter_ms) },
+    { "--timeout", offsetof(SimConfig, timeout) },
+    { "--check-interval-ms", offsetof(SimConfig, check_interval_ms) },
+    { "--min-completed", offsetof(SimConfig, min_completed) },
+};
+
+enum { SIM_SEND, SIM_DELIVER, SIM_CHECK_TIMEOUT };
+
+typedef struct {
+    double time_ms;
+    unsigned long long order;   // tie-break so equal timestamps stay deterministic
+    int type;
+    int message;
+    char *frame;
+    size_t length;
+} SimEvent;
+
+typedef struct {
+    SimEvent *events;
+    size_t count;
+    size_t capacity;
+    unsigned long long next_order;
+} SimQueue;
+
+#define SIM_HISTOGRAM_BUCKETS 24
+
+typedef struct {
+    size_t frames_sent;
+    size_t frames_lost;
+    size_t frames_duplicated;
+    size_t frames_corrupted;
+    size_t frames_delivered;
+    size_t messages_completed;
+    size_t messages_corrupted;
+    size_t messages_repeated;   // deliveries of a message that was already delivered
+    size_t entries_timed_out;
+    size_t peak_entries;
+    size_t peak_buffered_bytes;
+    size_t goodput_bytes;
+    double *latencies_ms;
+    size_t latency_count;
+    size_t histogram[SIM_HISTOGRAM_BUCKETS]; // bucket i: latency < 2^i ms
+} SimStats;
+
+static SimConfig sim_config = {
+    .seed = 1, .messages = 1000, .message_size = 2048, .segment_size = 250, .interval_ms = 50,
+    .loss = 0, .burst_enter = 0, .burst_exit = 0.3, .burst_loss = 1.0,
+    .reorder = 0, .reorder_delay_ms = 20, .duplicate = 0, .corrupt = 0,
+    .bandwidth = 125000, .latency_ms = 5, .jitter_ms = 1, .timeout = 5, .check_interval_ms = 250,
+    .min_completed = 0,
+};
+static SimStats sim_stats;
+static double sim_now_ms;
+static double *sim_send_time_ms;
+static unsigned char *sim_delivered;
+static char *sim_expected_data;
+static unsigned long long sim_random_state;
+
+// splitmix64: small, seedable and identical on every platform.
+static unsigned long long sim_random(void) {
+    unsigned long long z = (sim_random_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double sim_random_unit(void) {
+    return (double)(sim_random() >> 11) / (double)(1ull << 53);
+}
+
+static time_t sim_clock(void) {
+    return (time_t)(sim_now_ms / 1000.0);
+}
+
+static int sim_event_before(const SimEvent *a, const SimEvent *b) {
+    return a->time_ms < b->time_ms || (a->time_ms == b->time_ms && a->order < b->order);
+}
+
+static void sim_push(SimQueue *queue, SimEvent event) {
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 1024;
+        queue->events = realloc(queue->events, queue->capacity * sizeof(SimEvent));
+        if (queue->events == NULL) {
+            fprintf(stdout, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+    event.order = queue->next_order++;
+
+    size_t i = queue->count++;
+    while (i > 0 && sim_event_before(&event, &queue->events[(i - 1) / 2])) {
+        queue->events[i] = queue->events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->events[i] = event;
+}
+
+static SimEvent sim_pop(SimQueue *queue) {
+    SimEvent top = queue->events[0];
+    SimEvent last = queue->events[--queue->count];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && sim_event_before(&queue->events[child + 1], &queue->events[child])) {
+            child++;
+        }
+        if (!sim_event_before(&queue->events[child], &last)) {
+            break;
+        }
+        queue->events[i] = queue->events[child];
+        i = child;
+    }
+    if (queue->count > 0) {
+        queue->events[i] = last;
+    }
+    return top;
+}
+
+// Completed messages carry their id, so the send time and the expected
+// content can be looked up.
+static void sim_process_json(cJSON *json) {
+    cJSON *id = cJSON_GetObjectItem(json, "id");
+    cJSON *data = cJSON_GetObjectItem(json, "data");
+
+    if (!cJSON_IsNumber(id) || id->valueint < 0 || id->valueint >= (int)sim_config.messages ||
+        !cJSON_IsString(data) || strcmp(data->valuestring, sim_expected_data) != 0) {
+        sim_stats.messages_corrupted++;
+        return;
+    }
+
+    if (sim_delivered[id->valueint]) {
+        sim_stats.messages_repeated++;
+        return;
+    }
+    sim_delivered[id->valueint] = 1;
+
+    double latency = sim_now_ms - sim_send_time_ms[id->valueint];
+    size_t bucket = 0;
+    while (bucket + 1 < SIM_HISTOGRAM_BUCKETS && latency >= (double)(1u << bucket)) {
+        bucket++;
+    }
+
+    sim_stats.histogram[bucket]++;
+    sim_stats.latencies_ms[sim_stats.latency_count++] = latency;
+    sim_stats.messages_completed++;
+    sim_stats.goodput_bytes += (size_t)sim_config.message_size;
+}
+
+// Track the peak of the reassembler's in-flight gauges.
+static void sim_sample_memory(void) {
+    JsonSegmentsStats stats;
+    json_segments_stats_snapshot(&stats);
+
+    if (stats.in_flight_uids > sim_stats.peak_entries) {
+        sim_stats.peak_entries = (size_t)stats.in_flight_uids;
+    }
+    if (stats.buffered_bytes > sim_stats.peak_buffered_bytes) {
+        sim_stats.peak_buffered_bytes = (size_t)stats.buffered_bytes;
+    }
+}
+
+// Put one frame on the channel: it is serialized after the frames already
+// queued on the link, then lost, corrupted, delayed or duplicated.
+static void sim_transmit(SimQueue *queue, double *link_free_ms, int *burst_state, const char *frame, size_t length) {
+    double start = *link_free_ms > sim_now_ms ? *link_free_ms : sim_now_ms;
+    *link_free_ms = start + (double)length * 1000.0 / sim_config.bandwidth;
+    sim_stats.frames_sent++;
+
+    // Gilbert-Elliott two-state burst loss, plus independent random loss
+    if (*burst_state) {
+        if (sim_random_unit() < sim_config.burst_exit) {
+            *burst_state = 0;
+        }
+    } else if (sim_random_unit() < sim_config.burst_enter) {
+        *burst_state = 1;
+    }
+    if ((*burst_state && sim_random_unit() < sim_config.burst_loss) || sim_random_unit() < sim_config.loss) {
+        sim_stats.frames_lost++;
+        return;
+    }
+
+    int copies = sim_random_unit() < sim_config.duplicate ? 2 : 1;
+    sim_stats.frames_duplicated += (size_t)(copies - 1);
+
+    for (int c = 0; c < copies; c++) {
+        SimEvent event = { 0 };
+        event.type = SIM_DELIVER;
+        event.time_ms = *link_free_ms + sim_config.latency_ms + sim_config.jitter_ms * sim_random_unit();
+        if (sim_random_unit() < sim_config.reorder) {
+            event.time_ms += sim_config.reorder_delay_ms * sim_random_unit();
+        }
+        event.frame = malloc(length + 1);
+        memcpy(event.frame, frame, length + 1);
+        event.length = length;
+        if (length > 0 && sim_random_unit() < sim_config.corrupt) {
+            event.frame[sim_random() % length] ^= (char)(1u << (sim_random() % 8));
+            sim_stats.frames_corrupted++;
+        }
+        sim_push(queue, event);
+    }
+}
+
+// Build the message body: {"id":N,"data":"..."} padded to message_size.
+static char *sim_make_message(int id, size_t *length) {
+    size_t size = (size_t)sim_config.message_size;
+    char *message = malloc(size + 64);
+    int written = snprintf(message, size + 64, "{\"id\":%d,\"data\":\"%s\"}", id, sim_expected_data);
+    *length = (size_t)written;
+    return message;
+}
+
+static int sim_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double sim_percentile(double percentile) {
+    if (sim_stats.latency_count == 0) {
+        return 0;
+    }
+    return sim_stats.latencies_ms[(size_t)(percentile / 100.0 * (double)(sim_stats.latency_count - 1) + 0.5)];
+}
+
+static void sim_report(FILE *out, int as_json, double duration_ms) {
+    int messages = (int)sim_config.messages;
+    double goodput = duration_ms > 0 ? (double)sim_stats.goodput_bytes * 1000.0 / duration_ms : 0;
+
+    if (!as_json) {
+        fprintf(out, "messages        %d sent, %zu completed, %zu corrupted, %zu reassembly entries timed out\n",
+                messages, sim_stats.messages_completed, sim_stats.messages_corrupted, sim_stats.entries_timed_out);
+        fprintf(out, "frames          %zu sent, %zu lost, %zu duplicated, %zu corrupted, %zu delivered\n",
+                sim_stats.frames_sent, sim_stats.frames_lost, sim_stats.frames_duplicated, sim_stats.frames_corrupted, sim_stats.frames_delivered);
+        fprintf(out, "goodput         %.1f B/s over %.3f s (link %.0f B/s)\n", goodput, duration_ms / 1000.0, sim_config.bandwidth);
+        fprintf(out, "latency (ms)    p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                sim_percentile(50), sim_percentile(90), sim_percentile(99), sim_percentile(100));
+        fprintf(out, "peak memory     %zu entries, %zu bytes buffered\n", sim_stats.peak_entries, sim_stats.peak_buffered_bytes);
+        fprintf(out, "latency histogram:\n");
+        for (int i = 0; i < SIM_HISTOGRAM_BUCKETS; i++) {
+            if (sim_stats.histogram[i] > 0) {
+                fprintf(out, "  < %8u ms  %zu\n", 1u << i, sim_stats.histogram[i]);
+            }
+        }
+        return;
+    }
+
+    fprintf(out, "{\n  \"config\": {");
+    for (size_t i = 0; i < sizeof(sim_options) / sizeof(sim_options[0]); i++) {
+        fprintf(out, "%s\"%s\": %g", i ? ", " : "", sim_options[i].name + 2, *(const double *)((const char *)&sim_config + sim_options[i].offset));
+    }
+    fprintf(out, "},\n");
+    fprintf(out, "  \"messages_sent\": %d,\n  \"messages_completed\": %zu,\n  \"messages_corrupted\": %zu,\n  \"entries_timed_out\": %zu,\n",
+            messages, sim_stats.messages_completed, sim_stats.messages_corrupted, sim_stats.entries_timed_out);
+    fprintf(out, "  \"frames_sent\": %zu,\n  \"frames_lost\": %zu,\n  \"frames_duplicated\": %zu,\n  \"frames_corrupted\": %zu,\n  \"frames_delivered\": %zu,\n",
+            sim_stats.frames_sent, sim_stats.frames_lost, sim_stats.frames_duplicated, sim_stats.frames_corrupted, sim_stats.frames_delivered);
+    fprintf(out, "  \"duration_s\": %.6f,\n  \"goodput_bytes_per_second\": %.1f,\n", duration_ms / 1000.0, goodput);
+    fprintf(out, "  \"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            sim_percentile(50), sim_percentile(90), sim_percentile(99), sim_percentile(100));
+    fprintf(out, "  \"latency_histogram_ms\": [");
+    for (int i = 0; i < SIM_HISTOGRAM_BUCKETS; i++) {
+        fprintf(out, "%s{\"below\": %u, \"count\": %zu}", i ? ", " : "", 1u << i, sim_stats.histogram[i]);
+    }
+    fprintf(out, "],\n  \"peak_entries\": %zu,\n  \"peak_buffered_bytes\": %zu\n}\n", sim_stats.peak_entries, sim_stats.peak_buffered_bytes);
+}
+
+int main(int argc, char **argv) {
+    const char *json_path = NULL;
+    int verbose = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int matched = 0;
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+            continue;
+        }
+        for (size_t o = 0; o < sizeof(sim_options) / sizeof(sim_options[0]) && i + 1 < argc; o++) {
+            if (strcmp(argv[i], sim_options[o].name) == 0) {
+                *(double *)((char *)&sim_config + sim_options[o].offset) = strtod(argv[++i], NULL);
+                matched = 1;
+                break;
+            }
+        }
+        if (!matched) {
+            fprintf(stderr, "Unknown option %s (see the header of json_segments_channel_sim.c)\n", argv[i]);
+            return 2;
+        }
+    }
+
+    int messages = (int)sim_config.messages;
+    if (messages <= 0 || sim_config.message_size < 32 || sim_config.bandwidth <= 0) {
+        fprintf(stderr, "Invalid configuration\n");
+        return 2;
+    }
+
+    // Malformed frames are expected here, so diagnostics are only printed on request
+    if (verbose) {
+        current_json_segments_diagnostic_function = json_segments_stderr_diagnostic;
+    }
+
+    sim_random_state = (unsigned long long)sim_config.seed;
+    sim_send_time_ms = calloc((size_t)messages, sizeof(double));
+    sim_delivered = calloc((size_t)messages, 1);
+    sim_stats.latencies_ms = calloc((size_t)messages, sizeof(double));
+    size_t data_length = (size_t)sim_config.message_size - 24;
+    sim_expected_data = malloc(data_length + 1);
+    for (size_t i = 0; i < data_length; i++) {
+        sim_expected_data[i] = (char)('a' + i % 26);
+    }
+    sim_expected_data[data_length] = '\0';
+
+    current_json_processing_function = sim_process_json;
+    current_json_segments_clock_function = sim_clock;
+
+    SimQueue queue = { 0 };
+    SimEvent first = { 0 };
+    first.type = SIM_SEND;
+    sim_push(&queue, first);
+    SimEvent check = { 0 };
+    check.type = SIM_CHECK_TIMEOUT;
+    check.time_ms = sim_config.check_interval_ms;
+    sim_push(&queue, check);
+
+    double link_free_ms = 0;
+    int burst_state = 0;
+    int pending_sends = 1;
+    char frame[65536];
+
+    while (queue.count > 0) {
+        SimEvent event = sim_pop(&queue);
+        sim_now_ms = event.time_ms;
+
+        if (event.type == SIM_SEND) {
+            size_t length;
+            char uid[16];
+            char *message = sim_make_message(event.message, &length);
+            JsonSegmentsIterator iterator;
+            int frame_length;
+
+            snprintf(uid, sizeof(uid), "s%d", event.message);
+            sim_send_time_ms[event.message] = sim_now_ms;
+            if (json_segments_iterator_init(&iterator, message, length, uid, (int)sim_config.segment_size) == 0) {
+                while ((frame_length = json_segments_iterator_next(&iterator, frame, sizeof(frame))) > 0) {
+                    sim_transmit(&queue, &link_free_ms, &burst_state, frame, (size_t)frame_length);
+                }
+            }
+            free(message);
+
+            pending_sends = event.message + 1 < messages;
+            if (pending_sends) {
+                SimEvent next = { 0 };
+                next.type = SIM_SEND;
+                next.message = event.message + 1;
+                next.time_ms = sim_now_ms + sim_config.interval_ms;
+                sim_push(&queue, next);
+            }
+        } else if (event.type == SIM_DELIVER) {
+            sim_stats.frames_delivered++;
+            json_segments_parse_raw(event.frame, event.length);
+            free(event.frame);
+            sim_sample_memory();
+        } else {
+            int before = all_json_segments_count;
+            json_segments_check_timeout((int)sim_config.timeout);
+            sim_stats.entries_timed_out += (size_t)(before - all_json_segments_count);
+
+            // Keep checking until nothing can arrive anymore and the table has drained
+            if (pending_sends || queue.count > 0 || all_json_segments_count > 0) {
+                SimEvent next = { 0 };
+                next.type = SIM_CHECK_TIMEOUT;
+                next.time_ms = sim_now_ms + sim_config.check_interval_ms;
+                sim_push(&queue, next);
+            }
+        }
+    }
+
+    qsort(sim_stats.latencies_ms, sim_stats.latency_count, sizeof(double), sim_compare_doubles);
+    sim_report(stdout, 0, sim_now_ms);
+    if (json_path != NULL) {
+        FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (out == NULL) {
+            return 1;
+        }
+        sim_report(out, 1, sim_now_ms);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+
+    int status = 0;
+    if (sim_stats.messages_repeated > 0) {
+        fprintf(stderr, "FAIL: %zu messages delivered more than once\n", sim_stats.messages_repeated);
+        status = 1;
+    }
+    if (sim_config.corrupt == 0 && sim_stats.messages_corrupted > 0) {
+        fprintf(stderr, "FAIL: %zu messages delivered with wrong content on a link without corruption\n", sim_stats.messages_corrupted);
+        status = 1;
+    }
+    if ((double)sim_stats.messages_completed < sim_config.min_completed * messages) {
+        fprintf(stderr, "FAIL: %zu of %d messages completed, expected at least %.0f\n", sim_stats.messages_completed, messages,
+                sim_config.min_completed * messages);
+        status = 1;
+    }
+
+    free(queue.events);
+    free(sim_expected_data);
+    free(sim_stats.latencies_ms);
+    free(sim_send_time_ms);
+    free(sim_delivered);
+    return status;
+}
@@ -0,0 +1,245 @@
+// json_segments_concurrent_bench.c
+//
+// Contention benchmark for the lock-free reassembly table. Segments are
+// decoded up front and fed by 1..8 threads, segment i going to thread
+// i % threads, so different threads add segments of the same uid at the same
+// time. Three receivers are compared:
+//
+//   lock-free   one JsonSegmentsConcurrentTable
+//   locked      one JsonSegmentsContext behind a single mutex
+//   sharded     16 JsonSegmentsContexts, each behind its own mutex, picked by uid hash
+//
+// Workloads: "spread" keeps 64 messages of 16 segments in flight and sends
+// them seq-major, "hot" sends one message of 256 segments at a time, so all
+// threads hit the same uid.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_concurrent_bench.c json_segments.c json_segments_escape.c json_segments_concurrent.c -lcjson -lpthread -o concurrent_bench
+// Usage:
+//   concurrent_bench [messages] [segment_length]
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments_concurrent.h"
+
+#define SHARD_COUNT 16
+#define MAX_THREADS 8
+
+typedef struct {
+    char unique_id[16];
+    size_t unique_id_length;
+    int sequence_number;
+    int total_segments;
+    const char *segment;
+    size_t segment_length;
+} Tuple;
+
+typedef struct {
+    pthread_mutex_t lock;
+    JsonSegmentsContext context;
+} LockedContext;
+
+typedef enum { RECEIVER_LOCK_FREE, RECEIVER_LOCKED, RECEIVER_SHARDED } ReceiverKind;
+
+typedef struct {
+    ReceiverKind kind;
+    JsonSegmentsConcurrentTable *table;
+    LockedContext shards[SHARD_COUNT];
+    int shard_count;
+} Receiver;
+
+typedef struct {
+    Receiver *receiver;
+    const Tuple *tuples;
+    size_t tuple_count;
+    int thread_index;
+    int thread_count;
+    pthread_barrier_t *barrier;
+} Worker;
+
+static atomic_long delivered;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void count_message(cJSON *json, void *user_data) {
+    (void)json;
+    (void)user_data;
+    atomic_fetch_add_explicit(&delivered, 1, memory_order_relaxed);
+}
+
+static uint32_t shard_hash(const char *unique_id, size_t unique_id_length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < unique_id_length; i++) {
+        hash = (hash ^ (unsigned char)unique_id[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void receiver_add(Receiver *receiver, const Tuple *tuple) {
+    if (receiver->kind == RECEIVER_LOCK_FREE) {
+        json_segments_concurrent_add(receiver->table, tuple->unique_id, tuple->unique_id_length, tuple->sequence_number, tuple->total_segments,
+                                     tuple->segment, tuple->segment_length);
+        return;
+    }
+
+    LockedContext *shard = &receiver->shards[shard_hash(tuple->unique_id, tuple->unique_id_length) % (uint32_t)receiver->shard_count];
+    pthread_mutex_lock(&shard->lock);
+    json_segments_context_add(&shard->context, tuple->unique_id, tuple->unique_id_length, tuple->sequence_number, tuple->total_segments,
+                              tuple->segment, tuple->segment_length);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static void *worker_main(void *argument) {
+    Worker *worker = argument;
+
+    pthread_barrier_wait(worker->barrier);
+    for (size_t i = (size_t)worker->thread_index; i < worker->tuple_count; i += (size_t)worker->thread_count) {
+        receiver_add(worker->receiver, &worker->tuples[i]);
+    }
+    return NULL;
+}
+
+// Feed all tuples with the given number of threads; returns the elapsed seconds.
+static double run(ReceiverKind kind, const Tuple *tuples, size_t tuple_count, int thread_count) {
+    static Receiver receiver;
+    pthread_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    pthread_barrier_t barrier;
+
+    receiver.kind = kind;
+    receiver.table = NULL;
+    receiver.shard_count = kind == RECEIVER_SHARDED ? SHARD_COUNT : 1;
+    if (kind == RECEIVER_LOCK_FREE) {
+        receiver.table = json_segments_concurrent_create(1024, count_message, NULL);
+    } else {
+        for (int i = 0; i < receiver.shard_count; i++) {
+            pthread_mutex_init(&receiver.shards[i].lock, NULL);
+            json_segments_context_init(&receiver.shards[i].context, count_message, NULL);
+        }
+    }
+
+    atomic_store(&delivered, 0);
+    pthread_barrier_init(&barrier, NULL, (unsigned)thread_count + 1);
+    for (int t = 0; t < thread_count; t++) {
+        workers[t] = (Worker){ &receiver, tuples, tuple_count, t, thread_count, &barrier };
+        pthread_create(&threads[t], NULL, worker_main, &workers[t]);
+    }
+    pthread_barrier_wait(&barrier);
+    double start = now_seconds();
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = now_seconds() - start;
+    pthread_barrier_destroy(&barrier);
+
+    if (kind == RECEIVER_LOCK_FREE) {
+        json_segments_concurrent_free(receiver.table);
+    } else {
+        for (int i = 0; i < receiver.shard_count; i++) {
+            json_segments_context_free(&receiver.shards[i].context);
+            pthread_mutex_destroy(&receiver.shards[i].lock);
+        }
+    }
+    return elapsed;
+}
+
+// Build the segments of message_count messages of total_segments segments,
+// ordered seq-major within windows of window messages.
+static Tuple *build_workload(const char *content, size_t segment_length, int message_count, int total_segments, int window, size_t *tuple_count) {
+    Tuple *tuples = malloc(sizeof(Tuple) * (size_t)message_count * (size_t)total_segments);
+    size_t count = 0;
+
+    if (tuples == NULL) {
+        return NULL;
+    }
+    for (int base = 0; base < message_count; base += window) {
+        int end = base + window < message_count ? base + window : message_count;
+        for (int seq = 1; seq <= total_segments; seq++) {
+            for (int m = base; m < end; m++) {
+                Tuple *tuple = &tuples[count++];
+                tuple->unique_id_length = (size_t)snprintf(tuple->unique_id, sizeof(tuple->unique_id), "m%08d", m);
+                tuple->sequence_number = seq;
+                tuple->total_segments = total_segments;
+                tuple->segment = content + (size_t)(seq - 1) * segment_length;
+                tuple->segment_length = segment_length;
+            }
+        }
+    }
+    *tuple_count = count;
+    return tuples;
+}
+
+// The payload of every message: a JSON string of total_segments * segment_length bytes.
+static char *build_content(size_t segment_length, int total_segments) {
+    size_t length = segment_length * (size_t)total_segments;
+    char *content = malloc(length + 1);
+
+    if (content == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < length; i++) {
+        content[i] = (char)('a' + i % 26);
+    }
+    content[0] = '"';
+    content[length - 1] = '"';
+    content[length] = '\0';
+    return content;
+}
+
+int main(int argc, char **argv) {
+    static const int thread_counts[] = { 1, 2, 4, 8 };
+    static const char *receiver_names[] = { "lock-free", "locked", "sharded" };
+    int messages = argc > 1 ? atoi(argv[1]) : 8192;
+    size_t segment_length = argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 200;
+    struct {
+        const char *name;
+        int total_segments;
+        int window;
+    } workloads[] = { { "spread", 16, 64 }, { "hot", 256, 1 } };
+
+    if (messages <= 0 || segment_length < 2) {
+        fprintf(stderr, "Usage: %s [messages] [segment_length]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-8s %-10s %8s %14s %12s\n", "workload", "receiver", "threads", "segments/s", "delivered");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        int total_segments = workloads[w].total_segments;
+        // Keep the number of segments equal across workloads
+        int message_count = messages * 16 / total_segments;
+        size_t tuple_count;
+        char *content = build_content(segment_length, total_segments);
+        Tuple *tuples = content != NULL ? build_workload(content, segment_length, message_count, total_segments, workloads[w].window, &tuple_count) : NULL;
+        if (tuples == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return 1;
+        }
+
+        for (int r = RECEIVER_LOCK_FREE; r <= RECEIVER_SHARDED; r++) {
+            for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+                double elapsed = run((ReceiverKind)r, tuples, tuple_count, thread_counts[t]);
+                long count = atomic_load(&delivered);
+                printf("%-8s %-10s %8d %14.0f %12ld%s\n", workloads[w].name, receiver_names[r], thread_counts[t], (double)tuple_count / elapsed, count,
+                       count == message_count ? "" : "  MISMATCH");
+                if (count != message_count) {
+                    return 1;
+                }
+            }
+        }
+        free(tuples);
+        free(content);
+    }
+    json_segments_concurrent_reclaim();
+    return 0;
+}
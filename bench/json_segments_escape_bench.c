@@ -0,0 +1,132 @@
+// json_segments_escape_bench.c
+//
+// Microbenchmark for the segment payload escape/unescape kernel, compared
+// with the cJSON string printer/parser it replaces on the frame hot path.
+//
+// Build (add -mavx2 to benchmark the AVX2 kernel, -DJSON_SEGMENTS_NO_SIMD for the scalar fallback):
+//   cc -O2 -I. bench/json_segments_escape_bench.c json_segments.c json_segments_escape.c -lcjson -o escape_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Fill buf with JSON-like text: mostly plain characters with a quote every
+// 'density' bytes (0 = no special characters at all).
+static void fill_payload(char *buf, size_t length, int density) {
+    static const char plain[] = "abcdefghijklmnopqrstuvwxyz0123456789:,{}[] ";
+    for (size_t i = 0; i < length; i++) {
+        buf[i] = plain[i % (sizeof(plain) - 1)];
+        if (density > 0 && i % (size_t)density == 0) {
+            buf[i] = (i / (size_t)density) % 4 == 0 ? '\n' : '"';
+        }
+    }
+    buf[length] = '\0';
+}
+
+static void report(const char *name, size_t length, int density, size_t bytes, double seconds) {
+    printf("%-22s %8zu B  density %3d  %9.1f MB/s\n", name, length, density, (double)bytes / seconds / 1e6);
+}
+
+static void bench_case(size_t length, int density) {
+    char *payload = malloc(length + 1);
+    char *escaped = malloc(length * 6 + 1);
+    char *unescaped = malloc(length + 1);
+    size_t iterations = (64u << 20) / (length + 1) + 1;
+    volatile size_t sink = 0;
+
+    fill_payload(payload, length, density);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += json_segments_escape(escaped, payload, length);
+    }
+    report("escape (kernel)", length, density, iterations * length, now_seconds() - start);
+
+    cJSON *string_item = cJSON_CreateString(payload);
+    start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        char *printed = cJSON_PrintUnformatted(string_item);
+        sink += strlen(printed);
+        cJSON_free(printed);
+    }
+    report("escape (cJSON)", length, density, iterations * length, now_seconds() - start);
+
+    size_t escaped_length = json_segments_escape(escaped, payload, length);
+    start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += json_segments_unescape(unescaped, escaped, escaped_length);
+    }
+    report("unescape (kernel)", length, density, iterations * length, now_seconds() - start);
+
+    char *quoted = cJSON_PrintUnformatted(string_item);
+    start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        cJSON *parsed = cJSON_Parse(quoted);
+        sink += parsed != NULL;
+        cJSON_Delete(parsed);
+    }
+    report("unescape (cJSON)", length, density, iterations * length, now_seconds() - start);
+
+    cJSON_free(quoted);
+    cJSON_Delete(string_item);
+    free(unescaped);
+    free(escaped);
+    free(payload);
+    (void)sink;
+}
+
+static void bench_ingest(size_t segment_length) {
+    char *payload = malloc(segment_length + 1);
+    size_t frame_size = segment_length * 6 + 64;
+    char *frame = malloc(frame_size);
+    size_t iterations = (32u << 20) / (segment_length + 1) + 1;
+
+    fill_payload(payload, segment_length, 16);
+    int frame_length = json_segments_write_frame(frame, frame_size, "bench", 1, 2, payload, segment_length);
+
+    // Each frame is the first of two, so the table entry is created and then deleted
+    double start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        json_segments_parse_raw(frame, (size_t)frame_length);
+        json_segments_delete_segments("bench");
+    }
+    report("ingest (raw)", segment_length, 16, iterations * segment_length, now_seconds() - start);
+
+    start = now_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        cJSON *json = cJSON_Parse(frame);
+        json_segments_parse_input(json);
+        cJSON_Delete(json);
+        json_segments_delete_segments("bench");
+    }
+    report("ingest (cJSON)", segment_length, 16, iterations * segment_length, now_seconds() - start);
+
+    free(frame);
+    free(payload);
+}
+
+int main(void) {
+    static const size_t lengths[] = { 32, 200, 4096, 65536 };
+    static const int densities[] = { 0, 64, 8 };
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+            bench_case(lengths[l], densities[d]);
+        }
+    }
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        bench_ingest(lengths[l]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+// json_segments_parallel_bench.c
+//
+// Scaling benchmark for the parallel splitter: splits one large payload with
+// 1..16 threads and reports throughput and speedup over a single thread.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_parallel_bench.c json_segments.c json_segments_escape.c json_segments_parallel.c -lcjson -lpthread -o parallel_bench
+// Usage:
+//   parallel_bench [payload_megabytes] [max_length]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments_parallel.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    size_t megabytes = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 64;
+    int max_length = argc > 2 ? atoi(argv[2]) : 1400;
+    size_t length = megabytes << 20;
+    const char *uid = "parallel-bench";
+
+    char *payload = malloc(length + 1);
+    if (payload == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = i % 29 == 0 ? '"' : (char)('a' + i % 26);
+    }
+    payload[length] = '\0';
+
+    size_t segment_length;
+    int total_segments;
+    if (json_segments_layout(uid, length, max_length, &segment_length, &total_segments) != 0) {
+        fprintf(stderr, "max_length %d is too small\n", max_length);
+        return 1;
+    }
+
+    size_t stride = json_segments_frame_capacity(uid, segment_length, total_segments);
+    char *frames = malloc(stride * (size_t)total_segments);
+    int *frame_lengths = malloc(sizeof(int) * (size_t)total_segments);
+    if (frames == NULL || frame_lengths == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 1;
+    }
+
+    // Touch the output slots once so the first measurement does not pay for page faults
+    json_segments_write_frames_parallel(payload, length, uid, max_length, frames, stride, frame_lengths, 1, NULL, NULL);
+
+    printf("payload %zu MB, %d segments of %zu bytes\n", megabytes, total_segments, segment_length);
+    printf("%-8s %14s %9s %14s %9s\n", "threads", "frames MB/s", "speedup", "cJSON MB/s", "speedup");
+
+    double frames_baseline = 0;
+    double cjson_baseline = 0;
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int threads = thread_counts[t];
+
+        double start = now_seconds();
+        if (json_segments_write_frames_parallel(payload, length, uid, max_length, frames, stride, frame_lengths, threads, NULL, NULL) != 0) {
+            fprintf(stderr, "write_frames_parallel failed\n");
+            return 1;
+        }
+        double frames_rate = (double)length / (now_seconds() - start) / 1e6;
+
+        start = now_seconds();
+        cJSON **segments = json_segments_split_string_parallel(payload, uid, max_length, threads, NULL, NULL);
+        double cjson_rate = (double)length / (now_seconds() - start) / 1e6;
+        json_segments_free_segments_array(segments);
+
+        if (t == 0) {
+            frames_baseline = frames_rate;
+            cjson_baseline = cjson_rate;
+        }
+        printf("%-8d %14.1f %8.2fx %14.1f %8.2fx\n", threads, frames_rate, frames_rate / frames_baseline, cjson_rate, cjson_rate / cjson_baseline);
+    }
+
+    free(frame_lengths);
+    free(frames);
+    free(payload);
+    return 0;
+}
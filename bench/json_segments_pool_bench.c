@@ -0,0 +1,144 @@
+// json_segments_pool_bench.c
+//
+// Completion latency under a burst: a number of large messages are buffered
+// up to their last segment, then all last segments arrive back to back. The
+// time from the start of the burst to each message's processing function is
+// measured with merge, parse and callback running inline on the ingest
+// thread and on a work-stealing pool of 1..8 workers.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_pool_bench.c json_segments.c json_segments_escape.c json_segments_pool.c -lcjson -lpthread -o pool_bench
+// Usage:
+//   pool_bench [messages] [message_kilobytes] [segment_length]
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments_pool.h"
+
+typedef struct {
+    double start;
+    double *latencies;
+    atomic_int completed;
+} Burst;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void record_completion(cJSON *json, void *user_data) {
+    Burst *burst = user_data;
+    int index = atomic_fetch_add(&burst->completed, 1);
+
+    (void)json;
+    burst->latencies[index] = now_seconds() - burst->start;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// A JSON array of numbers, which makes parsing a real share of the completion cost.
+static char *build_payload(size_t length) {
+    char *payload = malloc(length + 1);
+    size_t used = 1;
+
+    if (payload == NULL) {
+        return NULL;
+    }
+    payload[0] = '[';
+    for (unsigned int value = 100000; used + 8 < length; value += 7919) {
+        used += (size_t)snprintf(payload + used, length + 1 - used, "%u,", value % 900000 + 100000);
+    }
+    while (used < length - 2) {
+        payload[used++] = ' ';
+    }
+    memcpy(payload + used, "0]", 2);
+    payload[length] = '\0';
+    return payload;
+}
+
+// Run one burst; workers == 0 completes inline. Returns the makespan in seconds.
+static double run_burst(const char *payload, size_t length, size_t segment_length, int messages, int workers, double *latencies) {
+    JsonSegmentsContext context;
+    JsonSegmentsPool *pool = workers > 0 ? json_segments_pool_create(workers) : NULL;
+    Burst burst;
+    int total_segments = (int)((length + segment_length - 1) / segment_length);
+    char uid[32];
+
+    burst.latencies = latencies;
+    atomic_init(&burst.completed, 0);
+    json_segments_context_init(&context, record_completion, &burst);
+    if (pool != NULL) {
+        json_segments_context_set_executor(&context, json_segments_pool_submit, pool);
+    }
+
+    for (int m = 0; m < messages; m++) {
+        int uid_length = snprintf(uid, sizeof(uid), "burst-%d", m);
+        for (int seq = 1; seq < total_segments; seq++) {
+            size_t start = (size_t)(seq - 1) * segment_length;
+            json_segments_context_add(&context, uid, (size_t)uid_length, seq, total_segments, payload + start, segment_length);
+        }
+    }
+
+    burst.start = now_seconds();
+    for (int m = 0; m < messages; m++) {
+        int uid_length = snprintf(uid, sizeof(uid), "burst-%d", m);
+        size_t start = (size_t)(total_segments - 1) * segment_length;
+        json_segments_context_add(&context, uid, (size_t)uid_length, total_segments, total_segments, payload + start, length - start);
+    }
+    json_segments_pool_wait(pool);
+    double makespan = now_seconds() - burst.start;
+
+    json_segments_pool_free(pool);
+    json_segments_context_free(&context);
+    return atomic_load(&burst.completed) == messages ? makespan : -1;
+}
+
+int main(int argc, char **argv) {
+    static const int worker_counts[] = { 0, 1, 2, 4, 8 };
+    int messages = argc > 1 ? atoi(argv[1]) : 32;
+    size_t length = (argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 512) * 1024;
+    size_t segment_length = argc > 3 ? (size_t)strtoul(argv[3], NULL, 10) : 1400;
+
+    if (messages <= 0 || length < 16 || segment_length == 0) {
+        fprintf(stderr, "Usage: %s [messages] [message_kilobytes] [segment_length]\n", argv[0]);
+        return 1;
+    }
+
+    char *payload = build_payload(length);
+    double *latencies = malloc(sizeof(double) * (size_t)messages);
+    if (payload == NULL || latencies == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 1;
+    }
+
+    printf("burst of %d messages of %zu KB, %zu-byte segments\n", messages, length / 1024, segment_length);
+    printf("%-8s %12s %12s %12s %12s\n", "workers", "p50 ms", "p99 ms", "max ms", "makespan ms");
+    for (size_t w = 0; w < sizeof(worker_counts) / sizeof(worker_counts[0]); w++) {
+        double makespan = run_burst(payload, length, segment_length, messages, worker_counts[w], latencies);
+        if (makespan < 0) {
+            fprintf(stderr, "Not every message was delivered\n");
+            return 1;
+        }
+        qsort(latencies, (size_t)messages, sizeof(double), compare_double);
+        char label[16] = "inline";
+        if (worker_counts[w] > 0) {
+            snprintf(label, sizeof(label), "%d", worker_counts[w]);
+        }
+        printf("%-8s %12.2f %12.2f %12.2f %12.2f\n", label, latencies[messages / 2] * 1e3, latencies[(messages * 99) / 100] * 1e3,
+               latencies[messages - 1] * 1e3, makespan * 1e3);
+    }
+
+    free(latencies);
+    free(payload);
+    return 0;
+}
@@ -0,0 +1,110 @@
+// json_segments_segmenter_bench.cpp
+//
+// Compares the compile-time specialized Segmenter (250-byte MTU, 8-character
+// uid) with the runtime splitters on the same payloads, after checking that
+// all of them produce identical frames.
+//
+// Build:
+//   c++ -std=c++17 -O2 -I. bench/json_segments_segmenter_bench.cpp json_segments.c json_segments_escape.c -lcjson -o segmenter_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cJSON.h>
+
+#include "json_segments_segmenter.hpp"
+
+using EspNowSegmenter = json_segments::Segmenter<250, 8, 1024>;
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// JSON-like text with a quote every 29 bytes, so the content needs some escaping.
+static std::string make_payload(std::size_t length) {
+    std::string payload(length, ' ');
+    for (std::size_t i = 0; i < length; i++) {
+        payload[i] = i % 29 == 0 ? '"' : static_cast<char>('a' + i % 26);
+    }
+    return payload;
+}
+
+// Check that the Segmenter produces the same bytes as the iterator and json_segments_split_string().
+static bool frames_match(const std::string &payload, const char *uid) {
+    EspNowSegmenter segmenter(payload, uid);
+    JsonSegmentsIterator iterator;
+    if (!segmenter.valid() || json_segments_iterator_init(&iterator, payload.data(), payload.size(), uid, 250) != 0 ||
+        iterator.total_segments != segmenter.total_segments()) {
+        return false;
+    }
+
+    std::vector<char> expected(json_segments_frame_capacity(uid, iterator.segment_length, iterator.total_segments));
+    cJSON **segments = json_segments_split_string(payload.c_str(), uid, 250);
+    EspNowSegmenter::Frame frame;
+    bool match = segments != nullptr;
+    int index = 0;
+    int length;
+    while (match && (length = segmenter.next(frame)) > 0) {
+        char *printed = cJSON_PrintUnformatted(segments[index++]);
+        match = json_segments_iterator_next(&iterator, expected.data(), expected.size()) == length &&
+                std::memcmp(expected.data(), frame.data(), static_cast<std::size_t>(length) + 1) == 0 &&
+                printed != nullptr && std::strcmp(printed, frame.data()) == 0;
+        cJSON_free(printed);
+    }
+    match = match && length == 0 && index == segmenter.total_segments();
+    json_segments_free_segments_array(segments);
+    return match;
+}
+
+int main() {
+    static const std::size_t lengths[] = { 200, 1000, 16000, 200000 };
+    const char *uid = "a1b2c3d4";
+    volatile std::size_t sink = 0;
+
+    std::printf("%-10s %8s %16s %16s %16s\n", "payload", "frames", "Segmenter MB/s", "iterator MB/s", "split MB/s");
+    for (std::size_t length : lengths) {
+        std::string payload = make_payload(length);
+        if (!frames_match(payload, uid)) {
+            std::fprintf(stderr, "frames differ for a %zu byte payload\n", length);
+            return 1;
+        }
+
+        std::size_t iterations = (std::size_t{256} << 20) / length + 1;
+        EspNowSegmenter::Frame frame;
+        double start = now_seconds();
+        for (std::size_t i = 0; i < iterations; i++) {
+            EspNowSegmenter segmenter(payload, uid);
+            int frame_length;
+            while ((frame_length = segmenter.next(frame)) > 0) {
+                sink += static_cast<std::size_t>(frame_length);
+            }
+        }
+        double segmenter_rate = static_cast<double>(iterations * length) / (now_seconds() - start) / 1e6;
+
+        start = now_seconds();
+        for (std::size_t i = 0; i < iterations; i++) {
+            JsonSegmentsIterator iterator;
+            json_segments_iterator_init(&iterator, payload.data(), payload.size(), uid, 250);
+            int frame_length;
+            while ((frame_length = json_segments_iterator_next(&iterator, frame.data(), frame.size())) > 0) {
+                sink += static_cast<std::size_t>(frame_length);
+            }
+        }
+        double iterator_rate = static_cast<double>(iterations * length) / (now_seconds() - start) / 1e6;
+
+        std::size_t split_iterations = iterations / 16 + 1;
+        start = now_seconds();
+        for (std::size_t i = 0; i < split_iterations; i++) {
+            cJSON **segments = json_segments_split_string(payload.c_str(), uid, 250);
+            sink += segments != nullptr;
+            json_segments_free_segments_array(segments);
+        }
+        double split_rate = static_cast<double>(split_iterations * length) / (now_seconds() - start) / 1e6;
+
+        std::printf("%-10zu %8d %16.1f %16.1f %16.1f\n", length, EspNowSegmenter(payload, uid).total_segments(), segmenter_rate,
+                    iterator_rate, split_rate);
+    }
+    return 0;
+}
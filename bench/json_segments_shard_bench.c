@@ -0,0 +1,259 @@
+// json_segments_shard_bench.c
+//
+// Benchmark for thread-per-core reassembly. First it compares the cost of
+// steering a frame (json_segments_frame_unique_id_hash) with decoding it
+// completely (json_segments_decode_frame). Then one receive thread routes
+// serialized frames of many interleaved messages to 1..8 shard threads, each
+// owning a private context, and the end-to-end frame rate is compared with a
+// single thread calling json_segments_parse_raw.
+//
+// Build:
+//   cc -O2 -I. bench/json_segments_shard_bench.c json_segments.c json_segments_escape.c json_segments_shard.c -lcjson -lpthread -o shard_bench
+// Usage:
+//   shard_bench [messages] [message_length] [max_length]
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments_shard.h"
+
+#define MAX_SHARDS 8
+#define WINDOW 64
+
+typedef struct {
+    char *data;
+    size_t *offsets;
+    size_t *lengths;
+    size_t count;
+    size_t max_length;
+} FrameSet;
+
+typedef struct {
+    JsonSegmentsShardSet *shards;
+    int shard;
+} ShardWorker;
+
+static atomic_long delivered;
+static atomic_int producer_done;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void count_message(cJSON *json, void *user_data) {
+    (void)json;
+    (void)user_data;
+    atomic_fetch_add_explicit(&delivered, 1, memory_order_relaxed);
+}
+
+static void count_processed(cJSON *json) {
+    count_message(json, NULL);
+}
+
+static JsonSegmentsError discard_segment(void *target, const char *unique_id, size_t unique_id_length, int sequence_number, int total_segments,
+                                         const char *json_segment, size_t json_segment_length) {
+    (void)unique_id;
+    (void)unique_id_length;
+    (void)sequence_number;
+    (void)total_segments;
+    (void)json_segment;
+    *(size_t *)target += json_segment_length;
+    return JSON_SEGMENTS_OK;
+}
+
+// Serialize message_count messages, interleaving the frames of WINDOW
+// messages at a time like a gateway receiving from many senders.
+static int build_frames(FrameSet *set, int message_count, size_t message_length, int max_length) {
+    char *payload = malloc(message_length + 1);
+    JsonSegmentsIterator *iterators = malloc(sizeof(JsonSegmentsIterator) * WINDOW);
+    char (*uids)[24] = malloc(sizeof(*uids) * WINDOW);
+    size_t capacity = 1 << 20;
+    size_t used = 0;
+
+    set->data = malloc(capacity);
+    set->offsets = NULL;
+    set->lengths = NULL;
+    set->count = 0;
+    set->max_length = 0;
+    if (payload == NULL || iterators == NULL || uids == NULL || set->data == NULL) {
+        return -1;
+    }
+    int prefix = snprintf(payload, message_length + 1, "{\"p\":\"");
+    for (size_t i = (size_t)prefix; i < message_length; i++) {
+        payload[i] = (char)('a' + i % 26);
+    }
+    memcpy(payload + message_length - 2, "\"}", 2);
+    payload[message_length] = '\0';
+
+    size_t frame_count_capacity = 0;
+    for (int base = 0; base < message_count; base += WINDOW) {
+        int end = base + WINDOW < message_count ? base + WINDOW : message_count;
+        for (int m = base; m < end; m++) {
+            snprintf(uids[m - base], sizeof(uids[0]), "sensor-%d", m);
+            if (json_segments_iterator_init(&iterators[m - base], payload, message_length, uids[m - base], max_length) != 0) {
+                return -1;
+            }
+        }
+
+        int active = end - base;
+        while (active > 0) {
+            active = 0;
+            for (int m = base; m < end; m++) {
+                char frame[4096];
+                int length = json_segments_iterator_next(&iterators[m - base], frame, sizeof(frame));
+                if (length <= 0) {
+                    continue;
+                }
+                active++;
+                if (used + (size_t)length > capacity) {
+                    capacity *= 2;
+                    set->data = realloc(set->data, capacity);
+                }
+                if (set->count == frame_count_capacity) {
+                    frame_count_capacity = frame_count_capacity ? frame_count_capacity * 2 : 1024;
+                    set->offsets = realloc(set->offsets, sizeof(size_t) * frame_count_capacity);
+                    set->lengths = realloc(set->lengths, sizeof(size_t) * frame_count_capacity);
+                }
+                if (set->data == NULL || set->offsets == NULL || set->lengths == NULL) {
+                    return -1;
+                }
+                memcpy(set->data + used, frame, (size_t)length);
+                set->offsets[set->count] = used;
+                set->lengths[set->count] = (size_t)length;
+                set->count++;
+                used += (size_t)length;
+                if ((size_t)length > set->max_length) {
+                    set->max_length = (size_t)length;
+                }
+            }
+        }
+    }
+    free(payload);
+    free(iterators);
+    free(uids);
+    return 0;
+}
+
+static void *shard_main(void *argument) {
+    ShardWorker *worker = argument;
+
+    for (;;) {
+        if (json_segments_shards_poll(worker->shards, worker->shard, 64) > 0) {
+            continue;
+        }
+        if (atomic_load_explicit(&producer_done, memory_order_acquire)) {
+            // Everything was queued before the flag was set
+            while (json_segments_shards_poll(worker->shards, worker->shard, 0) > 0) {
+            }
+            return NULL;
+        }
+        sched_yield();
+    }
+}
+
+// Route all frames from this thread to shard_count shard threads; returns the elapsed seconds.
+static double run_sharded(const FrameSet *set, int shard_count) {
+    pthread_t threads[MAX_SHARDS];
+    ShardWorker workers[MAX_SHARDS];
+    JsonSegmentsShardSet *shards = json_segments_shards_create(shard_count, 1, 1024, set->max_length, count_message, NULL);
+
+    if (shards == NULL) {
+        return -1;
+    }
+    atomic_store(&delivered, 0);
+    atomic_store(&producer_done, 0);
+
+    double start = now_seconds();
+    for (int i = 0; i < shard_count; i++) {
+        workers[i] = (ShardWorker){ shards, i };
+        pthread_create(&threads[i], NULL, shard_main, &workers[i]);
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        while (json_segments_shards_route(shards, 0, set->data + set->offsets[i], set->lengths[i]) == JSON_SEGMENTS_ERROR_FULL) {
+            sched_yield();
+        }
+    }
+    atomic_store_explicit(&producer_done, 1, memory_order_release);
+    for (int i = 0; i < shard_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    json_segments_shards_free(shards);
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    static const int shard_counts[] = { 1, 2, 4, 8 };
+    int message_count = argc > 1 ? atoi(argv[1]) : 4096;
+    size_t message_length = argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 4096;
+    int max_length = argc > 3 ? atoi(argv[3]) : 250;
+    FrameSet set;
+
+    if (message_count <= 0 || message_length < 16) {
+        fprintf(stderr, "Usage: %s [messages] [message_length] [max_length]\n", argv[0]);
+        return 1;
+    }
+    if (build_frames(&set, message_count, message_length, max_length) != 0) {
+        fprintf(stderr, "Could not build frames (max_length %d too small?)\n", max_length);
+        return 1;
+    }
+    printf("%d messages of %zu bytes, %zu frames\n", message_count, message_length, set.count);
+
+    // Steering cost against a full decode of the same frames
+    uint64_t hash_sum = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < set.count; i++) {
+        uint64_t hash;
+        json_segments_frame_unique_id_hash(set.data + set.offsets[i], set.lengths[i], &hash);
+        hash_sum += hash;
+    }
+    double hash_time = now_seconds() - start;
+
+    size_t decoded_bytes = 0;
+    start = now_seconds();
+    for (size_t i = 0; i < set.count; i++) {
+        json_segments_decode_frame(set.data + set.offsets[i], set.lengths[i], discard_segment, &decoded_bytes);
+    }
+    double decode_time = now_seconds() - start;
+    printf("uid hash   %8.1f ns/frame (checksum %llx)\n", hash_time / (double)set.count * 1e9, (unsigned long long)(hash_sum & 0xffff));
+    printf("decode     %8.1f ns/frame (%zu bytes)\n", decode_time / (double)set.count * 1e9, decoded_bytes);
+
+    // Single-threaded baseline on the default context
+    current_json_processing_function = count_processed;
+    atomic_store(&delivered, 0);
+    start = now_seconds();
+    for (size_t i = 0; i < set.count; i++) {
+        json_segments_parse_raw(set.data + set.offsets[i], set.lengths[i]);
+    }
+    double baseline = now_seconds() - start;
+    printf("\n%-10s %14s %9s %10s\n", "shards", "frames/s", "speedup", "delivered");
+    printf("%-10s %14.0f %9.2f %10ld\n", "inline", (double)set.count / baseline, 1.0, atomic_load(&delivered));
+
+    for (size_t s = 0; s < sizeof(shard_counts) / sizeof(shard_counts[0]); s++) {
+        double elapsed = run_sharded(&set, shard_counts[s]);
+        long count = atomic_load(&delivered);
+        if (elapsed < 0) {
+            fprintf(stderr, "Memory allocation error\n");
+            return 1;
+        }
+        printf("%-10d %14.0f %9.2f %10ld%s\n", shard_counts[s], (double)set.count / elapsed, baseline / elapsed, count,
+               count == message_count ? "" : "  MISMATCH");
+        if (count != message_count) {
+            return 1;
+        }
+    }
+
+    free(set.data);
+    free(set.offsets);
+    free(set.lengths);
+    return 0;
+}
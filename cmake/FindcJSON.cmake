@@ -0,0 +1,37 @@
+# FindcJSON.cmake
+#
+# Locate cJSON and provide the imported target cJSON::cJSON.
+#
+# The sources include <cJSON.h>, while cJSON installs its header as
+# <cjson/cJSON.h>, so the header directory itself is searched. pkg-config
+# (libcjson) is only used for hints. Set cJSON_ROOT or CMAKE_PREFIX_PATH to
+# point at a non-standard installation.
+#
+# Result variables: cJSON_FOUND, cJSON_INCLUDE_DIR, cJSON_LIBRARY
+
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+    pkg_check_modules(PC_cJSON QUIET libcjson)
+endif()
+
+find_path(cJSON_INCLUDE_DIR cJSON.h
+    HINTS ${PC_cJSON_INCLUDEDIR} ${PC_cJSON_INCLUDE_DIRS}
+    PATH_SUFFIXES cjson)
+find_library(cJSON_LIBRARY
+    NAMES cjson
+    HINTS ${PC_cJSON_LIBDIR} ${PC_cJSON_LIBRARY_DIRS})
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(cJSON REQUIRED_VARS cJSON_LIBRARY cJSON_INCLUDE_DIR)
+mark_as_advanced(cJSON_INCLUDE_DIR cJSON_LIBRARY)
+
+if(cJSON_FOUND AND NOT TARGET cJSON::cJSON)
+    add_library(cJSON::cJSON UNKNOWN IMPORTED)
+    set_target_properties(cJSON::cJSON PROPERTIES
+        IMPORTED_LOCATION "${cJSON_LIBRARY}"
+        INTERFACE_INCLUDE_DIRECTORIES "${cJSON_INCLUDE_DIR}")
+    # A static cJSON does not carry its libm dependency
+    if(UNIX AND cJSON_LIBRARY MATCHES "\\.a$")
+        set_property(TARGET cJSON::cJSON APPEND PROPERTY INTERFACE_LINK_LIBRARIES m)
+    endif()
+endif()
@@ -1,132 +1,1517 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
 #include <cJSON.h>
 
+#if !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#endif
+
 #include "json_segments.h"
 
 // Initialize the global function pointer for JSON processing to NULL.
 // This ensures it's explicitly set by the user before use.
 JsonProcessingFunction current_json_processing_function = NULL;
 
-// Initialize the global pointer for storing JSON segment information to NULL.
-// This will be allocated memory as segments are added.
-JsonSegmentInfo *all_json_segments = NULL;
-
-int all_json_segments_count = 0;
-
-// Add a JSON segment to the global array. This function searches for the
-// unique_id in all_json_segments. If found, it adds the segment to the
-// existing JsonSegmentInfo structure. If not found, it creates a new entry.
-void json_segments_add(const char *unique_id, int sequence_number, int total_segments, const char *json_segment) {
-    // Search for unique_id in all_json_segments
-    for (int i = 0; i < all_json_segments_count; i++) {
-        // Check if we already received segments of the same unique id
-        if (strcmp(all_json_segments[i].unique_id, unique_id) == 0) {
-            // Check data consistency
-            if (all_json_segments[i].total_segments != total_segments) {
-                fprintf(stderr, "Error: Inconsistent total number of segments\n");
-                return;
+// Clock used for segment timestamps and timeouts. NULL means time(NULL).
+JsonSegmentsClockFunction current_json_segments_clock_function = NULL;
+
+// Diagnostics are off by default: a flood of bad frames must not turn into
+// a flood of write(2) calls.
+JsonSegmentsDiagnosticFunction current_json_segments_diagnostic_function = NULL;
+
+int json_segments_diagnostic_rate_limit = 10;
+
+// Lifecycle trace hook, only invoked in builds with JSON_SEGMENTS_TRACE.
+JsonSegmentsTraceFunction current_json_segments_trace_function = NULL;
+
+// Context used by the functions without a context parameter. The table
+// starts out empty and is allocated as segments are added; the legacy names
+// all_json_segments and all_json_segments_count refer to it. Fields not
+// named here start out zero or NULL.
+JsonSegmentsContext json_segments_default_context = { .free_slot = -1 };
+
+// Runtime counters. Relaxed atomics are enough: every counter is independent
+// and only read through json_segments_stats_snapshot().
+#if defined(JSON_SEGMENTS_NO_STATS)
+#define JSON_SEGMENTS_STAT_ADD(counter, value) ((void)0)
+#define JSON_SEGMENTS_STAT_SUB(counter, value) ((void)0)
+#define JSON_SEGMENTS_STAT_LOAD(counter) 0ULL
+#define JSON_SEGMENTS_STAT_STORE(counter, value) ((void)0)
+#elif defined(__STDC_NO_ATOMICS__)
+typedef unsigned long long JsonSegmentsCounter;
+#define JSON_SEGMENTS_STAT_ADD(counter, value) (json_segments_counters.counter += (value))
+#define JSON_SEGMENTS_STAT_SUB(counter, value) (json_segments_counters.counter -= (value))
+#define JSON_SEGMENTS_STAT_LOAD(counter) (json_segments_counters.counter)
+#define JSON_SEGMENTS_STAT_STORE(counter, value) (json_segments_counters.counter = (value))
+#else
+typedef _Atomic unsigned long long JsonSegmentsCounter;
+#define JSON_SEGMENTS_STAT_ADD(counter, value) atomic_fetch_add_explicit(&json_segments_counters.counter, (value), memory_order_relaxed)
+#define JSON_SEGMENTS_STAT_SUB(counter, value) atomic_fetch_sub_explicit(&json_segments_counters.counter, (value), memory_order_relaxed)
+#define JSON_SEGMENTS_STAT_LOAD(counter) atomic_load_explicit(&json_segments_counters.counter, memory_order_relaxed)
+#define JSON_SEGMENTS_STAT_STORE(counter, value) atomic_store_explicit(&json_segments_counters.counter, (value), memory_order_relaxed)
+#endif
+
+#if !defined(JSON_SEGMENTS_NO_STATS)
+static struct {
+    JsonSegmentsCounter in_flight_uids;
+    JsonSegmentsCounter buffered_bytes;
+    JsonSegmentsCounter segments_accepted;
+    JsonSegmentsCounter segments_duplicate;
+    JsonSegmentsCounter segments_inconsistent;
+    JsonSegmentsCounter segments_invalid;
+    JsonSegmentsCounter segments_out_of_memory;
+    JsonSegmentsCounter messages_merged;
+    JsonSegmentsCounter messages_parse_failed;
+    JsonSegmentsCounter messages_timed_out;
+    JsonSegmentsCounter time_to_complete[JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS];
+} json_segments_counters;
+#endif
+
+// Trace points compile to nothing unless JSON_SEGMENTS_TRACE is defined, and
+// read the monotonic clock only while a trace function is installed.
+#if defined(JSON_SEGMENTS_TRACE)
+static void json_segments_trace(JsonSegmentsTraceEvent event, const char *unique_id, int sequence_number) {
+    JsonSegmentsTraceFunction trace = current_json_segments_trace_function;
+    if (trace != NULL) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        trace(event, unique_id, sequence_number, (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec);
+    }
+}
+#define JSON_SEGMENTS_TRACE_POINT(event, unique_id, sequence_number) json_segments_trace((event), (unique_id), (sequence_number))
+#else
+#define JSON_SEGMENTS_TRACE_POINT(event, unique_id, sequence_number) ((void)0)
+#endif
+
+// Read the current time from the configured clock.
+static time_t json_segments_now(void) {
+    return current_json_segments_clock_function != NULL ? current_json_segments_clock_function() : time(NULL);
+}
+
+// Deliver a diagnostic to the configured callback. At most
+// json_segments_diagnostic_rate_limit diagnostics are delivered per clock
+// second; the rest are only counted and reported with the next delivery.
+// The limiter state is atomic because errors are reported from the worker
+// threads of the parallel splitter and the concurrent table as well.
+JsonSegmentsError json_segments_report_error(JsonSegmentsError error, const char *message, const char *unique_id) {
+#if defined(__STDC_NO_ATOMICS__)
+    static time_t window;
+    static int delivered;
+    static unsigned long suppressed;
+#else
+    static _Atomic time_t window;
+    static atomic_int delivered;
+    static atomic_ulong suppressed;
+#endif
+
+    if (current_json_segments_diagnostic_function == NULL) {
+        return error;
+    }
+
+    if (json_segments_diagnostic_rate_limit > 0) {
+        time_t now = json_segments_now();
+        if (now != window) {
+            window = now;
+            delivered = 0;
+        }
+        if (delivered++ >= json_segments_diagnostic_rate_limit) {
+            suppressed++;
+            return error;
+        }
+    }
+
+#if defined(__STDC_NO_ATOMICS__)
+    unsigned long dropped = suppressed;
+    suppressed = 0;
+#else
+    unsigned long dropped = atomic_exchange(&suppressed, 0);
+#endif
+    current_json_segments_diagnostic_function(error, message, unique_id, dropped);
+    return error;
+}
+
+// Print a diagnostic to stderr.
+void json_segments_stderr_diagnostic(JsonSegmentsError error, const char *message, const char *unique_id, unsigned long suppressed) {
+    (void)error;
+    if (suppressed > 0) {
+        fprintf(stderr, "(%lu similar messages suppressed)\n", suppressed);
+    }
+    if (unique_id != NULL) {
+        fprintf(stderr, "%s (uid %s)\n", message, unique_id);
+    } else {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+// Map an error code to a short description.
+const char *json_segments_error_string(JsonSegmentsError error) {
+    switch (error) {
+        case JSON_SEGMENTS_OK: return "ok";
+        case JSON_SEGMENTS_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case JSON_SEGMENTS_ERROR_INVALID_SEGMENT: return "invalid segment";
+        case JSON_SEGMENTS_ERROR_DUPLICATE: return "duplicate segment";
+        case JSON_SEGMENTS_ERROR_INCONSISTENT: return "inconsistent total number of segments";
+        case JSON_SEGMENTS_ERROR_TOO_MANY_SEGMENTS: return "too many segments";
+        case JSON_SEGMENTS_ERROR_OUT_OF_MEMORY: return "out of memory";
+        case JSON_SEGMENTS_ERROR_NOT_FOUND: return "unknown unique id";
+        case JSON_SEGMENTS_ERROR_INCOMPLETE: return "message incomplete";
+        case JSON_SEGMENTS_ERROR_PARSE: return "reassembled message is not valid JSON";
+        case JSON_SEGMENTS_ERROR_NO_HANDLER: return "no processing function set";
+        case JSON_SEGMENTS_ERROR_IO: return "I/O error";
+        case JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL: return "buffer too small";
+        case JSON_SEGMENTS_ERROR_FULL: return "queue full";
+    }
+    return "unknown error";
+}
+
+// Copy length bytes of s into the inline buffer if they fit with their
+// NUL terminator, otherwise into a new heap string stored in *heap.
+static int json_segments_store(char *inline_buffer, size_t capacity, char **heap, const char *s, size_t length) {
+    char *target = inline_buffer;
+
+    if (length >= capacity) {
+        target = malloc(length + 1);
+        if (target == NULL) {
+            return -1;
+        }
+        *heap = target;
+    }
+    memcpy(target, s, length);
+    target[length] = '\0';
+    return 0;
+}
+
+// A caller's buffer offered by json_segments_context_add_borrowed(). The
+// segment that keeps it sets taken; otherwise the caller releases it.
+typedef struct {
+    JsonSegmentsReleaseFunction release;
+    void *release_context;
+    int taken;
+} JsonSegmentsLoan;
+
+// Store a segment's content in its record, or on the heap if it is long.
+// With a loan the record only keeps a view of the caller's buffer.
+static int json_segments_store_segment(JsonSegment *segment, int sequence_number, const char *json_segment, size_t json_segment_length,
+                                       JsonSegmentsLoan *loan) {
+    segment->sequence_number = sequence_number;
+    segment->borrowed = loan != NULL;
+    segment->length = json_segment_length;
+    if (loan != NULL) {
+        segment->json_segment.view.data = json_segment;
+        segment->json_segment.view.release = loan->release;
+        segment->json_segment.view.release_context = loan->release_context;
+        loan->taken = 1;
+        return 0;
+    }
+    return json_segments_store(segment->json_segment.bytes, JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY, &segment->json_segment.heap,
+                               json_segment, json_segment_length);
+}
+
+// Free a segment's content if it was stored on the heap, or hand a borrowed
+// buffer back to its owner.
+static void json_segments_release_segment(JsonSegment *segment) {
+    if (segment->borrowed) {
+        if (segment->json_segment.view.release != NULL) {
+            segment->json_segment.view.release(segment->json_segment.view.release_context);
+        }
+    } else if (segment->length >= JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY) {
+        free(segment->json_segment.heap);
+    }
+}
+
+// Content of a stored segment, wherever it lives.
+const char *json_segments_segment_content(const JsonSegment *segment) {
+    if (segment->borrowed) {
+        return segment->json_segment.view.data;
+    }
+    return segment->length < JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY ? segment->json_segment.bytes : segment->json_segment.heap;
+}
+
+// Store an entry's uid in the entry, or on the heap if it is long.
+static int json_segments_store_unique_id(JsonSegmentInfo *entry, const char *unique_id, size_t unique_id_length) {
+    entry->unique_id_length = unique_id_length;
+    return json_segments_store(entry->unique_id.bytes, JSON_SEGMENTS_INLINE_UID_CAPACITY, &entry->unique_id.heap, unique_id, unique_id_length);
+}
+
+// Free an entry's uid if it was stored on the heap.
+static void json_segments_release_unique_id(JsonSegmentInfo *entry) {
+    if (entry->unique_id_length >= JSON_SEGMENTS_INLINE_UID_CAPACITY) {
+        free(entry->unique_id.heap);
+    }
+}
+
+// Uid of an entry, wherever it lives.
+const char *json_segments_entry_unique_id(const JsonSegmentInfo *entry) {
+    return entry->unique_id_length < JSON_SEGMENTS_INLINE_UID_CAPACITY ? entry->unique_id.bytes : entry->unique_id.heap;
+}
+
+// Fill the lookup key of a uid: its hash, length and zero-padded prefix.
+static void json_segments_make_key(JsonSegmentsKey *key, const char *unique_id, size_t unique_id_length) {
+    size_t prefix_length = unique_id_length < JSON_SEGMENTS_KEY_PREFIX_LENGTH ? unique_id_length : JSON_SEGMENTS_KEY_PREFIX_LENGTH;
+
+    key->hash = json_segments_unique_id_hash(unique_id, unique_id_length);
+    key->last_received_timestamp = 0;
+    key->unique_id_length = (uint32_t)unique_id_length;
+    memset(key->prefix, 0, sizeof(key->prefix));
+    memcpy(key->prefix, unique_id, prefix_length);
+}
+
+// Find the entry for a uid of the given length. Returns its index or -1.
+// Only the dense key array is scanned; the cold entry is read to compare
+// the rest of a uid longer than the prefix once hash and prefix match.
+static int json_segments_find(const JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length) {
+    JsonSegmentsKey key;
+
+    json_segments_make_key(&key, unique_id, unique_id_length);
+    for (int i = 0; i < context->segments_count; i++) {
+        const JsonSegmentsKey *candidate = &context->keys[i];
+        if (candidate->hash != key.hash || candidate->unique_id_length != key.unique_id_length ||
+            memcmp(candidate->prefix, key.prefix, sizeof(key.prefix)) != 0) {
+            continue;
+        }
+        if (unique_id_length <= JSON_SEGMENTS_KEY_PREFIX_LENGTH) {
+            return i;
+        }
+
+        const JsonSegmentInfo *entry = &context->segments[i];
+        if (entry->unique_id_length == unique_id_length &&
+            memcmp(json_segments_entry_unique_id(entry) + JSON_SEGMENTS_KEY_PREFIX_LENGTH, unique_id + JSON_SEGMENTS_KEY_PREFIX_LENGTH,
+                   unique_id_length - JSON_SEGMENTS_KEY_PREFIX_LENGTH) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static JsonSegmentsError json_segments_merge_entry(JsonSegmentsContext *context, int index);
+static JsonSegmentsError json_segments_deliver_single(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                      const char *json_segment, size_t json_segment_length);
+
+// First allocation of the entry and slot arrays; both grow by doubling.
+#define JSON_SEGMENTS_INITIAL_CAPACITY 8
+
+// A handle carries the slot's generation in its high half and the slot in
+// its low half. Generations are odd while a slot is in use, so a live
+// handle is never JSON_SEGMENTS_HANDLE_INVALID.
+static JsonSegmentsHandle json_segments_make_handle(const JsonSegmentsContext *context, uint32_t slot) {
+    return ((JsonSegmentsHandle)context->slots[slot].generation << 32) | slot;
+}
+
+// Translate a handle to the index of its entry. Returns -1 if the handle is
+// stale, i.e. its slot was released (and possibly reused) since.
+static int json_segments_resolve(const JsonSegmentsContext *context, JsonSegmentsHandle handle) {
+    uint32_t slot = (uint32_t)handle;
+    uint32_t generation = (uint32_t)(handle >> 32);
+
+    if (context == NULL || slot >= (uint32_t)context->slots_count || (generation & 1) == 0 ||
+        context->slots[slot].generation != generation) {
+        return -1;
+    }
+    return context->slots[slot].index;
+}
+
+// Take a slot from the free list, or a new one, and point it at index.
+static int json_segments_acquire_slot(JsonSegmentsContext *context, int index, uint32_t *slot) {
+    int acquired = context->free_slot;
+
+    if (acquired >= 0) {
+        context->free_slot = context->slots[acquired].index;
+    } else {
+        if (context->slots_count == context->slots_capacity) {
+            int capacity = context->slots_capacity > 0 ? context->slots_capacity * 2 : JSON_SEGMENTS_INITIAL_CAPACITY;
+            JsonSegmentsSlot *temp = realloc(context->slots, sizeof(JsonSegmentsSlot) * (size_t)capacity);
+            if (temp == NULL) {
+                return -1;
+            }
+            context->slots = temp;
+            context->slots_capacity = capacity;
+        }
+        acquired = context->slots_count++;
+        context->slots[acquired].generation = 0;
+    }
+
+    context->slots[acquired].generation++;
+    context->slots[acquired].index = index;
+    *slot = (uint32_t)acquired;
+    return 0;
+}
+
+// Invalidate every handle of a slot and put it on the free list.
+static void json_segments_release_slot(JsonSegmentsContext *context, uint32_t slot) {
+    context->slots[slot].generation++;
+    context->slots[slot].index = context->free_slot;
+    context->free_slot = (int)slot;
+}
+
+// Initialize an empty reassembly context.
+void json_segments_context_init(JsonSegmentsContext *context, JsonSegmentsContextFunction processing_function, void *user_data) {
+    if (context == NULL) {
+        return;
+    }
+    *context = (JsonSegmentsContext){ .processing_function = processing_function, .user_data = user_data, .free_slot = -1 };
+}
+
+// Hand complete messages of a context to an executor.
+void json_segments_context_set_executor(JsonSegmentsContext *context, JsonSegmentsSubmitFunction executor, void *executor_context) {
+    if (context == NULL) {
+        return;
+    }
+    context->completion_executor = executor;
+    context->completion_executor_context = executor_context;
+}
+
+// Deliver the complete messages of a context as segment payloads.
+void json_segments_context_set_vector_function(JsonSegmentsContext *context, JsonSegmentsVectorFunction vector_function, void *user_data) {
+    if (context == NULL) {
+        return;
+    }
+    context->vector_function = vector_function;
+    context->vector_user_data = user_data;
+}
+
+// Reassemble messages above a size threshold in spill files.
+void json_segments_context_set_spill(JsonSegmentsContext *context, const char *directory, size_t threshold,
+                                     JsonSegmentsSpillFunction spill_function, void *user_data) {
+    if (context == NULL) {
+        return;
+    }
+    context->spill_function = spill_function;
+    context->spill_user_data = user_data;
+    context->spill_directory = directory != NULL ? directory : "/tmp";
+    context->spill_threshold = threshold;
+}
+
+// Report changes of the table to a persistence function.
+void json_segments_context_set_persist(JsonSegmentsContext *context, JsonSegmentsPersistFunction persist_function, void *persist_context) {
+    if (context == NULL) {
+        return;
+    }
+    context->persist_function = persist_function;
+    context->persist_context = persist_context;
+}
+
+// Report a stored segment to the context's persistence function, unless it
+// completed its message: that message is only reported once it is removed.
+static void json_segments_persist_segment(const JsonSegmentsContext *context, const JsonSegmentInfo *entry, int sequence_number,
+                                          const char *json_segment, size_t json_segment_length) {
+    if (context->persist_function != NULL && entry->received_segments < entry->total_segments) {
+        context->persist_function(JSON_SEGMENTS_PERSIST_SEGMENT, json_segments_entry_unique_id(entry), entry->unique_id_length, sequence_number,
+                                  entry->total_segments, json_segment, json_segment_length, context->persist_context);
+    }
+}
+
+// A message reassembled in a file. Every segment but the last has
+// segment_length bytes, so each one is written straight to its offset.
+struct JsonSegmentsSpill {
+    int fd;
+    char *path;
+    size_t segment_length;
+    size_t length;
+    unsigned char *received;                // One bit per sequence number, allocated behind the struct.
+};
+
+// Whether a message of total_segments segments of segment_length bytes is
+// larger than the context's spill threshold, without overflowing.
+static int json_segments_spills(const JsonSegmentsContext *context, int total_segments, size_t segment_length) {
+    return context->spill_function != NULL && segment_length > 0 && context->spill_threshold / segment_length < (size_t)total_segments;
+}
+
+// Create an empty spill file in the context's spill directory.
+static JsonSegmentsSpill *json_segments_spill_create(const JsonSegmentsContext *context, int total_segments, size_t segment_length) {
+    static const char name[] = "/json_segments-XXXXXX";
+    size_t directory_length = strlen(context->spill_directory);
+    JsonSegmentsSpill *spill = calloc(1, sizeof(JsonSegmentsSpill) + ((size_t)total_segments + 7) / 8);
+    char *path = malloc(directory_length + sizeof(name));
+
+    if (spill == NULL || path == NULL) {
+        free(spill);
+        free(path);
+        return NULL;
+    }
+    memcpy(path, context->spill_directory, directory_length);
+    memcpy(path + directory_length, name, sizeof(name));
+    spill->fd = mkstemp(path);
+    if (spill->fd < 0) {
+        free(spill);
+        free(path);
+        return NULL;
+    }
+    spill->path = path;
+    spill->segment_length = segment_length;
+    spill->received = (unsigned char *)(spill + 1);
+    return spill;
+}
+
+// Close and delete a spill file. A file the spill function renamed is kept.
+static void json_segments_spill_free(JsonSegmentsSpill *spill) {
+    close(spill->fd);
+    unlink(spill->path);
+    free(spill->path);
+    free(spill);
+}
+
+// Write all of data at offset, resuming after partial and interrupted writes.
+static int json_segments_pwrite_all(int fd, const char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+        offset += written;
+    }
+    return 0;
+}
+
+// Read exactly length bytes at offset, resuming after partial and interrupted reads.
+static int json_segments_pread_all(int fd, char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t read_length = pread(fd, data, length, offset);
+        if (read_length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_length <= 0) {
+            return -1;
+        }
+        data += read_length;
+        length -= (size_t)read_length;
+        offset += read_length;
+    }
+    return 0;
+}
+
+// Write a segment of a spilled message at its offset and mark it received.
+static JsonSegmentsError json_segments_spill_write(JsonSegmentsSpill *spill, int total_segments, int sequence_number, const char *json_segment,
+                                                   size_t json_segment_length, const char *unique_id) {
+    if (sequence_number < 1 || sequence_number > total_segments) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Error: Invalid segment", unique_id);
+    }
+
+    size_t bit = (size_t)(sequence_number - 1);
+    if ((spill->received[bit / 8] & (1u << (bit % 8))) != 0) {
+        JSON_SEGMENTS_STAT_ADD(segments_duplicate, 1);
+        return JSON_SEGMENTS_ERROR_DUPLICATE;
+    }
+    if (sequence_number < total_segments && json_segment_length != spill->segment_length) {
+        JSON_SEGMENTS_STAT_ADD(segments_inconsistent, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INCONSISTENT, "Error: Inconsistent segment length", unique_id);
+    }
+
+    off_t offset = (off_t)bit * (off_t)spill->segment_length;
+    if (json_segments_pwrite_all(spill->fd, json_segment, json_segment_length, offset) != 0) {
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Error: Cannot write spill file", unique_id);
+    }
+    spill->received[bit / 8] |= (unsigned char)(1u << (bit % 8));
+    if (sequence_number == total_segments) {
+        spill->length = (size_t)offset + json_segment_length;
+    }
+    return JSON_SEGMENTS_OK;
+}
+
+// Add a segment to the spilled message at index and hand the file over once
+// the message is complete.
+static JsonSegmentsError json_segments_spill_append(JsonSegmentsContext *context, int index, int sequence_number, const char *json_segment,
+                                                    size_t json_segment_length) {
+    JsonSegmentInfo *entry = &context->segments[index];
+    JsonSegmentsError result = json_segments_spill_write(entry->spill, entry->total_segments, sequence_number, json_segment,
+                                                         json_segment_length, json_segments_entry_unique_id(entry));
+    if (result != JSON_SEGMENTS_OK) {
+        return result;
+    }
+
+    entry->received_segments++;
+    entry->last_received_timestamp = json_segments_now();
+    context->keys[index].last_received_timestamp = entry->last_received_timestamp;
+    JSON_SEGMENTS_STAT_ADD(segments_accepted, 1);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_SEGMENT, json_segments_entry_unique_id(entry), sequence_number);
+    json_segments_persist_segment(context, entry, sequence_number, json_segment, json_segment_length);
+
+    if (entry->received_segments == entry->total_segments) {
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_COMPLETE, json_segments_entry_unique_id(entry), 0);
+        return json_segments_merge_entry(context, index);
+    }
+    return JSON_SEGMENTS_OK;
+}
+
+// Move a message that so far only holds its last segment into a spill file,
+// once its first other segment shows that it is large.
+static JsonSegmentsError json_segments_spill_convert(JsonSegmentsContext *context, int index, size_t segment_length) {
+    JsonSegmentInfo *entry = &context->segments[index];
+    JsonSegment *last = &entry->segments[0];
+    JsonSegmentsSpill *spill = json_segments_spill_create(context, entry->total_segments, segment_length);
+
+    if (spill == NULL) {
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Error: Cannot create spill file", json_segments_entry_unique_id(entry));
+    }
+    JsonSegmentsError result = json_segments_spill_write(spill, entry->total_segments, last->sequence_number, json_segments_segment_content(last),
+                                                         last->length, json_segments_entry_unique_id(entry));
+    if (result != JSON_SEGMENTS_OK) {
+        json_segments_spill_free(spill);
+        return result;
+    }
+
+    JSON_SEGMENTS_STAT_SUB(buffered_bytes, entry->buffered_bytes);
+    entry->buffered_bytes = 0;
+    json_segments_release_segment(last);
+    free(entry->segments);
+    entry->segments = NULL;
+    entry->spill = spill;
+    return JSON_SEGMENTS_OK;
+}
+
+// Store a segment in the existing entry at index and merge the message once
+// it is complete. *handle is set to the entry's handle before the merge.
+static JsonSegmentsError json_segments_append(JsonSegmentsContext *context, int index, int sequence_number, int total_segments,
+                                              const char *json_segment, size_t json_segment_length, JsonSegmentsLoan *loan,
+                                              JsonSegmentsHandle *handle) {
+    JsonSegmentInfo *entry = &context->segments[index];
+
+    *handle = json_segments_make_handle(context, entry->slot);
+
+    // Check data consistency
+    if (entry->total_segments != total_segments) {
+        JSON_SEGMENTS_STAT_ADD(segments_inconsistent, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INCONSISTENT, "Error: Inconsistent total number of segments", json_segments_entry_unique_id(entry));
+    }
+    if (entry->spill != NULL) {
+        return json_segments_spill_append(context, index, sequence_number, json_segment, json_segment_length);
+    }
+
+    // Check if the sequence_number already exists
+    for (int j = 0; j < entry->received_segments; j++) {
+        if (entry->segments[j].sequence_number == sequence_number) {
+            // Segment already received, return without adding
+            JSON_SEGMENTS_STAT_ADD(segments_duplicate, 1);
+            return JSON_SEGMENTS_ERROR_DUPLICATE;
+        }
+    }
+
+    // A message that failed to merge stays complete until it times out
+    if (entry->received_segments >= entry->total_segments) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_TOO_MANY_SEGMENTS, "Error: Too many segments", json_segments_entry_unique_id(entry));
+    }
+
+    // The first segment that tells the segment length decides whether a message that arrived last segment first spills
+    if (sequence_number < total_segments && entry->received_segments == 1 && entry->segments[0].sequence_number == total_segments &&
+        json_segments_spills(context, total_segments, json_segment_length)) {
+        JsonSegmentsError result = json_segments_spill_convert(context, index, json_segment_length);
+        if (result != JSON_SEGMENTS_OK) {
+            return result;
+        }
+        return json_segments_spill_append(context, index, sequence_number, json_segment, json_segment_length);
+    }
+
+    // Add segment to existing
+    if (json_segments_store_segment(&entry->segments[entry->received_segments], sequence_number, json_segment, json_segment_length, loan) != 0) {
+        JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", json_segments_entry_unique_id(entry));
+    }
+    entry->received_segments++;
+    entry->last_received_timestamp = json_segments_now();
+    context->keys[index].last_received_timestamp = entry->last_received_timestamp;
+    entry->buffered_bytes += json_segment_length;
+    JSON_SEGMENTS_STAT_ADD(segments_accepted, 1);
+    JSON_SEGMENTS_STAT_ADD(buffered_bytes, json_segment_length);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_SEGMENT, json_segments_entry_unique_id(entry), sequence_number);
+    json_segments_persist_segment(context, entry, sequence_number, json_segment, json_segment_length);
+
+    // Check if JSON segments for this uid are complete now
+    if (entry->received_segments == entry->total_segments) {
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_COMPLETE, json_segments_entry_unique_id(entry), 0);
+        return json_segments_merge_entry(context, index);
+    }
+    return JSON_SEGMENTS_OK;
+}
+
+// Make room for one more entry. The entry and key arrays grow geometrically.
+static JsonSegmentsError json_segments_reserve(JsonSegmentsContext *context) {
+    if (context->segments_count == context->segments_capacity) {
+        int capacity = context->segments_capacity > 0 ? context->segments_capacity * 2 : JSON_SEGMENTS_INITIAL_CAPACITY;
+        JsonSegmentInfo *temp = realloc(context->segments, sizeof(JsonSegmentInfo) * (size_t)capacity);
+        if (temp != NULL) {
+            context->segments = temp;
+        }
+        // The capacity only grows once both arrays have; a larger block alone is harmless
+        JsonSegmentsKey *keys = temp != NULL ? realloc(context->keys, sizeof(JsonSegmentsKey) * (size_t)capacity) : NULL;
+        if (keys == NULL) {
+            JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+            return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+        }
+        context->keys = keys;
+        context->segments_capacity = capacity;
+    }
+    return JSON_SEGMENTS_OK;
+}
+
+// Create the entry of a large message in a spill file, starting with the
+// segment that revealed its size.
+static JsonSegmentsError json_segments_insert_spilled(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                      int sequence_number, int total_segments, const char *json_segment,
+                                                      size_t json_segment_length, JsonSegmentsHandle *handle) {
+    JsonSegmentInfo *entry = &context->segments[context->segments_count];
+    uint32_t slot;
+
+    if (json_segments_store_unique_id(entry, unique_id, unique_id_length) != 0) {
+        JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+    }
+    JsonSegmentsSpill *spill = json_segments_spill_create(context, total_segments, json_segment_length);
+    if (spill == NULL) {
+        JsonSegmentsError result = json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Error: Cannot create spill file", json_segments_entry_unique_id(entry));
+        json_segments_release_unique_id(entry);
+        return result;
+    }
+    JsonSegmentsError result = json_segments_spill_write(spill, total_segments, sequence_number, json_segment, json_segment_length,
+                                                         json_segments_entry_unique_id(entry));
+    if (result != JSON_SEGMENTS_OK) {
+        json_segments_spill_free(spill);
+        json_segments_release_unique_id(entry);
+        return result;
+    }
+    if (json_segments_acquire_slot(context, context->segments_count, &slot) != 0) {
+        json_segments_spill_free(spill);
+        json_segments_release_unique_id(entry);
+        JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+    }
+
+    entry->total_segments = total_segments;
+    entry->received_segments = 1;
+    entry->segments = NULL;
+    entry->last_received_timestamp = json_segments_now();
+    entry->first_received_timestamp = entry->last_received_timestamp;
+    entry->buffered_bytes = 0;
+    entry->slot = slot;
+    entry->spill = spill;
+    json_segments_make_key(&context->keys[context->segments_count], unique_id, unique_id_length);
+    context->keys[context->segments_count].last_received_timestamp = entry->last_received_timestamp;
+    context->segments_count++;
+    *handle = json_segments_make_handle(context, slot);
+    JSON_SEGMENTS_STAT_ADD(segments_accepted, 1);
+    JSON_SEGMENTS_STAT_ADD(in_flight_uids, 1);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_FIRST_SEEN, json_segments_entry_unique_id(entry), 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_SEGMENT, json_segments_entry_unique_id(entry), sequence_number);
+    json_segments_persist_segment(context, entry, sequence_number, json_segment, json_segment_length);
+
+    return JSON_SEGMENTS_OK;
+}
+
+// Create the entry for the first segment of a uid. The new entry gets a slot
+// for its handle; a large message goes to a spill file if the context has one.
+static JsonSegmentsError json_segments_insert(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                              int total_segments, const char *json_segment, size_t json_segment_length,
+                                              JsonSegmentsLoan *loan, JsonSegmentsHandle *handle) {
+    JsonSegmentsError reserved = json_segments_reserve(context);
+    if (reserved != JSON_SEGMENTS_OK) {
+        return reserved;
+    }
+    if (sequence_number < total_segments && json_segments_spills(context, total_segments, json_segment_length)) {
+        return json_segments_insert_spilled(context, unique_id, unique_id_length, sequence_number, total_segments, json_segment,
+                                            json_segment_length, handle);
+    }
+
+    // Short uids and segments are stored inline, so typically only the segment array is allocated
+    JsonSegmentInfo *entry = &context->segments[context->segments_count];
+    JsonSegment *segments = malloc(sizeof(JsonSegment) * total_segments);
+    int stored_uid = segments != NULL && json_segments_store_unique_id(entry, unique_id, unique_id_length) == 0;
+    int stored_segment = stored_uid && json_segments_store_segment(&segments[0], sequence_number, json_segment, json_segment_length, loan) == 0;
+    uint32_t slot;
+    if (!stored_segment || json_segments_acquire_slot(context, context->segments_count, &slot) != 0) {
+        if (stored_segment) {
+            json_segments_release_segment(&segments[0]);
+        }
+        if (stored_uid) {
+            json_segments_release_unique_id(entry);
+        }
+        free(segments);
+        JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+    }
+
+    entry->total_segments = total_segments;
+    entry->received_segments = 1;
+    entry->segments = segments;
+    entry->last_received_timestamp = json_segments_now();
+    entry->first_received_timestamp = entry->last_received_timestamp;
+    entry->buffered_bytes = json_segment_length;
+    entry->slot = slot;
+    entry->spill = NULL;
+    json_segments_make_key(&context->keys[context->segments_count], unique_id, unique_id_length);
+    context->keys[context->segments_count].last_received_timestamp = entry->last_received_timestamp;
+    context->segments_count++;
+    *handle = json_segments_make_handle(context, slot);
+    JSON_SEGMENTS_STAT_ADD(segments_accepted, 1);
+    JSON_SEGMENTS_STAT_ADD(in_flight_uids, 1);
+    JSON_SEGMENTS_STAT_ADD(buffered_bytes, json_segment_length);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_FIRST_SEEN, json_segments_entry_unique_id(entry), 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_SEGMENT, json_segments_entry_unique_id(entry), sequence_number);
+    json_segments_persist_segment(context, entry, sequence_number, json_segment, json_segment_length);
+
+    return JSON_SEGMENTS_OK;
+}
+
+// Add a JSON segment, copied or lent, to a context and report the handle of
+// its message. This function searches for the unique_id in the context's
+// table. If found, it adds the segment to the existing JsonSegmentInfo
+// structure. If not found, it creates a new entry.
+static JsonSegmentsError json_segments_context_add_segment(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                           int sequence_number, int total_segments, const char *json_segment,
+                                                           size_t json_segment_length, JsonSegmentsLoan *loan, JsonSegmentsHandle *handle) {
+    JsonSegmentsHandle added = JSON_SEGMENTS_HANDLE_INVALID;
+    JsonSegmentsError result;
+
+    if (handle != NULL) {
+        *handle = JSON_SEGMENTS_HANDLE_INVALID;
+    }
+    if (context == NULL || unique_id == NULL || json_segment == NULL || sequence_number < 1 || sequence_number > total_segments ||
+        memchr(unique_id, '\0', unique_id_length) != NULL) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Error: Invalid segment", NULL);
+    }
+
+    // A message of one frame is complete on arrival and never enters the table
+    if (total_segments == 1 && sequence_number == 1) {
+        return json_segments_deliver_single(context, unique_id, unique_id_length, json_segment, json_segment_length);
+    }
+
+    // Check if we already received segments of the same unique id
+    int index = json_segments_find(context, unique_id, unique_id_length);
+    if (index >= 0) {
+        result = json_segments_append(context, index, sequence_number, total_segments, json_segment, json_segment_length, loan, &added);
+    } else {
+        result = json_segments_insert(context, unique_id, unique_id_length, sequence_number, total_segments, json_segment,
+                                      json_segment_length, loan, &added);
+    }
+
+    // The handle is stale if the segment completed the message
+    if (handle != NULL && json_segments_resolve(context, added) >= 0) {
+        *handle = added;
+    }
+    return result;
+}
+
+// Add a JSON segment to a context and report the handle of its message.
+JsonSegmentsError json_segments_context_add_handle(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                   int sequence_number, int total_segments, const char *json_segment,
+                                                   size_t json_segment_length, JsonSegmentsHandle *handle) {
+    return json_segments_context_add_segment(context, unique_id, unique_id_length, sequence_number, total_segments, json_segment,
+                                             json_segment_length, NULL, handle);
+}
+
+// Add a JSON segment to a context as a view of the caller's buffer. A
+// segment the table does not keep, including a single-frame message that
+// was parsed in place, is released before returning.
+JsonSegmentsError json_segments_context_add_borrowed(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                     int sequence_number, int total_segments, const char *json_segment,
+                                                     size_t json_segment_length, JsonSegmentsReleaseFunction release, void *release_context) {
+    JsonSegmentsLoan loan = { release, release_context, 0 };
+    JsonSegmentsError result = json_segments_context_add_segment(context, unique_id, unique_id_length, sequence_number, total_segments,
+                                                                 json_segment, json_segment_length, &loan, NULL);
+
+    if (!loan.taken && release != NULL) {
+        release(release_context);
+    }
+    return result;
+}
+
+// Add a JSON segment to a context.
+JsonSegmentsError json_segments_context_add(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                            int total_segments, const char *json_segment, size_t json_segment_length) {
+    return json_segments_context_add_handle(context, unique_id, unique_id_length, sequence_number, total_segments, json_segment,
+                                            json_segment_length, NULL);
+}
+
+// Add a JSON segment to the message a handle refers to, skipping the uid lookup.
+JsonSegmentsError json_segments_context_add_by_handle(JsonSegmentsContext *context, JsonSegmentsHandle handle, int sequence_number,
+                                                      int total_segments, const char *json_segment, size_t json_segment_length) {
+    JsonSegmentsHandle added;
+
+    if (context == NULL || json_segment == NULL || sequence_number < 1 || sequence_number > total_segments) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Error: Invalid segment", NULL);
+    }
+
+    int index = json_segments_resolve(context, handle);
+    if (index < 0) {
+        return JSON_SEGMENTS_ERROR_NOT_FOUND;
+    }
+    return json_segments_append(context, index, sequence_number, total_segments, json_segment, json_segment_length, NULL, &added);
+}
+
+// Look up the entry behind a handle.
+JsonSegmentInfo *json_segments_context_entry(JsonSegmentsContext *context, JsonSegmentsHandle handle) {
+    int index = json_segments_resolve(context, handle);
+    return index >= 0 ? &context->segments[index] : NULL;
+}
+
+// Find the handle of a buffered message by its uid.
+JsonSegmentsHandle json_segments_context_find_handle(const JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length) {
+    if (context == NULL || unique_id == NULL) {
+        return JSON_SEGMENTS_HANDLE_INVALID;
+    }
+
+    int index = json_segments_find(context, unique_id, unique_id_length);
+    return index >= 0 ? json_segments_make_handle(context, context->segments[index].slot) : JSON_SEGMENTS_HANDLE_INVALID;
+}
+
+// Read the received segments of a spilled message back from its file and
+// report them, one at a time through a buffer of one segment.
+static int json_segments_spill_export(const JsonSegmentInfo *entry, JsonSegmentsPersistFunction persist_function, void *persist_context) {
+    const JsonSegmentsSpill *spill = entry->spill;
+    size_t last_offset = (size_t)(entry->total_segments - 1) * spill->segment_length;
+    size_t last_length = spill->length > last_offset ? spill->length - last_offset : 0;
+    char *buffer = malloc((last_length > spill->segment_length ? last_length : spill->segment_length) + 1);
+
+    if (buffer == NULL) {
+        return -1;
+    }
+    for (int j = 0; j < entry->total_segments; j++) {
+        if ((spill->received[j / 8] & (1u << (j % 8))) == 0) {
+            continue;
+        }
+        size_t length = j + 1 < entry->total_segments ? spill->segment_length : last_length;
+        if (json_segments_pread_all(spill->fd, buffer, length, (off_t)j * (off_t)spill->segment_length) != 0) {
+            free(buffer);
+            return -1;
+        }
+        persist_function(JSON_SEGMENTS_PERSIST_SEGMENT, json_segments_entry_unique_id(entry), entry->unique_id_length, j + 1,
+                         entry->total_segments, buffer, length, persist_context);
+    }
+    free(buffer);
+    return 0;
+}
+
+// Report every stored segment of the partial messages.
+int json_segments_context_export(const JsonSegmentsContext *context, JsonSegmentsPersistFunction persist_function, void *persist_context) {
+    if (context == NULL || persist_function == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < context->segments_count; i++) {
+        const JsonSegmentInfo *entry = &context->segments[i];
+        if (entry->spill != NULL) {
+            if (json_segments_spill_export(entry, persist_function, persist_context) != 0) {
+                return -1;
             }
+            continue;
+        }
+        for (int j = 0; j < entry->received_segments; j++) {
+            persist_function(JSON_SEGMENTS_PERSIST_SEGMENT, json_segments_entry_unique_id(entry), entry->unique_id_length,
+                             entry->segments[j].sequence_number, entry->total_segments, json_segments_segment_content(&entry->segments[j]),
+                             entry->segments[j].length, persist_context);
+        }
+    }
+    return 0;
+}
+
+// List the sequence numbers a partial message lacks. A spilled message has
+// a bitmap of its segments already; for the others one is built here.
+int json_segments_context_missing(const JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length, int *sequence_numbers,
+                                  int capacity) {
+    if (context == NULL || unique_id == NULL || (sequence_numbers == NULL && capacity > 0)) {
+        return -1;
+    }
+
+    int index = json_segments_find(context, unique_id, unique_id_length);
+    if (index < 0) {
+        return -1;
+    }
+
+    const JsonSegmentInfo *entry = &context->segments[index];
+    const unsigned char *received = entry->spill != NULL ? entry->spill->received : NULL;
+    unsigned char *marks = NULL;
+    if (received == NULL) {
+        marks = calloc(((size_t)entry->total_segments + 7) / 8, 1);
+        if (marks == NULL) {
+            return -1;
+        }
+        for (int j = 0; j < entry->received_segments; j++) {
+            int bit = entry->segments[j].sequence_number - 1;
+            if (bit >= 0 && bit < entry->total_segments) {
+                marks[bit / 8] |= (unsigned char)(1u << (bit % 8));
+            }
+        }
+        received = marks;
+    }
+
+    int missing = 0;
+    for (int bit = 0; bit < entry->total_segments; bit++) {
+        if ((received[bit / 8] & (1u << (bit % 8))) == 0) {
+            if (missing < capacity) {
+                sequence_numbers[missing] = bit + 1;
+            }
+            missing++;
+        }
+    }
+    free(marks);
+    return missing;
+}
+
+// Add a JSON segment to the default context.
+JsonSegmentsError json_segments_add(const char *unique_id, int sequence_number, int total_segments, const char *json_segment) {
+    if (unique_id == NULL || json_segment == NULL) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Error: Invalid segment", NULL);
+    }
+    return json_segments_context_add(&json_segments_default_context, unique_id, strlen(unique_id), sequence_number, total_segments,
+                                     json_segment, strlen(json_segment));
+}
+
+
+// Adapter passing decoded segments to json_segments_context_add.
+static JsonSegmentsError json_segments_context_add_decoded(void *target, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                                           int total_segments, const char *json_segment, size_t json_segment_length) {
+    return json_segments_context_add((JsonSegmentsContext *)target, unique_id, unique_id_length, sequence_number, total_segments,
+                                     json_segment, json_segment_length);
+}
+
+// Parse a cJSON object and add its contents as a segment. The function
+// extracts the unique_id, sequence number, total segments, and the segment
+// string from the cJSON object, validating each field before adding the segment.
+JsonSegmentsError json_segments_decode_object(cJSON *json_obj, JsonSegmentsAddFunction add, void *target) {
+    if (json_obj == NULL) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Ungültiges cJSON-Objekt", NULL);
+    }
+
+    cJSON *uid = cJSON_GetObjectItem(json_obj, "uid");
+    cJSON *seq = cJSON_GetObjectItem(json_obj, "seq");
+    cJSON *abs = cJSON_GetObjectItem(json_obj, "abs");
+    cJSON *seg = cJSON_GetObjectItem(json_obj, "seg");
+
+    if (!cJSON_IsString(uid) || !cJSON_IsNumber(seq) || !cJSON_IsNumber(abs) || !cJSON_IsString(seg)) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "JSON-Objekt enthält ungültige Daten",
+                                          cJSON_IsString(uid) ? uid->valuestring : NULL);
+    }
+
+    return add(target, uid->valuestring, strlen(uid->valuestring), seq->valueint, abs->valueint,
+               seg->valuestring, strlen(seg->valuestring));
+}
+
+// Parse a cJSON object into a context.
+JsonSegmentsError json_segments_context_parse_input(JsonSegmentsContext *context, cJSON *json_obj) {
+    return json_segments_decode_object(json_obj, json_segments_context_add_decoded, context);
+}
+
+// Parse a cJSON object into the default context.
+JsonSegmentsError json_segments_parse_input(cJSON *json_obj) {
+    return json_segments_context_parse_input(&json_segments_default_context, json_obj);
+}
+
+// Create a single JSON segment object. This function constructs a cJSON object
+// with the given UID, sequence number, total segments, and content, structuring
+// it as per the expected JSON segment format.
+void json_segments_create_single(cJSON **root, char *uid, int sequence_number, int total_segments, char *content) {
+    *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(*root, "uid", uid);
+    cJSON_AddNumberToObject(*root, "seq", sequence_number);
+    cJSON_AddNumberToObject(*root, "abs", total_segments);
+    cJSON_AddStringToObject(*root, "seg", content);
+}
+
+// Write the decimal representation of an int and return the number of
+// characters written. Used instead of snprintf on the frame hot path.
+static int json_segments_write_int(char *out, int value) {
+    char digits[12];
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    int count = 0;
+    int length = 0;
+
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        out[length++] = '-';
+    }
+    while (count > 0) {
+        out[length++] = digits[--count];
+    }
+    return length;
+}
+
+// Number of characters json_segments_write_int produces for value.
+static int json_segments_int_length(int value) {
+    char digits[12];
+    return json_segments_write_int(digits, value);
+}
+
+// Keys and punctuation of the frame envelope, in the order cJSON prints them.
+static const char json_segments_uid_key[] = "{\"uid\":\"";
+static const char json_segments_seq_key[] = "\",\"seq\":";
+static const char json_segments_abs_key[] = ",\"abs\":";
+static const char json_segments_seg_key[] = ",\"seg\":\"";
+
+// Total length of the envelope without the uid and the two numbers: the four
+// keys plus the closing quote and brace.
+#define JSON_SEGMENTS_ENVELOPE_OVERHEAD (sizeof(json_segments_uid_key) - 1 + sizeof(json_segments_seq_key) - 1 + \
+                                         sizeof(json_segments_abs_key) - 1 + sizeof(json_segments_seg_key) - 1 + 2)
+
+// Append the escaped content and the closing quote and brace. The caller has
+// already checked that the buffer is large enough.
+static int json_segments_finish_frame(char *buffer, char *out, const char *content, size_t content_length) {
+    out += json_segments_escape(out, content, content_length);
+    *out++ = '"';
+    *out++ = '}';
+    *out = '\0';
+    return (int)(out - buffer);
+}
+
+// Check that a frame with the given fixed part fits into size bytes. The
+// escaped content length is only computed when the worst case (every byte
+// expanding to \u00XX) does not fit anyway.
+static int json_segments_frame_fits(size_t fixed_length, const char *content, size_t content_length, size_t size) {
+    if (fixed_length + 6 * content_length + 1 <= size && fixed_length + 6 * content_length < INT_MAX) {
+        return 1;
+    }
+
+    size_t needed = fixed_length + json_segments_escaped_length(content, content_length) + 1;
+    return needed <= size && needed - 1 <= INT_MAX;
+}
+
+// Serialize a single JSON segment frame straight into the caller's buffer.
+// The layout matches cJSON_PrintUnformatted() of json_segments_create_single(),
+// so receivers can keep using either cJSON_Parse or json_segments_parse_raw.
+int json_segments_write_frame(char *buffer, size_t size, const char *uid, int sequence_number, int total_segments, const char *content, size_t content_length) {
+    if (buffer == NULL || uid == NULL || (content == NULL && content_length > 0)) {
+        return -1;
+    }
+
+    size_t uid_length = strlen(uid);
+    size_t fixed_length = JSON_SEGMENTS_ENVELOPE_OVERHEAD + json_segments_escaped_length(uid, uid_length) +
+                          (size_t)json_segments_int_length(sequence_number) + (size_t)json_segments_int_length(total_segments);
+
+    if (!json_segments_frame_fits(fixed_length, content, content_length, size)) {
+        return -1;
+    }
+
+    char *out = buffer;
+    memcpy(out, json_segments_uid_key, sizeof(json_segments_uid_key) - 1);
+    out += sizeof(json_segments_uid_key) - 1;
+    out += json_segments_escape(out, uid, uid_length);
+    memcpy(out, json_segments_seq_key, sizeof(json_segments_seq_key) - 1);
+    out += sizeof(json_segments_seq_key) - 1;
+    out += json_segments_write_int(out, sequence_number);
+    memcpy(out, json_segments_abs_key, sizeof(json_segments_abs_key) - 1);
+    out += sizeof(json_segments_abs_key) - 1;
+    out += json_segments_write_int(out, total_segments);
+    memcpy(out, json_segments_seg_key, sizeof(json_segments_seg_key) - 1);
+    out += sizeof(json_segments_seg_key) - 1;
+
+    return json_segments_finish_frame(buffer, out, content, content_length);
+}
+
+// Precompute the envelope of a split: everything up to "seq": and everything
+// from ,"abs": to the opening quote of seg only depends on the uid and the
+// total number of segments, so frames only need their seq digits patched in.
+int json_segments_envelope_init(JsonSegmentsEnvelope *envelope, const char *uid, int total_segments) {
+    if (envelope == NULL || uid == NULL) {
+        return -1;
+    }
+
+    size_t uid_length = strlen(uid);
+    size_t escaped_uid_length = json_segments_escaped_length(uid, uid_length);
+
+    envelope->unique_id = uid;
+    envelope->total_segments = total_segments;
+    envelope->prefix_length = sizeof(json_segments_uid_key) - 1 + escaped_uid_length + sizeof(json_segments_seq_key) - 1;
+    envelope->suffix_length = sizeof(json_segments_abs_key) - 1 + (size_t)json_segments_int_length(total_segments) +
+                              sizeof(json_segments_seg_key) - 1;
+
+    if (envelope->prefix_length + envelope->suffix_length > sizeof(envelope->header)) {
+        // Unusually long uid: frames are serialized field by field instead
+        envelope->prefix_length = 0;
+        envelope->suffix_length = 0;
+        return 0;
+    }
+
+    char *out = envelope->header;
+    memcpy(out, json_segments_uid_key, sizeof(json_segments_uid_key) - 1);
+    out += sizeof(json_segments_uid_key) - 1;
+    out += json_segments_escape(out, uid, uid_length);
+    memcpy(out, json_segments_seq_key, sizeof(json_segments_seq_key) - 1);
+    out += sizeof(json_segments_seq_key) - 1;
+    memcpy(out, json_segments_abs_key, sizeof(json_segments_abs_key) - 1);
+    out += sizeof(json_segments_abs_key) - 1;
+    out += json_segments_write_int(out, total_segments);
+    memcpy(out, json_segments_seg_key, sizeof(json_segments_seg_key) - 1);
+
+    return 0;
+}
+
+// Serialize a frame from a precomputed envelope: two memcpys, the seq
+// digits and the escaped content.
+int json_segments_envelope_write(const JsonSegmentsEnvelope *envelope, char *buffer, size_t size, int sequence_number, const char *content, size_t content_length) {
+    if (envelope == NULL || buffer == NULL || (content == NULL && content_length > 0)) {
+        return -1;
+    }
+    if (envelope->prefix_length == 0) {
+        return json_segments_write_frame(buffer, size, envelope->unique_id, sequence_number, envelope->total_segments, content, content_length);
+    }
+
+    size_t fixed_length = envelope->prefix_length + (size_t)json_segments_int_length(sequence_number) + envelope->suffix_length + 2;
+    if (!json_segments_frame_fits(fixed_length, content, content_length, size)) {
+        return -1;
+    }
+
+    char *out = buffer;
+    memcpy(out, envelope->header, envelope->prefix_length);
+    out += envelope->prefix_length;
+    out += json_segments_write_int(out, sequence_number);
+    memcpy(out, envelope->header + envelope->prefix_length, envelope->suffix_length);
+    out += envelope->suffix_length;
+
+    return json_segments_finish_frame(buffer, out, content, content_length);
+}
+
+// Fields of a frame located by json_segments_scan_frame. String fields point
+// into the frame and are still escaped if the corresponding flag is set.
+typedef struct {
+    const char *uid;
+    size_t uid_length;
+    int uid_escaped;
+    const char *seg;
+    size_t seg_length;
+    int seg_escaped;
+    int sequence_number;
+    int total_segments;
+    int has_sequence_number;
+    int has_total_segments;
+} JsonSegmentsRawFrame;
+
+// Skip JSON whitespace starting at offset i.
+static size_t json_segments_skip_whitespace(const char *p, size_t length, size_t i) {
+    while (i < length && (p[i] == ' ' || p[i] == '\t' || p[i] == '\n' || p[i] == '\r')) {
+        i++;
+    }
+    return i;
+}
+
+// Scan a JSON integer. Returns the number of bytes consumed, or 0 if the value
+// is not a plain int (fractions, exponents and overflow are left to cJSON).
+static size_t json_segments_scan_int(const char *p, size_t length, int *value) {
+    size_t i = 0;
+    int negative = 0;
+    long long result = 0;
+
+    if (i < length && p[i] == '-') {
+        negative = 1;
+        i++;
+    }
+    size_t first_digit = i;
+    while (i < length && p[i] >= '0' && p[i] <= '9') {
+        result = result * 10 + (p[i] - '0');
+        if (result > INT_MAX) {
+            return 0;
+        }
+        i++;
+    }
+    if (i == first_digit || (i < length && (p[i] == '.' || p[i] == 'e' || p[i] == 'E'))) {
+        return 0;
+    }
+
+    *value = negative ? (int)-result : (int)result;
+    return i;
+}
+
+// Locate uid, seq, abs and seg in a flat frame object without allocating.
+// Returns 1 on success and 0 for anything that needs the full cJSON parser
+// (nested values, escaped keys, missing fields, trailing garbage).
+static int json_segments_scan_frame(const char *frame, size_t length, JsonSegmentsRawFrame *out) {
+    size_t i = json_segments_skip_whitespace(frame, length, 0);
+
+    memset(out, 0, sizeof(*out));
+    if (i >= length || frame[i] != '{') {
+        return 0;
+    }
+    i++;
 
-            // Check if the sequence_number already exists
-            for (int j = 0; j < all_json_segments[i].received_segments; j++) {
-                if (all_json_segments[i].segments[j].sequence_number == sequence_number) {
-                    // Segment already received, return without adding
-                    return;
-                }
-            }
+    for (;;) {
+        int escaped;
 
-            // Add segment to existing
-            int index = all_json_segments[i].received_segments;
-            all_json_segments[i].segments[index].sequence_number = sequence_number;
-            all_json_segments[i].segments[index].json_segment = strdup(json_segment);
-            all_json_segments[i].received_segments++;
-            all_json_segments[i].last_received_timestamp = time(NULL);
+        i = json_segments_skip_whitespace(frame, length, i);
+        if (i >= length || frame[i] != '"') {
+            return 0;
+        }
+        i++;
+        const char *key = frame + i;
+        size_t key_length = json_segments_string_end(key, length - i, &escaped);
+        if (escaped || key_length == length - i) {
+            return 0;
+        }
+        i = json_segments_skip_whitespace(frame, length, i + key_length + 1);
+        if (i >= length || frame[i] != ':') {
+            return 0;
+        }
+        i = json_segments_skip_whitespace(frame, length, i + 1);
+        if (i >= length) {
+            return 0;
+        }
 
-            // Check if JSON segments for this uid are complete now
-            if (all_json_segments[i].received_segments == all_json_segments[i].total_segments) {
-                json_segments_merge(unique_id);
+        int is_key = key_length == 3;
+        if (frame[i] == '"') {
+            i++;
+            const char *value = frame + i;
+            size_t value_length = json_segments_string_end(value, length - i, &escaped);
+            if (value_length == length - i) {
+                return 0;
+            }
+            // cJSON_GetObjectItem returns the first match, so keep the first occurrence
+            if (is_key && memcmp(key, "uid", 3) == 0 && out->uid == NULL) {
+                out->uid = value;
+                out->uid_length = value_length;
+                out->uid_escaped = escaped;
+            } else if (is_key && memcmp(key, "seg", 3) == 0 && out->seg == NULL) {
+                out->seg = value;
+                out->seg_length = value_length;
+                out->seg_escaped = escaped;
+            }
+            i += value_length + 1;
+        } else {
+            int value;
+            size_t consumed = json_segments_scan_int(frame + i, length - i, &value);
+            if (consumed == 0) {
+                return 0;
             }
-            return;
+            if (is_key && memcmp(key, "seq", 3) == 0 && !out->has_sequence_number) {
+                out->sequence_number = value;
+                out->has_sequence_number = 1;
+            } else if (is_key && memcmp(key, "abs", 3) == 0 && !out->has_total_segments) {
+                out->total_segments = value;
+                out->has_total_segments = 1;
+            }
+            i += consumed;
+        }
+
+        i = json_segments_skip_whitespace(frame, length, i);
+        if (i >= length) {
+            return 0;
+        }
+        if (frame[i] == ',') {
+            i++;
+            continue;
         }
+        if (frame[i] != '}') {
+            return 0;
+        }
+        break;
     }
 
-    // Create new entry, if unique_id does not exist yet
-    JsonSegmentInfo *temp = realloc(all_json_segments, sizeof(JsonSegmentInfo) * (all_json_segments_count + 1));
-    if (temp == NULL) {
-        fprintf(stderr, "Memory allocation error!\n");
-        return NULL;
+    // Allow a trailing NUL terminator, like cJSON does
+    i = json_segments_skip_whitespace(frame, length, i + 1);
+    if (i < length && frame[i] != '\0') {
+        return 0;
+    }
+
+    return out->uid != NULL && out->seg != NULL && out->has_sequence_number && out->has_total_segments;
+}
+
+// Copy a (possibly escaped) string field into dst and NUL-terminate it.
+// Returns 0 if the escape sequences are malformed.
+static int json_segments_decode_field(char *dst, const char *src, size_t length, int escaped, size_t *decoded_length) {
+    size_t decoded = length;
+
+    if (escaped) {
+        decoded = json_segments_unescape(dst, src, length);
+        if (decoded == (size_t)-1) {
+            return 0;
+        }
     } else {
-        all_json_segments = temp;
+        memcpy(dst, src, length);
+    }
+    dst[decoded] = '\0';
+    *decoded_length = decoded;
+    return 1;
+}
+
+// Parse a serialized segment frame without building a cJSON tree. The
+// envelope is scanned in place and only uid and seg are decoded, into a stack
+// buffer for typical frame sizes. Unusual frames are handed to cJSON so the
+// accepted input is the same as for json_segments_parse_input.
+JsonSegmentsError json_segments_decode_frame(const char *frame, size_t length, JsonSegmentsAddFunction add, void *target) {
+    JsonSegmentsRawFrame raw;
+
+    if (frame == NULL) {
+        JSON_SEGMENTS_STAT_ADD(segments_invalid, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_ARGUMENT, "Invalid frame", NULL);
     }
 
-    int idx = all_json_segments_count;
-    all_json_segments[idx].unique_id = strdup(unique_id);
-    all_json_segments[idx].total_segments = total_segments;
-    all_json_segments[idx].received_segments = 1;
-    all_json_segments[idx].segments = malloc(sizeof(JsonSegment) * total_segments);
-    all_json_segments[idx].segments[0].sequence_number = sequence_number;
-    all_json_segments[idx].segments[0].json_segment = strdup(json_segment);
-    all_json_segments[idx].last_received_timestamp = time(NULL);
-    all_json_segments_count++;
+    if (json_segments_scan_frame(frame, length, &raw)) {
+        char stack_buffer[512];
+        size_t needed = raw.uid_length + raw.seg_length + 2;
+        char *buffer = needed <= sizeof(stack_buffer) ? stack_buffer : malloc(needed);
+
+        if (buffer == NULL) {
+            JSON_SEGMENTS_STAT_ADD(segments_out_of_memory, 1);
+            return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        }
+
+        char *uid = buffer;
+        char *seg = buffer + raw.uid_length + 1;
+        size_t uid_length;
+        size_t seg_length;
+        int decoded = json_segments_decode_field(uid, raw.uid, raw.uid_length, raw.uid_escaped, &uid_length) &&
+                      json_segments_decode_field(seg, raw.seg, raw.seg_length, raw.seg_escaped, &seg_length);
+        JsonSegmentsError result = JSON_SEGMENTS_OK;
+
+        if (decoded) {
+            result = add(target, uid, uid_length, raw.sequence_number, raw.total_segments, seg, seg_length);
+        }
+        if (buffer != stack_buffer) {
+            free(buffer);
+        }
+        if (decoded) {
+            return result;
+        }
+    }
 
-    return;
+    cJSON *json = cJSON_ParseWithLength(frame, length);
+    JsonSegmentsError result = json_segments_decode_object(json, add, target);
+    cJSON_Delete(json);
+    return result;
 }
 
+// 64-bit FNV-1a of a decoded uid.
+uint64_t json_segments_unique_id_hash(const char *unique_id, size_t unique_id_length) {
+    uint64_t hash = 14695981039346656037ULL;
 
-// Parse a cJSON object and add its contents as a segment. The function
-// extracts the unique_id, sequence number, total segments, and the segment
-// string from the cJSON object, validating each field before adding the segment.
-void json_segments_parse_input(cJSON *json_obj) {
-    if (json_obj == NULL) {
-        fprintf(stderr, "Ungültiges cJSON-Objekt\n");
-        return;
+    for (size_t i = 0; i < unique_id_length; i++) {
+        hash ^= (unsigned char)unique_id[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    cJSON *uid = cJSON_GetObjectItem(json_obj, "uid");
-    cJSON *seq = cJSON_GetObjectItem(json_obj, "seq");
-    cJSON *abs = cJSON_GetObjectItem(json_obj, "abs");
-    cJSON *seg = cJSON_GetObjectItem(json_obj, "seg");
+// Hash an escaped uid string body, decoding it into a stack buffer for
+// typical uid lengths. Returns 0 if the escape sequences are malformed.
+static int json_segments_hash_field(const char *src, size_t length, int escaped, uint64_t *hash) {
+    if (!escaped) {
+        *hash = json_segments_unique_id_hash(src, length);
+        return 1;
+    }
 
-    if (!cJSON_IsString(uid) || !cJSON_IsNumber(seq) || !cJSON_IsNumber(abs) || !cJSON_IsString(seg)) {
-        fprintf(stderr, "JSON-Objekt enthält ungültige Daten\n");
-        return;
+    char stack_buffer[256];
+    char *buffer = length <= sizeof(stack_buffer) ? stack_buffer : malloc(length);
+    if (buffer == NULL) {
+        return 0;
     }
 
-    json_segments_add(uid->valuestring, seq->valueint, abs->valueint, seg->valuestring);
+    size_t decoded = json_segments_unescape(buffer, src, length);
+    if (decoded != (size_t)-1) {
+        *hash = json_segments_unique_id_hash(buffer, decoded);
+    }
+    if (buffer != stack_buffer) {
+        free(buffer);
+    }
+    return decoded != (size_t)-1;
 }
 
-// Create a single JSON segment object. This function constructs a cJSON object
-// with the given UID, sequence number, total segments, and content, structuring
-// it as per the expected JSON segment format.
-void json_segments_create_single(cJSON **root, char *uid, int sequence_number, int total_segments, char *content) {
-    *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(*root, "uid", uid);
-    cJSON_AddNumberToObject(*root, "seq", sequence_number);
-    cJSON_AddNumberToObject(*root, "abs", total_segments);
-    cJSON_AddStringToObject(*root, "seg", content);
+// Hash the uid of a frame. The layout written by the library puts the uid
+// first, so for those frames only the uid string is scanned; anything else
+// goes through the same scanner and cJSON fallback as json_segments_decode_frame.
+JsonSegmentsError json_segments_frame_unique_id_hash(const char *frame, size_t length, uint64_t *hash) {
+    static const char prefix[] = "{\"uid\":\"";
+    JsonSegmentsRawFrame raw;
+    int escaped;
+
+    if (frame == NULL || hash == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (length > sizeof(prefix) - 1 && memcmp(frame, prefix, sizeof(prefix) - 1) == 0) {
+        const char *uid = frame + sizeof(prefix) - 1;
+        size_t uid_length = json_segments_string_end(uid, length - (sizeof(prefix) - 1), &escaped);
+        if (uid_length < length - (sizeof(prefix) - 1) && json_segments_hash_field(uid, uid_length, escaped, hash)) {
+            return JSON_SEGMENTS_OK;
+        }
+    }
+
+    if (json_segments_scan_frame(frame, length, &raw) && json_segments_hash_field(raw.uid, raw.uid_length, raw.uid_escaped, hash)) {
+        return JSON_SEGMENTS_OK;
+    }
+
+    cJSON *json = cJSON_ParseWithLength(frame, length);
+    cJSON *uid = cJSON_GetObjectItem(json, "uid");
+    JsonSegmentsError result = JSON_SEGMENTS_ERROR_INVALID_SEGMENT;
+    if (cJSON_IsString(uid)) {
+        *hash = json_segments_unique_id_hash(uid->valuestring, strlen(uid->valuestring));
+        result = JSON_SEGMENTS_OK;
+    }
+    cJSON_Delete(json);
+    return result;
+}
+
+// Parse a serialized segment frame into a context.
+JsonSegmentsError json_segments_context_parse_raw(JsonSegmentsContext *context, const char *frame, size_t length) {
+    return json_segments_decode_frame(frame, length, json_segments_context_add_decoded, context);
+}
+
+// Parse a serialized segment frame into the default context.
+JsonSegmentsError json_segments_parse_raw(const char *frame, size_t length) {
+    return json_segments_context_parse_raw(&json_segments_default_context, frame, length);
 }
 
-// Calculate the overhead of a JSON segment. This helper function creates a
-// temporary cJSON object with dummy values to estimate the additional space
-// required for metadata in each JSON segment.
+// Calculate the overhead of a JSON segment: the exact number of bytes a frame
+// with the given uid, seq and abs adds on top of its escaped content.
 int json_segments_overhead_size(const char *uid, int seq, int abs) {
-    // Create a temporary cJSON object to calculate the overhead
-    cJSON *temp = cJSON_CreateObject();
-    cJSON_AddStringToObject(temp, "uid", uid);
-    cJSON_AddNumberToObject(temp, "seq", seq);
-    cJSON_AddNumberToObject(temp, "abs", abs);
-    cJSON_AddStringToObject(temp, "seg", "");
+    return (int)(JSON_SEGMENTS_ENVELOPE_OVERHEAD + json_segments_escaped_length(uid, strlen(uid))) +
+           json_segments_int_length(seq) + json_segments_int_length(abs);
+}
+
+// Compute how a payload is cut into segments. Every splitter (string,
+// stream, ...) goes through here so they all produce the same frames.
+// The overhead is sized for the widest seq (which equals abs), so no frame
+// exceeds max_length unless its content needs escaping. Since abs itself
+// depends on the segment length, iterate until its digit count is stable;
+// it can only grow, so this takes at most a few rounds.
+int json_segments_layout(const char *uid, size_t payload_length, int max_length, size_t *segment_length, int *total_segments) {
+    if (uid == NULL || max_length <= 0) {
+        return -1;
+    }
 
-    char *temp_str = cJSON_PrintUnformatted(temp);
-    int overhead = strlen(temp_str) - 2; // minus 2 for the empty seg string
+    int fixed_overhead = json_segments_overhead_size(uid, 0, 0) - 2;
+    int digits = 1;
 
-    free(temp_str);
-    cJSON_Delete(temp);
+    for (;;) {
+        int max_seg_length = max_length - fixed_overhead - 2 * digits;
+
+        if (max_seg_length <= 0) {
+            return -1; // The max_length is too small even for the overhead
+        }
+
+        size_t count = (payload_length + (size_t)max_seg_length - 1) / (size_t)max_seg_length;
+        if (count > INT_MAX) {
+            return -1;
+        }
+
+        int count_digits = json_segments_int_length((int)count);
+        if (count_digits <= digits) {
+            *segment_length = (size_t)max_seg_length;
+            *total_segments = (int)count;
+            return 0;
+        }
+        digits = count_digits;
+    }
+}
 
-    return overhead;
+// Worst-case size of a serialized frame, for sizing transmit buffers: every
+// payload byte may expand to a six character \u00XX escape.
+size_t json_segments_frame_capacity(const char *uid, size_t segment_length, int total_segments) {
+    return (size_t)json_segments_overhead_size(uid, total_segments, total_segments) + 6 * segment_length + 1;
 }
 
 // Split a string into multiple JSON segments. This function divides a given
@@ -138,14 +1523,14 @@ cJSON **json_segments_split_string(const char *str, const char *uid, int max_len
     }
 
     int total_length = strlen(str);
-    int overhead = json_segments_overhead_size(uid, 0, 0); // Calculate overhead with dummy values
-    int max_seg_length = max_length - overhead;
+    size_t segment_length;
+    int total_segments;
 
-    if (max_seg_length <= 0) {
-        return NULL; // The max_length is too small even for the overhead
+    if (json_segments_layout(uid, (size_t)total_length, max_length, &segment_length, &total_segments) != 0) {
+        return NULL;
     }
 
-    int total_segments = (total_length + max_seg_length - 1) / max_seg_length;
+    int max_seg_length = (int)segment_length;
     cJSON **segments = malloc(sizeof(cJSON *) * total_segments);
 
     if (segments == NULL) {
@@ -169,6 +1554,60 @@ cJSON **json_segments_split_string(const char *str, const char *uid, int max_len
     return segments;
 }
 
+// Initialize a lazy segment iterator. Only the position within the source is
+// kept; frames are serialized on demand by json_segments_iterator_next.
+int json_segments_iterator_init(JsonSegmentsIterator *iterator, const char *str, size_t length, const char *uid, int max_length) {
+    if (iterator == NULL || str == NULL || uid == NULL) {
+        return -1;
+    }
+
+    if (json_segments_layout(uid, length, max_length, &iterator->segment_length, &iterator->total_segments) != 0) {
+        return -1;
+    }
+
+    iterator->source = str;
+    iterator->source_length = length;
+    iterator->unique_id = uid;
+    iterator->next_sequence_number = 1;
+    return json_segments_envelope_init(&iterator->envelope, uid, iterator->total_segments);
+}
+
+// Serialize the segment at the current position. Segment boundaries are a
+// multiple of segment_length, so any segment is located in O(1).
+int json_segments_iterator_next(JsonSegmentsIterator *iterator, char *frame, size_t frame_size) {
+    if (iterator == NULL) {
+        return -1;
+    }
+    if (iterator->next_sequence_number > iterator->total_segments) {
+        return 0;
+    }
+
+    size_t start = (size_t)(iterator->next_sequence_number - 1) * iterator->segment_length;
+    size_t length = iterator->source_length - start;
+    if (length > iterator->segment_length) {
+        length = iterator->segment_length;
+    }
+
+    int frame_length = json_segments_envelope_write(&iterator->envelope, frame, frame_size, iterator->next_sequence_number,
+                                                    iterator->source + start, length);
+    if (frame_length < 0) {
+        return -1;
+    }
+
+    iterator->next_sequence_number++;
+    return frame_length;
+}
+
+// Reposition the iterator to an arbitrary segment, e.g. for retransmits.
+int json_segments_iterator_seek(JsonSegmentsIterator *iterator, int sequence_number) {
+    if (iterator == NULL || sequence_number < 1 || sequence_number > iterator->total_segments) {
+        return -1;
+    }
+
+    iterator->next_sequence_number = sequence_number;
+    return 0;
+}
+
 // Free the memory allocated for an array of cJSON segments. This function
 // ensures that all cJSON objects in the array are safely deleted and the
 // memory for the array itself is freed. It relies on the first segment's
@@ -183,7 +1622,7 @@ void json_segments_free_segments_array(cJSON **segments) {
     cJSON *abs_item = cJSON_GetObjectItem(first_segment, "abs");
     if (!cJSON_IsNumber(abs_item)) {
         // Error handling if 'abs' is not a number or does not exist
-        fprintf(stderr, "Error: 'abs' field is missing or not a number in the first segment\n");
+        json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_ARGUMENT, "Error: 'abs' field is missing or not a number in the first segment", NULL);
         return;
     }
 
@@ -198,126 +1637,617 @@ void json_segments_free_segments_array(cJSON **segments) {
     free(segments);
 }
 
-// Delete all segments associated with a given unique_id. This function
-// frees all resources associated with the segments, including memory
-// for the unique ID, segment strings, and the segment array itself.
-void json_segments_delete_segments(const char *unique_id) {
-    for (int i = 0; i < all_json_segments_count; i++) {
-        if (strcmp(all_json_segments[i].unique_id, unique_id) == 0) {
-            // Free all ressources
-            free(all_json_segments[i].unique_id);
-            for (int j = 0; j < all_json_segments[i].received_segments; j++) {
-                free(all_json_segments[i].segments[j].json_segment);
-            }
-            free(all_json_segments[i].segments);
+// Remove an entry from the table without freeing it in O(1): the last entry
+// moves into the gap and its slot is pointed at the new index. The array is
+// only shrunk once it is a quarter full, so deletes do not realloc each time.
+// The removal is reported to the persistence function.
+static JsonSegmentInfo json_segments_detach(JsonSegmentsContext *context, int index) {
+    JsonSegmentInfo entry = context->segments[index];
+    int last = --context->segments_count;
 
-            // Move the remaining elements to avoid gaps
-            for (int j = i; j < all_json_segments_count - 1; j++) {
-                all_json_segments[j] = all_json_segments[j + 1];
-            }
+    if (context->persist_function != NULL) {
+        context->persist_function(JSON_SEGMENTS_PERSIST_REMOVE, json_segments_entry_unique_id(&entry), entry.unique_id_length, 0, 0, NULL, 0,
+                                  context->persist_context);
+    }
 
-            all_json_segments_count--;
-            
-            JsonSegmentInfo *temp = realloc(all_json_segments, sizeof(JsonSegmentInfo) * all_json_segments_count);
-            if (temp == NULL) {
-                fprintf(stderr, "Memory allocation error!\n");
-                return NULL;
-            } else {
-                all_json_segments = temp;
-            }
+    if (index != last) {
+        context->segments[index] = context->segments[last];
+        context->keys[index] = context->keys[last];
+        context->slots[context->segments[index].slot].index = index;
+    }
+    json_segments_release_slot(context, entry.slot);
+
+    if (context->segments_count == 0) {
+        // realloc(ptr, 0) may free the block and return NULL, leaving a dangling pointer
+        free(context->segments);
+        free(context->keys);
+        context->segments = NULL;
+        context->keys = NULL;
+        context->segments_capacity = 0;
+    } else if (context->segments_count <= context->segments_capacity / 4 && context->segments_capacity > JSON_SEGMENTS_INITIAL_CAPACITY) {
+        // If shrinking fails the larger block stays valid, so there is nothing to report
+        int capacity = context->segments_capacity / 2;
+        JsonSegmentInfo *temp = realloc(context->segments, sizeof(JsonSegmentInfo) * (size_t)capacity);
+        JsonSegmentsKey *keys = realloc(context->keys, sizeof(JsonSegmentsKey) * (size_t)capacity);
+        if (temp != NULL) {
+            context->segments = temp;
+        }
+        if (keys != NULL) {
+            context->keys = keys;
+        }
+        context->segments_capacity = capacity;
+    }
+
+    return entry;
+}
 
-            return;
+// Free all resources of a detached entry, including memory for the unique
+// ID, segment strings, and the segment array itself.
+static void json_segments_free_entry(JsonSegmentInfo *entry) {
+    JSON_SEGMENTS_STAT_SUB(in_flight_uids, 1);
+    JSON_SEGMENTS_STAT_SUB(buffered_bytes, entry->buffered_bytes);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_EVICT, json_segments_entry_unique_id(entry), 0);
+
+    json_segments_release_unique_id(entry);
+    if (entry->spill != NULL) {
+        json_segments_spill_free(entry->spill);
+    } else {
+        for (int j = 0; j < entry->received_segments; j++) {
+            json_segments_release_segment(&entry->segments[j]);
         }
     }
+    free(entry->segments);
+}
+
+// Delete all segments associated with a given unique_id.
+JsonSegmentsError json_segments_context_delete_segments(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length) {
+    if (context == NULL || unique_id == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+
+    int index = json_segments_find(context, unique_id, unique_id_length);
+    if (index < 0) {
+        return JSON_SEGMENTS_ERROR_NOT_FOUND;
+    }
+
+    JsonSegmentInfo entry = json_segments_detach(context, index);
+    json_segments_free_entry(&entry);
+    return JSON_SEGMENTS_OK;
+}
+
+// Delete the message a handle refers to.
+JsonSegmentsError json_segments_context_delete_handle(JsonSegmentsContext *context, JsonSegmentsHandle handle) {
+    int index = json_segments_resolve(context, handle);
+    if (index < 0) {
+        return JSON_SEGMENTS_ERROR_NOT_FOUND;
+    }
+
+    JsonSegmentInfo entry = json_segments_detach(context, index);
+    json_segments_free_entry(&entry);
+    return JSON_SEGMENTS_OK;
+}
+
+// Delete all segments associated with a given unique_id in the default context.
+JsonSegmentsError json_segments_delete_segments(const char *unique_id) {
+    if (unique_id == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+    return json_segments_context_delete_segments(&json_segments_default_context, unique_id, strlen(unique_id));
 }
 
 // Check for and handle timeouts in receiving JSON segments. This function
 // iterates through all JSON segments and deletes those that have not been
 // completed within the specified timeout period.
-void json_segments_check_timeout(int timeout) {
-    time_t current_time = time(NULL);
-    for (int i = 0; i < all_json_segments_count; i++) {
-        double seconds_diff = difftime(current_time, all_json_segments[i].last_received_timestamp);
+void json_segments_context_check_timeout(JsonSegmentsContext *context, int timeout) {
+    if (context == NULL) {
+        return;
+    }
+
+    time_t current_time = json_segments_now();
+    for (int i = 0; i < context->segments_count; i++) {
+        double seconds_diff = difftime(current_time, context->keys[i].last_received_timestamp);
         if (seconds_diff > timeout) {
-            json_segments_delete_segments(all_json_segments[i].unique_id);
-            // Nach dem Löschen eines Elements, iteriere erneut vom aktuellen Index
+            JSON_SEGMENTS_STAT_ADD(messages_timed_out, 1);
+            JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_TIMEOUT, json_segments_entry_unique_id(&context->segments[i]), 0);
+            JsonSegmentInfo entry = json_segments_detach(context, i);
+            json_segments_free_entry(&entry);
+            // Nach dem Löschen ist das letzte Element an Index i gerückt, prüfe es erneut
             i--;
         }
     }
 }
 
+// Check for timeouts in the default context.
+void json_segments_check_timeout(int timeout) {
+    json_segments_context_check_timeout(&json_segments_default_context, timeout);
+}
+
+// Free every partial message held by a context, and its slot map. The
+// entries are not detached one by one, so no removal is persisted.
+void json_segments_context_free(JsonSegmentsContext *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < context->segments_count; i++) {
+        json_segments_free_entry(&context->segments[i]);
+    }
+    context->segments_count = 0;
+    free(context->segments);
+    free(context->keys);
+    context->segments = NULL;
+    context->keys = NULL;
+    context->segments_capacity = 0;
+    free(context->slots);
+    context->slots = NULL;
+    context->slots_count = 0;
+    context->slots_capacity = 0;
+    context->free_slot = -1;
+}
+
 // Interpret a complete JSON object after reassembly. This function calls
 // the user-defined JSON processing function set in the global function pointer.
 // If no function is set, it logs an error.
-void json_segments_process_merged(cJSON *json) {
+JsonSegmentsError json_segments_process_merged(cJSON *json) {
     if (current_json_processing_function != NULL) {
         current_json_processing_function(json);
+        return JSON_SEGMENTS_OK;
+    }
+    return json_segments_report_error(JSON_SEGMENTS_ERROR_NO_HANDLER, "Keine Verarbeitungsfunktion gesetzt", NULL);
+}
+
+// Count a merged message in the time-to-complete histogram.
+void json_segments_stats_record_completion(time_t first_received_timestamp) {
+    double seconds = difftime(json_segments_now(), first_received_timestamp);
+    int bucket = 0;
+
+    while (bucket + 1 < JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS && seconds >= (double)(1L << bucket)) {
+        bucket++;
+    }
+    JSON_SEGMENTS_STAT_ADD(messages_merged, 1);
+    JSON_SEGMENTS_STAT_ADD(time_to_complete[bucket], 1);
+    (void)bucket;
+}
+
+// Concatenate the sorted segments of a complete entry and parse the result.
+static JsonSegmentsError json_segments_build(const JsonSegmentInfo *entry, cJSON **json) {
+    size_t total_length = 0;
+
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_START, json_segments_entry_unique_id(entry), 0);
+
+    // Determine the total length of the combined string
+    for (int j = 0; j < entry->total_segments; j++) {
+        total_length += entry->segments[j].length;
+    }
+
+    // Allocate memory for the complete string
+    char *full_json_str = (char *)malloc(total_length + 1);
+    if (full_json_str == NULL) {
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", json_segments_entry_unique_id(entry));
+    }
+
+    // Merge segments; copying at a running offset keeps this linear in the message size
+    char *out = full_json_str;
+    for (int j = 0; j < entry->total_segments; j++) {
+        memcpy(out, json_segments_segment_content(&entry->segments[j]), entry->segments[j].length);
+        out += entry->segments[j].length;
+    }
+    *out = '\0';
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_END, json_segments_entry_unique_id(entry), 0);
+
+    // Parse the merged JSON
+    *json = cJSON_ParseWithLength(full_json_str, total_length);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_PARSE_END, json_segments_entry_unique_id(entry), 0);
+    free(full_json_str);
+    if (*json == NULL) {
+        JSON_SEGMENTS_STAT_ADD(messages_parse_failed, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_PARSE, "Fehler beim Parsen von JSON", json_segments_entry_unique_id(entry));
+    }
+    return JSON_SEGMENTS_OK;
+}
+
+// Pass a parsed message to its processing function, then free it and its
+// detached entry.
+static JsonSegmentsError json_segments_deliver(JsonSegmentInfo *entry, cJSON *json, JsonSegmentsContextFunction processing_function, void *user_data) {
+    JsonSegmentsError result = JSON_SEGMENTS_OK;
+
+    json_segments_stats_record_completion(entry->first_received_timestamp);
+    if (processing_function != NULL) {
+        processing_function(json, user_data);
     } else {
-        fprintf(stderr, "Keine Verarbeitungsfunktion gesetzt\n");
+        result = json_segments_process_merged(json);
+    }
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_CALLBACK_END, json_segments_entry_unique_id(entry), 0);
+
+    cJSON_Delete(json);
+
+    // Remove processed segments
+    json_segments_free_entry(entry);
+    return result;
+}
+
+// Segment counts up to which the payload array of a vector delivery lives on the stack.
+#define JSON_SEGMENTS_IOVEC_STACK 64
+
+// Point an iovec at every segment of a complete, sorted entry. The array is
+// stack unless the message has more segments than it holds.
+static JsonSegmentsError json_segments_gather(const JsonSegmentInfo *entry, struct iovec *stack, struct iovec **segments, size_t *length) {
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_START, json_segments_entry_unique_id(entry), 0);
+
+    *segments = stack;
+    *length = 0;
+    if (entry->total_segments > JSON_SEGMENTS_IOVEC_STACK) {
+        *segments = malloc(sizeof(struct iovec) * (size_t)entry->total_segments);
+        if (*segments == NULL) {
+            return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", json_segments_entry_unique_id(entry));
+        }
+    }
+
+    for (int j = 0; j < entry->total_segments; j++) {
+        (*segments)[j].iov_base = (void *)json_segments_segment_content(&entry->segments[j]);
+        (*segments)[j].iov_len = entry->segments[j].length;
+        *length += entry->segments[j].length;
     }
+    // Nothing is parsed; the events keep the merge and parse phases of the trace paired
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_END, json_segments_entry_unique_id(entry), 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_PARSE_END, json_segments_entry_unique_id(entry), 0);
+    return JSON_SEGMENTS_OK;
 }
 
-// Merge all received segments associated with a unique_id into a complete JSON object.
-// This function sorts the segments in order, concatenates them into a single string,
-// and parses it into a cJSON object. The complete JSON is then passed to json_segments_process_merged.
-void json_segments_merge(const char *unique_id) {
-    for (int i = 0; i < all_json_segments_count; i++) {
-        if (strcmp(all_json_segments[i].unique_id, unique_id) == 0) {
-            // Check if all segments have been received
-            if (all_json_segments[i].received_segments != all_json_segments[i].total_segments) {
-                return;
-            }
+// Pass the gathered segments of a message to a vector function, then free
+// the array and the detached entry.
+static void json_segments_deliver_vector(JsonSegmentInfo *entry, struct iovec *stack, struct iovec *segments, size_t length,
+                                         JsonSegmentsVectorFunction vector_function, void *user_data) {
+    json_segments_stats_record_completion(entry->first_received_timestamp);
+    vector_function(json_segments_entry_unique_id(entry), entry->unique_id_length, segments, entry->total_segments, length, user_data);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_CALLBACK_END, json_segments_entry_unique_id(entry), 0);
 
-            // Sort the segments with Insertion Sort
-            for (int j = 1; j < all_json_segments[i].total_segments; j++) {
-                JsonSegment key = all_json_segments[i].segments[j];
-                int k = j - 1;
-
-                // Move elements of all_json_segments[i].segments[0..j-1] that are greater than key
-                while (k >= 0 && all_json_segments[i].segments[k].sequence_number > key.sequence_number) {
-                    all_json_segments[i].segments[k + 1] = all_json_segments[i].segments[k];
-                    k = k - 1;
-                }
-                all_json_segments[i].segments[k + 1] = key;
-            }
+    if (segments != stack) {
+        free(segments);
+    }
+    json_segments_free_entry(entry);
+}
 
-            char *full_json_str = NULL;
-            int total_length = 0;
+// Hand the file of a detached complete spilled message to the spill
+// function, then delete it with the entry.
+static void json_segments_deliver_spilled(JsonSegmentInfo *entry, JsonSegmentsSpillFunction spill_function, void *user_data) {
+    // The segments are already in place; the events keep the merge and parse phases of the trace paired
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_START, json_segments_entry_unique_id(entry), 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_END, json_segments_entry_unique_id(entry), 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_PARSE_END, json_segments_entry_unique_id(entry), 0);
 
-            // Determine the total length of the combined string
-            for (int j = 0; j < all_json_segments[i].total_segments; j++) {
-                total_length += strlen(all_json_segments[i].segments[j].json_segment);
-            }
+    json_segments_stats_record_completion(entry->first_received_timestamp);
+    spill_function(json_segments_entry_unique_id(entry), entry->unique_id_length, entry->spill->fd, entry->spill->path, entry->spill->length,
+                   user_data);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_CALLBACK_END, json_segments_entry_unique_id(entry), 0);
 
-            // Allocate memory for the complete string
-            full_json_str = (char *)malloc(total_length + 1);
-            if (full_json_str == NULL) {
-                fprintf(stderr, "Memory allocation error\n");
-                return;
-            }
+    json_segments_free_entry(entry);
+}
 
-            // Merge segments
-            strcpy(full_json_str, all_json_segments[i].segments[0].json_segment);
-            for (int j = 1; j < all_json_segments[i].total_segments; j++) {
-                strcat(full_json_str, all_json_segments[i].segments[j].json_segment);
-            }
+// NUL-terminate a uid for diagnostics and trace events of messages that are
+// not stored, truncating long ones.
+static const char *json_segments_uid_label(char *buffer, size_t size, const char *unique_id, size_t unique_id_length) {
+    size_t length = unique_id_length < size - 1 ? unique_id_length : size - 1;
+
+    memcpy(buffer, unique_id, length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+// Parse a single-frame message straight from the caller's buffer and hand
+// it to the processing function. Nothing is looked up, stored or copied,
+// and it runs on the calling thread even with an executor set: there is
+// nothing to reassemble.
+static JsonSegmentsError json_segments_deliver_single(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                      const char *json_segment, size_t json_segment_length) {
+    char label[64];
+    JsonSegmentsError result = JSON_SEGMENTS_OK;
+
+#if defined(JSON_SEGMENTS_TRACE)
+    json_segments_uid_label(label, sizeof(label), unique_id, unique_id_length);
+#endif
+    JSON_SEGMENTS_STAT_ADD(segments_accepted, 1);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_FIRST_SEEN, label, 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_SEGMENT, label, 1);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_COMPLETE, label, 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_START, label, 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_MERGE_END, label, 0);
+
+    if (context->vector_function != NULL) {
+        struct iovec segment = { (void *)json_segment, json_segment_length };
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_PARSE_END, label, 0);
+        json_segments_stats_record_completion(json_segments_now());
+        context->vector_function(unique_id, unique_id_length, &segment, 1, json_segment_length, context->vector_user_data);
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_CALLBACK_END, label, 0);
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_EVICT, label, 0);
+        return JSON_SEGMENTS_OK;
+    }
+
+    cJSON *json = cJSON_ParseWithLength(json_segment, json_segment_length);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_PARSE_END, label, 0);
+    if (json == NULL) {
+        JSON_SEGMENTS_STAT_ADD(messages_parse_failed, 1);
+        JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_EVICT, label, 0);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_PARSE, "Fehler beim Parsen von JSON",
+                                          json_segments_uid_label(label, sizeof(label), unique_id, unique_id_length));
+    }
+
+    json_segments_stats_record_completion(json_segments_now());
+    if (context->processing_function != NULL) {
+        context->processing_function(json, context->user_data);
+    } else {
+        result = json_segments_process_merged(json);
+    }
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_CALLBACK_END, label, 0);
+    JSON_SEGMENTS_TRACE_POINT(JSON_SEGMENTS_TRACE_EVICT, label, 0);
+
+    cJSON_Delete(json);
+    return result;
+}
+
+// A detached complete message queued on a context's executor.
+typedef struct {
+    JsonSegmentInfo entry;
+    JsonSegmentsContextFunction processing_function;
+    void *user_data;
+    JsonSegmentsVectorFunction vector_function;
+    void *vector_user_data;
+    JsonSegmentsSpillFunction spill_function;
+    void *spill_user_data;
+} JsonSegmentsCompletion;
 
-            // Parse the merged JSON
-            cJSON *json = cJSON_Parse(full_json_str);
-            if (json == NULL) {
-                fprintf(stderr, "Fehler beim Parsen von JSON\n");
-                free(full_json_str);
-                return;
+// Executor task completing one message. The entry has already left the
+// table, so a message that cannot be built is dropped.
+static void json_segments_complete_task(void *argument) {
+    JsonSegmentsCompletion *completion = argument;
+    cJSON *json;
+
+    if (completion->entry.spill != NULL) {
+        json_segments_deliver_spilled(&completion->entry, completion->spill_function, completion->spill_user_data);
+    } else if (completion->vector_function != NULL) {
+        struct iovec stack[JSON_SEGMENTS_IOVEC_STACK];
+        struct iovec *segments;
+        size_t length;
+        if (json_segments_gather(&completion->entry, stack, &segments, &length) == JSON_SEGMENTS_OK) {
+            json_segments_deliver_vector(&completion->entry, stack, segments, length, completion->vector_function, completion->vector_user_data);
+        } else {
+            json_segments_free_entry(&completion->entry);
+        }
+    } else if (json_segments_build(&completion->entry, &json) == JSON_SEGMENTS_OK) {
+        json_segments_deliver(&completion->entry, json, completion->processing_function, completion->user_data);
+    } else {
+        json_segments_free_entry(&completion->entry);
+    }
+    free(completion);
+}
+
+// Merge all received segments of a complete entry into a JSON object.
+// This function sorts the segments in order, concatenates them into a single
+// string and parses it. The entry is taken out of the table before the
+// processing function runs, so the callback may safely use the context. With
+// an executor set, the entry is taken out right after sorting and the rest
+// runs as a task; if the task cannot be queued, it runs inline.
+static JsonSegmentsError json_segments_merge_entry(JsonSegmentsContext *context, int index) {
+    JsonSegmentInfo *entry = &context->segments[index];
+
+    // Check if all segments have been received
+    if (entry->received_segments != entry->total_segments) {
+        return JSON_SEGMENTS_ERROR_INCOMPLETE;
+    }
+
+    // Sort the segments with Insertion Sort; a spilled message is in order already
+    for (int j = 1; entry->spill == NULL && j < entry->total_segments; j++) {
+        JsonSegment key = entry->segments[j];
+        int k = j - 1;
+
+        // Move elements of entry->segments[0..j-1] that are greater than key
+        while (k >= 0 && entry->segments[k].sequence_number > key.sequence_number) {
+            entry->segments[k + 1] = entry->segments[k];
+            k = k - 1;
+        }
+        entry->segments[k + 1] = key;
+    }
+
+    if (context->completion_executor != NULL) {
+        JsonSegmentsCompletion *completion = malloc(sizeof(*completion));
+        if (completion != NULL) {
+            completion->entry = json_segments_detach(context, index);
+            completion->processing_function = context->processing_function;
+            completion->user_data = context->user_data;
+            completion->vector_function = context->vector_function;
+            completion->vector_user_data = context->vector_user_data;
+            completion->spill_function = context->spill_function;
+            completion->spill_user_data = context->spill_user_data;
+            if (context->completion_executor(json_segments_complete_task, completion, context->completion_executor_context) == 0) {
+                return JSON_SEGMENTS_OK;
             }
+            json_segments_complete_task(completion);
+            return JSON_SEGMENTS_OK;
+        }
+    }
+
+    // Inline: a message that cannot be built stays in the table until it is deleted or times out
+    if (entry->spill != NULL) {
+        JsonSegmentInfo merged = json_segments_detach(context, index);
+        json_segments_deliver_spilled(&merged, context->spill_function, context->spill_user_data);
+        return JSON_SEGMENTS_OK;
+    }
+    if (context->vector_function != NULL) {
+        struct iovec stack[JSON_SEGMENTS_IOVEC_STACK];
+        struct iovec *segments;
+        size_t length;
+        JsonSegmentsError result = json_segments_gather(entry, stack, &segments, &length);
+        if (result != JSON_SEGMENTS_OK) {
+            return result;
+        }
+
+        JsonSegmentInfo merged = json_segments_detach(context, index);
+        json_segments_deliver_vector(&merged, stack, segments, length, context->vector_function, context->vector_user_data);
+        return JSON_SEGMENTS_OK;
+    }
+
+    cJSON *json;
+    JsonSegmentsError result = json_segments_build(entry, &json);
+    if (result != JSON_SEGMENTS_OK) {
+        return result;
+    }
+
+    JsonSegmentInfo merged = json_segments_detach(context, index);
+    return json_segments_deliver(&merged, json, context->processing_function, context->user_data);
+}
+
+// Merge all received segments associated with a unique_id into a complete JSON object.
+JsonSegmentsError json_segments_context_merge(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length) {
+    if (context == NULL || unique_id == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+
+    int index = json_segments_find(context, unique_id, unique_id_length);
+    if (index < 0) {
+        return JSON_SEGMENTS_ERROR_NOT_FOUND;
+    }
+    return json_segments_merge_entry(context, index);
+}
+
+// Merge all received segments associated with a unique_id in the default context.
+// The complete JSON is passed to json_segments_process_merged.
+JsonSegmentsError json_segments_merge(const char *unique_id) {
+    if (unique_id == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+    return json_segments_context_merge(&json_segments_default_context, unique_id, strlen(unique_id));
+}
+
+// Parse a message given as segment payloads. A single segment is parsed in
+// place; several are gathered first, since cJSON needs contiguous text.
+cJSON *json_segments_parse_iovec(const struct iovec *segments, int count) {
+    size_t length = 0;
+
+    if (segments == NULL || count <= 0) {
+        return NULL;
+    }
+    if (count == 1) {
+        return cJSON_ParseWithLength(segments[0].iov_base, segments[0].iov_len);
+    }
+
+    for (int i = 0; i < count; i++) {
+        length += segments[i].iov_len;
+    }
+    char *text = malloc(length + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    char *out = text;
+    for (int i = 0; i < count; i++) {
+        memcpy(out, segments[i].iov_base, segments[i].iov_len);
+        out += segments[i].iov_len;
+    }
+    *out = '\0';
+
+    cJSON *json = cJSON_ParseWithLength(text, length);
+    free(text);
+    return json;
+}
+
+// Write segment payloads to fd. Each writev() gets a window of at most
+// JSON_SEGMENTS_IOVEC_STACK entries, the first one trimmed by what an
+// earlier partial write already sent.
+int json_segments_writev(int fd, const struct iovec *segments, int count) {
+    struct iovec window[JSON_SEGMENTS_IOVEC_STACK];
+    size_t offset = 0;
+    int index = 0;
+
+    if (segments == NULL || count < 0) {
+        errno = EINVAL;
+        return -1;
+    }
 
-            json_segments_process_merged(json);
+    while (index < count) {
+        int window_count = count - index < JSON_SEGMENTS_IOVEC_STACK ? count - index : JSON_SEGMENTS_IOVEC_STACK;
+        memcpy(window, segments + index, sizeof(struct iovec) * (size_t)window_count);
+        window[0].iov_base = (char *)window[0].iov_base + offset;
+        window[0].iov_len -= offset;
 
-            cJSON_Delete(json);
-            free(full_json_str);
+        ssize_t written = writev(fd, window, window_count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
 
-            // Remove processed segments
-            json_segments_delete_segments(unique_id);
-            return;
+        // Skip the fully written entries, including empty ones, and remember how far into the next one it got
+        size_t remaining = (size_t)written + offset;
+        while (index < count && remaining >= segments[index].iov_len) {
+            remaining -= segments[index].iov_len;
+            index++;
         }
+        offset = remaining;
+    }
+    return 0;
+}
+
+// Copy the runtime counters into a caller-owned snapshot.
+void json_segments_stats_snapshot(JsonSegmentsStats *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->in_flight_uids = JSON_SEGMENTS_STAT_LOAD(in_flight_uids);
+    stats->buffered_bytes = JSON_SEGMENTS_STAT_LOAD(buffered_bytes);
+    stats->segments_accepted = JSON_SEGMENTS_STAT_LOAD(segments_accepted);
+    stats->segments_duplicate = JSON_SEGMENTS_STAT_LOAD(segments_duplicate);
+    stats->segments_inconsistent = JSON_SEGMENTS_STAT_LOAD(segments_inconsistent);
+    stats->segments_invalid = JSON_SEGMENTS_STAT_LOAD(segments_invalid);
+    stats->segments_out_of_memory = JSON_SEGMENTS_STAT_LOAD(segments_out_of_memory);
+    stats->messages_merged = JSON_SEGMENTS_STAT_LOAD(messages_merged);
+    stats->messages_parse_failed = JSON_SEGMENTS_STAT_LOAD(messages_parse_failed);
+    stats->messages_timed_out = JSON_SEGMENTS_STAT_LOAD(messages_timed_out);
+    for (int i = 0; i < JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS; i++) {
+        stats->time_to_complete[i] = JSON_SEGMENTS_STAT_LOAD(time_to_complete[i]);
     }
-}
\ No newline at end of file
+}
+
+// Adjust a counter on behalf of another module. Gauges are decremented with
+// a negative delta, which wraps around to the same unsigned result.
+void json_segments_stats_add(JsonSegmentsStatCounter counter, long long delta) {
+#if defined(JSON_SEGMENTS_NO_STATS)
+    (void)counter;
+    (void)delta;
+#else
+    JsonSegmentsCounter *target;
+
+    switch (counter) {
+        case JSON_SEGMENTS_COUNTER_IN_FLIGHT_UIDS: target = &json_segments_counters.in_flight_uids; break;
+        case JSON_SEGMENTS_COUNTER_BUFFERED_BYTES: target = &json_segments_counters.buffered_bytes; break;
+        case JSON_SEGMENTS_COUNTER_SEGMENTS_ACCEPTED: target = &json_segments_counters.segments_accepted; break;
+        case JSON_SEGMENTS_COUNTER_SEGMENTS_DUPLICATE: target = &json_segments_counters.segments_duplicate; break;
+        case JSON_SEGMENTS_COUNTER_SEGMENTS_INCONSISTENT: target = &json_segments_counters.segments_inconsistent; break;
+        case JSON_SEGMENTS_COUNTER_SEGMENTS_INVALID: target = &json_segments_counters.segments_invalid; break;
+        case JSON_SEGMENTS_COUNTER_SEGMENTS_OUT_OF_MEMORY: target = &json_segments_counters.segments_out_of_memory; break;
+        case JSON_SEGMENTS_COUNTER_MESSAGES_PARSE_FAILED: target = &json_segments_counters.messages_parse_failed; break;
+        case JSON_SEGMENTS_COUNTER_MESSAGES_TIMED_OUT: target = &json_segments_counters.messages_timed_out; break;
+        default: return;
+    }
+#if defined(__STDC_NO_ATOMICS__)
+    *target += (unsigned long long)delta;
+#else
+    atomic_fetch_add_explicit(target, (unsigned long long)delta, memory_order_relaxed);
+#endif
+#endif
+}
+
+// Reset the cumulative counters. The gauges describe the table and are kept.
+void json_segments_stats_reset(void) {
+    JSON_SEGMENTS_STAT_STORE(segments_accepted, 0);
+    JSON_SEGMENTS_STAT_STORE(segments_duplicate, 0);
+    JSON_SEGMENTS_STAT_STORE(segments_inconsistent, 0);
+    JSON_SEGMENTS_STAT_STORE(segments_invalid, 0);
+    JSON_SEGMENTS_STAT_STORE(segments_out_of_memory, 0);
+    JSON_SEGMENTS_STAT_STORE(messages_merged, 0);
+    JSON_SEGMENTS_STAT_STORE(messages_parse_failed, 0);
+    JSON_SEGMENTS_STAT_STORE(messages_timed_out, 0);
+    for (int i = 0; i < JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS; i++) {
+        JSON_SEGMENTS_STAT_STORE(time_to_complete[i], 0);
+    }
+}
@@ -26,8 +26,15 @@ int main() {
 #define JSON_SEGMENTS_H
 
 #include <cJSON.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
 #include <time.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Typedef for a function pointer for JSON processing
 typedef void (*JsonProcessingFunction)(cJSON *);
 
@@ -38,45 +45,385 @@ typedef void (*JsonProcessingFunction)(cJSON *);
  */
 extern JsonProcessingFunction current_json_processing_function;
 
+// Typedef for a function pointer returning the current time
+typedef time_t (*JsonSegmentsClockFunction)(void);
+
+/**
+ * @brief Global function pointer for reading the current time.
+ *
+ * Used to timestamp received segments and by json_segments_check_timeout(). If NULL (the default),
+ * time(NULL) is used. Simulations and tests can set it to drive reassembly from a virtual clock.
+ */
+extern JsonSegmentsClockFunction current_json_segments_clock_function;
+
+/**
+ * @brief Result codes of the reassembly entry points. Errors are negative.
+ */
+typedef enum {
+    JSON_SEGMENTS_OK = 0,                           ///< Success.
+    JSON_SEGMENTS_ERROR_INVALID_ARGUMENT = -1,      ///< A required argument was NULL or out of range.
+    JSON_SEGMENTS_ERROR_INVALID_SEGMENT = -2,       ///< The frame is not a valid segment object, or its sequence number is outside 1..total.
+    JSON_SEGMENTS_ERROR_DUPLICATE = -3,             ///< The segment was already received and has been dropped.
+    JSON_SEGMENTS_ERROR_INCONSISTENT = -4,          ///< The segment's total does not match earlier segments of the same uid.
+    JSON_SEGMENTS_ERROR_TOO_MANY_SEGMENTS = -5,     ///< The message already holds all of its segments.
+    JSON_SEGMENTS_ERROR_OUT_OF_MEMORY = -6,         ///< An allocation failed.
+    JSON_SEGMENTS_ERROR_NOT_FOUND = -7,             ///< No partial message with this uid exists.
+    JSON_SEGMENTS_ERROR_INCOMPLETE = -8,            ///< Not all segments of the message have been received yet.
+    JSON_SEGMENTS_ERROR_PARSE = -9,                 ///< The reassembled message is not valid JSON.
+    JSON_SEGMENTS_ERROR_NO_HANDLER = -10,           ///< No processing function is set; the message was discarded.
+    JSON_SEGMENTS_ERROR_IO = -11,                   ///< Reading the payload source failed or it ended early.
+    JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL = -12,     ///< The output buffer cannot hold the frame.
+    JSON_SEGMENTS_ERROR_FULL = -13,                 ///< The queue is full; retry once the consumer has caught up.
+} JsonSegmentsError;
+
+// Typedef for a function pointer receiving diagnostics
+typedef void (*JsonSegmentsDiagnosticFunction)(JsonSegmentsError error, const char *message, const char *unique_id, unsigned long suppressed);
+
+/**
+ * @brief Global function pointer for diagnostics.
+ *
+ * Called with a short description whenever an entry point fails. unique_id is NULL if unknown, and
+ * suppressed is the number of diagnostics dropped by the rate limit since the previous call. If NULL
+ * (the default) nothing is reported, so malformed traffic only costs the returned error code. Set it
+ * to json_segments_stderr_diagnostic to print to stderr.
+ */
+extern JsonSegmentsDiagnosticFunction current_json_segments_diagnostic_function;
+
+/**
+ * @brief Maximum number of diagnostics delivered per second of the segment clock (0 = unlimited, default 10).
+ */
+extern int json_segments_diagnostic_rate_limit;
+
+/**
+ * @brief Points in the lifecycle of a reassembled message reported to the trace hook.
+ */
+typedef enum {
+    JSON_SEGMENTS_TRACE_FIRST_SEEN,     ///< First segment of a uid arrived and a table entry was created.
+    JSON_SEGMENTS_TRACE_SEGMENT,        ///< A segment was stored (sequence_number is valid).
+    JSON_SEGMENTS_TRACE_COMPLETE,       ///< The last missing segment arrived.
+    JSON_SEGMENTS_TRACE_MERGE_START,    ///< Sorting and concatenation started.
+    JSON_SEGMENTS_TRACE_MERGE_END,      ///< The message text is assembled.
+    JSON_SEGMENTS_TRACE_PARSE_END,      ///< cJSON parsing finished (successfully or not).
+    JSON_SEGMENTS_TRACE_CALLBACK_END,   ///< current_json_processing_function returned.
+    JSON_SEGMENTS_TRACE_TIMEOUT,        ///< json_segments_check_timeout() expired the entry.
+    JSON_SEGMENTS_TRACE_EVICT,          ///< The entry was removed from the table.
+} JsonSegmentsTraceEvent;
+
+// Typedef for a function pointer receiving trace events
+typedef void (*JsonSegmentsTraceFunction)(JsonSegmentsTraceEvent event, const char *unique_id, int sequence_number, unsigned long long timestamp_ns);
+
+/**
+ * @brief Global function pointer for lifecycle tracing.
+ *
+ * Only called when the library is compiled with -DJSON_SEGMENTS_TRACE; otherwise the hooks are
+ * removed entirely. timestamp_ns is read from CLOCK_MONOTONIC, and only while a function is set.
+ * sequence_number is 0 for events that do not refer to a single segment. json_segments_trace.h
+ * provides a recorder with a Chrome trace-event exporter.
+ */
+extern JsonSegmentsTraceFunction current_json_segments_trace_function;
+
+#ifndef JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY
+/// Segment contents shorter than this are stored inside their JsonSegment instead of on the heap.
+#define JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY 48
+#endif
+
+#ifndef JSON_SEGMENTS_INLINE_UID_CAPACITY
+/// Uids shorter than this are stored inside their JsonSegmentInfo instead of on the heap.
+#define JSON_SEGMENTS_INLINE_UID_CAPACITY 17
+#endif
+
+/**
+ * @brief Called once a context no longer needs a buffer lent by json_segments_context_add_borrowed().
+ *
+ * @param release_context User-defined context given with the buffer, e.g. the packet buffer to unreference.
+ */
+typedef void (*JsonSegmentsReleaseFunction)(void *release_context);
+
 /**
  * @brief Structure representing a small segment of a JSON object.
+ *
+ * Short contents live in the record itself, so typical telemetry segments cost no allocation.
+ * Segments added with json_segments_context_add_borrowed() are kept as a view of the caller's buffer.
+ * Read the content with json_segments_segment_content().
  */
 typedef struct {
     int sequence_number;    ///< Sequence number of the JSON segment.
-    char *json_segment;     ///< String containing the JSON segment.
+    int borrowed;           ///< Nonzero if the content is the caller's buffer in json_segment.view.
+    size_t length;          ///< Length of the content in bytes; selects the member of json_segment.
+    union {
+        char *heap;         ///< NUL-terminated content of JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY bytes or more.
+        char bytes[JSON_SEGMENTS_INLINE_SEGMENT_CAPACITY]; ///< Shorter content, NUL-terminated.
+        struct {
+            const char *data;                    ///< Borrowed content, not NUL-terminated.
+            JsonSegmentsReleaseFunction release; ///< Called with release_context when the content is no longer needed; may be NULL.
+            void *release_context;               ///< Passed to release.
+        } view;             ///< Borrowed content of any length.
+    } json_segment;         ///< Content of the JSON segment.
 } JsonSegment;
 
+#ifndef JSON_SEGMENTS_ENVELOPE_CAPACITY
+/// Size of the inline frame header template; longer uids fall back to field-by-field serialization.
+#define JSON_SEGMENTS_ENVELOPE_CAPACITY 128
+#endif
+
+/**
+ * @brief Precomputed frame header template for one split.
+ *
+ * Everything in a frame except the seq digits and the content depends only on the uid and
+ * the total number of segments, so it is serialized once per split.
+ */
+typedef struct {
+    char header[JSON_SEGMENTS_ENVELOPE_CAPACITY]; ///< Frame prefix up to "seq": followed by the suffix from ,"abs": to the opening quote of seg.
+    size_t prefix_length;                   ///< Length of the prefix in header (0 if the uid did not fit).
+    size_t suffix_length;                   ///< Length of the suffix in header.
+    const char *unique_id;                  ///< Unique identifier (borrowed, not copied).
+    int total_segments;                     ///< Total number of segments.
+} JsonSegmentsEnvelope;
+
+/**
+ * @brief Lazy splitter producing one frame at a time from a source string.
+ *
+ * The iterator only stores its position, so senders interleaving many large messages
+ * do not hold any segment objects in memory. All fields are read-only for the caller.
+ */
+typedef struct {
+    const char *source;                     ///< Payload being split (borrowed, not copied).
+    size_t source_length;                   ///< Length of the payload in bytes.
+    const char *unique_id;                  ///< Unique identifier (borrowed, not copied).
+    size_t segment_length;                  ///< Payload bytes per segment (the last one may be shorter).
+    int total_segments;                     ///< Total number of segments.
+    int next_sequence_number;               ///< Sequence number produced by the next call to json_segments_iterator_next().
+    JsonSegmentsEnvelope envelope;          ///< Precomputed frame header.
+} JsonSegmentsIterator;
+
+/**
+ * @brief Reassembly state of a message that is written to a spill file; see json_segments_context_set_spill().
+ */
+typedef struct JsonSegmentsSpill JsonSegmentsSpill;
+
 /**
  * @brief Structure representing information about all segments of a JSON object.
  */
 typedef struct {
-    char *unique_id;                        ///< Unique identifier for the collection of JSON segments.
+    union {
+        char *heap;                         ///< NUL-terminated uid of JSON_SEGMENTS_INLINE_UID_CAPACITY bytes or more.
+        char bytes[JSON_SEGMENTS_INLINE_UID_CAPACITY]; ///< Shorter uid, NUL-terminated.
+    } unique_id;                            ///< Unique identifier for the collection of JSON segments; read it with json_segments_entry_unique_id().
+    size_t unique_id_length;                ///< Length of the uid in bytes; selects the member of unique_id.
     int received_segments;                  ///< Number of segments received so far.
     int total_segments;                     ///< Total number of segments expected.
-    JsonSegment *segments;            ///< Array of JSON segments.
+    JsonSegment *segments;            ///< Array of JSON segments; NULL if the message is spilled.
     time_t last_received_timestamp;         ///< Timestamp of the last received segment.
+    time_t first_received_timestamp;        ///< Timestamp of the first received segment.
+    size_t buffered_bytes;                  ///< Bytes of segment content held for this entry.
+    uint32_t slot;                          ///< Slot of the entry's handle in the context's slot map.
+    JsonSegmentsSpill *spill;               ///< File the message is reassembled in instead of segments, or NULL.
 } JsonSegmentInfo;
 
-// Global array of all JSON segment information
-extern JsonSegmentInfo *all_json_segments;
-extern int all_json_segments_count;
+/// Number of leading uid bytes kept in a JsonSegmentsKey.
+#define JSON_SEGMENTS_KEY_PREFIX_LENGTH 12
+
+/**
+ * @brief Hot part of a table entry, scanned on every lookup and timeout check.
+ *
+ * The keys of a context form a dense array parallel to its segments, two per cache line, so a
+ * lookup only touches the cold JsonSegmentInfo of the entry it matches. Uids of up to
+ * JSON_SEGMENTS_KEY_PREFIX_LENGTH bytes are compared without touching it at all.
+ */
+typedef struct {
+    uint64_t hash;                          ///< json_segments_unique_id_hash() of the uid.
+    time_t last_received_timestamp;         ///< Copy of the entry's last_received_timestamp.
+    uint32_t unique_id_length;              ///< Length of the uid in bytes.
+    char prefix[JSON_SEGMENTS_KEY_PREFIX_LENGTH]; ///< First bytes of the uid, zero-padded.
+} JsonSegmentsKey;
+
+/**
+ * @brief Stable reference to a partial message of a context.
+ *
+ * Returned by json_segments_context_add_handle() and json_segments_context_find_handle(). A handle
+ * stays valid while the message is buffered, however the table is rearranged, and becomes stale
+ * (never dangling) once the message is merged, deleted or timed out.
+ */
+typedef uint64_t JsonSegmentsHandle;
+
+/// Handle that never refers to a message.
+#define JSON_SEGMENTS_HANDLE_INVALID ((JsonSegmentsHandle)0)
+
+/**
+ * @brief Slot map entry translating a handle to the entry's position in segments.
+ */
+typedef struct {
+    uint32_t generation;                    ///< Incremented on every use and release; odd while the slot is in use.
+    int index;                              ///< Index in segments while in use, otherwise the next free slot (-1 ends the list).
+} JsonSegmentsSlot;
+
+// Typedef for a function pointer receiving the reassembled JSON of a context, plus the context's user data
+typedef void (*JsonSegmentsContextFunction)(cJSON *json, void *user_data);
+
+/**
+ * @brief Receives a complete message as its ordered segment payloads instead of a cJSON tree.
+ *
+ * The segments are neither concatenated nor parsed, so a consumer that only forwards the message
+ * can pass them straight to writev() or sendmsg(), see json_segments_writev(). Everything is only
+ * valid during the call and must not be modified; json_segments_parse_iovec() parses it if needed.
+ *
+ * @param unique_id Unique identifier of the message, not necessarily NUL-terminated.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param segments Payloads of the segments in sequence order.
+ * @param count Number of entries in segments.
+ * @param length Total length of the message in bytes.
+ * @param user_data User data registered with json_segments_context_set_vector_function().
+ */
+typedef void (*JsonSegmentsVectorFunction)(const char *unique_id, size_t unique_id_length, const struct iovec *segments, int count,
+                                           size_t length, void *user_data);
+
+/**
+ * @brief Receives a complete message that was reassembled in a spill file.
+ *
+ * The file holds exactly the message text. After the function returns, fd is closed and the file
+ * at path is deleted; rename() it to keep it, or dup() fd to keep reading it.
+ *
+ * @param unique_id Unique identifier of the message, NUL-terminated.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param fd Descriptor of the spill file, open for reading and writing.
+ * @param path Path of the spill file.
+ * @param length Length of the message in bytes.
+ * @param user_data User data registered with json_segments_context_set_spill().
+ */
+typedef void (*JsonSegmentsSpillFunction)(const char *unique_id, size_t unique_id_length, int fd, const char *path, size_t length,
+                                          void *user_data);
+
+/**
+ * @brief Change of a context's table reported to its persistence function.
+ */
+typedef enum {
+    JSON_SEGMENTS_PERSIST_SEGMENT,          ///< A segment was stored and its message is still incomplete.
+    JSON_SEGMENTS_PERSIST_REMOVE,           ///< A message left the table: it completed, or was deleted or timed out.
+} JsonSegmentsPersistEvent;
+
+/**
+ * @brief Caller-provided persistence of a context's partial messages, e.g. json_segments_journal_persist().
+ *
+ * Called on the thread that changed the table, before the change is visible to the processing
+ * function. The segment that completes a message is not reported, only the removal, so replaying
+ * the SEGMENT events that have no REMOVE yields exactly the partial messages.
+ *
+ * @param event What changed.
+ * @param unique_id Unique identifier of the message, NUL-terminated.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_number Sequence number of the segment (SEGMENT only).
+ * @param total_segments Total number of segments of the message (SEGMENT only).
+ * @param json_segment Segment content, not NUL-terminated (SEGMENT only, otherwise NULL).
+ * @param json_segment_length Length of json_segment in bytes.
+ * @param persist_context User-defined context registered with the function.
+ */
+typedef void (*JsonSegmentsPersistFunction)(JsonSegmentsPersistEvent event, const char *unique_id, size_t unique_id_length,
+                                            int sequence_number, int total_segments, const char *json_segment, size_t json_segment_length,
+                                            void *persist_context);
+
+/**
+ * @brief A unit of work handed to an executor.
+ */
+typedef void (*JsonSegmentsTaskFunction)(void *argument);
+
+/**
+ * @brief Caller-provided executor running single tasks asynchronously, e.g. json_segments_pool_submit().
+ *
+ * @param task Function to run once, on any thread.
+ * @param argument Argument for task.
+ * @param executor_context User-defined context registered with the executor.
+ * @return 0 if the task was accepted, nonzero to have the caller run it inline instead.
+ */
+typedef int (*JsonSegmentsSubmitFunction)(JsonSegmentsTaskFunction task, void *argument, void *executor_context);
+
+/**
+ * @brief Independent reassembly table.
+ *
+ * Each context owns its partial messages and may have its own processing function, so several
+ * receivers can live in one process. A context is not thread-safe; use one per thread or lock
+ * around calls. Statistics, diagnostics and trace events are shared by all contexts.
+ *
+ * Each entry is split into a hot JsonSegmentsKey in keys and the cold JsonSegmentInfo at the same
+ * index in segments. Removing an entry moves the last entry into its place, so indices are only valid
+ * until the next add, merge, delete or timeout check; keep a JsonSegmentsHandle to refer to a
+ * message across calls.
+ */
+typedef struct JsonSegmentsContext {
+    JsonSegmentInfo *segments;              ///< Partial messages, densely packed in no particular order.
+    int segments_count;                     ///< Number of entries in segments.
+    JsonSegmentsContextFunction processing_function; ///< Receives complete messages; NULL falls back to current_json_processing_function.
+    void *user_data;                        ///< Passed to processing_function.
+    JsonSegmentsSubmitFunction completion_executor; ///< Runs merge, parse and callback of complete messages; NULL runs them inline.
+    void *completion_executor_context;      ///< Passed to completion_executor.
+    int segments_capacity;                  ///< Allocated entries in segments.
+    JsonSegmentsSlot *slots;                ///< Slot map behind the handles; kept until the context is freed.
+    int slots_count;                        ///< Slots ever used.
+    int slots_capacity;                     ///< Allocated entries in slots.
+    int free_slot;                          ///< First released slot, or -1.
+    JsonSegmentsKey *keys;                  ///< Lookup keys of the entries, parallel to segments.
+    JsonSegmentsVectorFunction vector_function; ///< Receives complete messages unparsed instead of processing_function; NULL parses them.
+    void *vector_user_data;                 ///< Passed to vector_function.
+    JsonSegmentsSpillFunction spill_function; ///< Receives messages larger than spill_threshold from a spill file; NULL keeps all in memory.
+    void *spill_user_data;                  ///< Passed to spill_function.
+    const char *spill_directory;            ///< Directory of the spill files (borrowed, not copied).
+    size_t spill_threshold;                 ///< Messages of more bytes than this are spilled.
+    JsonSegmentsPersistFunction persist_function; ///< Records changes of the table; NULL keeps it in memory only.
+    void *persist_context;                  ///< Passed to persist_function.
+} JsonSegmentsContext;
+
+/**
+ * @brief Context used by the functions without a context parameter.
+ */
+extern JsonSegmentsContext json_segments_default_context;
+
+// Global array of all JSON segment information (the table of the default context)
+#define all_json_segments (json_segments_default_context.segments)
+#define all_json_segments_count (json_segments_default_context.segments_count)
+
+#ifndef JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS
+/// Number of buckets in the time-to-complete histogram (bucket i counts messages completed in less than 2^i seconds).
+#define JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS 16
+#endif
+
+/**
+ * @brief Snapshot of the reassembler's runtime counters.
+ *
+ * Counters are cumulative since start-up or the last json_segments_stats_reset(); in_flight_uids
+ * and buffered_bytes are gauges describing the table at the time of the snapshot. The counters are
+ * updated with relaxed atomics on the hot paths; define JSON_SEGMENTS_NO_STATS to compile them out.
+ */
+typedef struct {
+    unsigned long long in_flight_uids;              ///< Partial messages currently buffered.
+    unsigned long long buffered_bytes;              ///< Segment content bytes currently buffered.
+    unsigned long long segments_accepted;           ///< Segments stored in the table.
+    unsigned long long segments_duplicate;          ///< Segments dropped because their sequence number was already received.
+    unsigned long long segments_inconsistent;       ///< Segments dropped because their total did not match the entry's.
+    unsigned long long segments_invalid;            ///< Frames dropped because they were not valid segment objects.
+    unsigned long long segments_out_of_memory;      ///< Segments dropped because an allocation failed.
+    unsigned long long messages_merged;             ///< Messages reassembled and handed to the processing function.
+    unsigned long long messages_parse_failed;       ///< Reassembled messages that were not valid JSON.
+    unsigned long long messages_timed_out;          ///< Partial messages evicted by json_segments_check_timeout().
+    unsigned long long time_to_complete[JSON_SEGMENTS_STATS_HISTOGRAM_BUCKETS]; ///< Time from first segment to merge, log2 seconds buckets.
+} JsonSegmentsStats;
 
 /**
  * @brief Add a JSON segment to the global array.
  * 
  * @param unique_id Unique identifier for the JSON object.
- * @param sequence_number Sequence number of the segment.
+ * @param sequence_number Sequence number of the segment, from 1 to total_segments.
  * @param total_segments Total number of segments in the JSON object.
  * @param json_segment String containing the JSON segment.
+ * @return JSON_SEGMENTS_OK if the segment was stored (and, if it completed the message, the result of json_segments_merge()), or the reason it was dropped.
  */
-void json_segments_add(const char *unique_id, int sequence_number, int total_segments, const char *json_segment);
+JsonSegmentsError json_segments_add(const char *unique_id, int sequence_number, int total_segments, const char *json_segment);
 
 /**
  * @brief Delete all segments associated with a unique_id.
  * 
  * @param unique_id Unique identifier for the JSON object.
+ * @return JSON_SEGMENTS_OK, or JSON_SEGMENTS_ERROR_NOT_FOUND if no message with this uid is buffered.
  */
-void json_segments_delete_segments(const char *unique_id);
+JsonSegmentsError json_segments_delete_segments(const char *unique_id);
 
 /**
  * @brief Check for and handle timeouts in receiving JSON segments.
@@ -89,15 +436,17 @@ void json_segments_check_timeout(int timeout);
  * @brief Merge all received segments associated with a unique_id into a complete JSON object.
  * 
  * @param unique_id Unique identifier for the JSON object.
+ * @return JSON_SEGMENTS_OK if the message was handed to the processing function, otherwise the reason it was not.
  */
-void json_segments_merge(const char *unique_id);
+JsonSegmentsError json_segments_merge(const char *unique_id);
 
 /**
  * @brief Parse a cJSON object and add its contents as a segment.
  * 
  * @param json_obj cJSON object to parse and add.
+ * @return Result of json_segments_add(), or JSON_SEGMENTS_ERROR_INVALID_SEGMENT if the object is not a segment.
  */
-void json_segments_parse_input(cJSON *json_obj);
+JsonSegmentsError json_segments_parse_input(cJSON *json_obj);
 
 /**
  * @brief Interpret a complete JSON object after reassembly.
@@ -118,6 +467,33 @@ void json_segments_parse_input(cJSON *json_obj);
  */
 void json_segments_create_single(cJSON **root, char *uid, int sequence_number, int total_segments, char *content);
 
+/**
+ * @brief Compute how a payload of a given length is cut into segments.
+ *
+ * All splitters use this layout: every segment except the last one carries exactly
+ * segment_length payload bytes. The overhead is computed exactly from the escaped uid length
+ * and the digit count of the total, so frames never exceed max_length unless their content
+ * contains characters that need escaping.
+ *
+ * @param uid Unique identifier for the JSON object.
+ * @param payload_length Length of the payload in bytes.
+ * @param max_length Maximum length of each segment.
+ * @param segment_length Set to the number of payload bytes per segment.
+ * @param total_segments Set to the number of segments.
+ * @return 0 on success, -1 if max_length is too small for the frame overhead.
+ */
+int json_segments_layout(const char *uid, size_t payload_length, int max_length, size_t *segment_length, int *total_segments);
+
+/**
+ * @brief Worst-case size of a serialized frame, including the terminating NUL.
+ *
+ * @param uid Unique identifier for the JSON object.
+ * @param segment_length Number of payload bytes per segment, as returned by json_segments_layout().
+ * @param total_segments Total number of segments in the JSON object.
+ * @return Buffer size that is always sufficient for json_segments_write_frame().
+ */
+size_t json_segments_frame_capacity(const char *uid, size_t segment_length, int total_segments);
+
 /**
  * @brief Split a string into multiple JSON segments.
  * 
@@ -129,6 +505,44 @@ void json_segments_create_single(cJSON **root, char *uid, int sequence_number, i
 cJSON **json_segments_split_string(const char *str, const char *uid, int max_length);
 
 
+/**
+ * @brief Initialize a lazy segment iterator over a string.
+ *
+ * The iterator produces the same frames as json_segments_split_string() would, one at a time
+ * and without allocating. str and uid are borrowed and must outlive the iterator.
+ *
+ * @param iterator Iterator to initialize.
+ * @param str Payload to be split (not necessarily NUL-terminated).
+ * @param length Length of the payload in bytes.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each segment.
+ * @return 0 on success, -1 on invalid arguments or if max_length is too small for the overhead.
+ */
+int json_segments_iterator_init(JsonSegmentsIterator *iterator, const char *str, size_t length, const char *uid, int max_length);
+
+/**
+ * @brief Serialize the next segment into a frame buffer and advance the iterator.
+ *
+ * A buffer of json_segments_frame_capacity(uid, iterator->segment_length, iterator->total_segments)
+ * bytes is always large enough.
+ *
+ * @param iterator Initialized iterator.
+ * @param frame Output buffer for the NUL-terminated frame.
+ * @param frame_size Size of the output buffer in bytes.
+ * @return Length of the frame, 0 after the last frame, or -1 if the buffer is too small
+ *         (the iterator does not advance in that case).
+ */
+int json_segments_iterator_next(JsonSegmentsIterator *iterator, char *frame, size_t frame_size);
+
+/**
+ * @brief Reposition the iterator, e.g. to retransmit a lost segment.
+ *
+ * @param iterator Initialized iterator.
+ * @param sequence_number Sequence number the next call to json_segments_iterator_next() produces.
+ * @return 0 on success, -1 if the sequence number is out of range.
+ */
+int json_segments_iterator_seek(JsonSegmentsIterator *iterator, int sequence_number);
+
 /**
  * @brief Frees the memory allocated for an array of cJSON segments.
  * 
@@ -142,5 +556,529 @@ cJSON **json_segments_split_string(const char *str, const char *uid, int max_len
  */
 void json_segments_free_segments_array(cJSON **segments);
 
+/**
+ * @brief Compute the length of a string after JSON escaping.
+ *
+ * Quotes, backslashes and control bytes are located 16-32 bytes at a time with SSE2/AVX2/NEON
+ * when available (define JSON_SEGMENTS_NO_SIMD to force the scalar fallback).
+ *
+ * @param src String to be escaped (not necessarily NUL-terminated).
+ * @param length Number of bytes in src.
+ * @return Number of bytes json_segments_escape will write for src.
+ */
+size_t json_segments_escaped_length(const char *src, size_t length);
+
+/**
+ * @brief Escape a string for use as a JSON string body, byte-identical to cJSON's output.
+ *
+ * No surrounding quotes and no terminating NUL are written.
+ *
+ * @param dst Output buffer of at least json_segments_escaped_length(src, length) bytes.
+ * @param src String to be escaped.
+ * @param length Number of bytes in src.
+ * @return Number of bytes written to dst.
+ */
+size_t json_segments_escape(char *dst, const char *src, size_t length);
+
+/**
+ * @brief Unescape a JSON string body (without its surrounding quotes).
+ *
+ * The output is never longer than the input, so dst may be equal to src for in-place decoding.
+ * No terminating NUL is written.
+ *
+ * @param dst Output buffer of at least length bytes.
+ * @param src Escaped string body.
+ * @param length Number of bytes in src.
+ * @return Number of bytes written to dst, or (size_t)-1 if src contains a malformed escape sequence.
+ */
+size_t json_segments_unescape(char *dst, const char *src, size_t length);
+
+/**
+ * @brief Find the closing quote of a JSON string body.
+ *
+ * @param src Pointer to the first byte after the opening quote.
+ * @param length Number of bytes available at src.
+ * @param has_escapes Set to 1 if the body contains escape sequences, 0 otherwise.
+ * @return Offset of the closing quote, or length if the string is unterminated.
+ */
+size_t json_segments_string_end(const char *src, size_t length, int *has_escapes);
+
+/**
+ * @brief Serialize a single JSON segment frame directly into a buffer, without cJSON.
+ *
+ * The output is byte-identical to cJSON_PrintUnformatted() of the object built by
+ * json_segments_create_single() and is NUL-terminated.
+ *
+ * @param buffer Output buffer.
+ * @param size Size of the output buffer in bytes.
+ * @param uid Unique identifier for the JSON object.
+ * @param sequence_number Sequence number of the segment.
+ * @param total_segments Total number of segments in the JSON object.
+ * @param content Segment content (not necessarily NUL-terminated).
+ * @param content_length Number of bytes in content.
+ * @return Length of the frame excluding the terminating NUL, or -1 if the buffer is too small.
+ */
+int json_segments_write_frame(char *buffer, size_t size, const char *uid, int sequence_number, int total_segments, const char *content, size_t content_length);
+
+/**
+ * @brief Precompute the frame header template for a split.
+ *
+ * @param envelope Envelope to initialize.
+ * @param uid Unique identifier for the JSON object (borrowed, must outlive the envelope).
+ * @param total_segments Total number of segments in the JSON object.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int json_segments_envelope_init(JsonSegmentsEnvelope *envelope, const char *uid, int total_segments);
+
+/**
+ * @brief Serialize a frame from a precomputed envelope.
+ *
+ * Produces the same bytes as json_segments_write_frame() with the envelope's uid and total.
+ *
+ * @param envelope Envelope initialized with json_segments_envelope_init().
+ * @param buffer Output buffer.
+ * @param size Size of the output buffer in bytes.
+ * @param sequence_number Sequence number of the segment.
+ * @param content Segment content (not necessarily NUL-terminated).
+ * @param content_length Number of bytes in content.
+ * @return Length of the frame excluding the terminating NUL, or -1 if the buffer is too small.
+ */
+int json_segments_envelope_write(const JsonSegmentsEnvelope *envelope, char *buffer, size_t size, int sequence_number, const char *content, size_t content_length);
+
+/**
+ * @brief Parse a serialized segment frame and add its contents as a segment, without building a cJSON tree.
+ *
+ * Frames in the format produced by json_segments_write_frame() are scanned directly; anything else
+ * falls back to cJSON_Parse() and json_segments_parse_input().
+ *
+ * @param frame Received frame (not necessarily NUL-terminated).
+ * @param length Number of bytes in frame.
+ * @return Result of json_segments_add(), or the reason the frame was dropped.
+ */
+JsonSegmentsError json_segments_parse_raw(const char *frame, size_t length);
+
+/**
+ * @brief Receives the fields of a decoded segment, e.g. json_segments_context_add() behind an adapter.
+ *
+ * unique_id and json_segment are NUL-terminated and only valid during the call.
+ */
+typedef JsonSegmentsError (*JsonSegmentsAddFunction)(void *target, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                                     int total_segments, const char *json_segment, size_t json_segment_length);
+
+/**
+ * @brief Validate a cJSON segment object and pass its fields to add.
+ *
+ * Shared by all reassembly tables so they accept the same input.
+ *
+ * @param json_obj cJSON object to decode.
+ * @param add Receives the decoded segment.
+ * @param target Passed to add.
+ * @return Result of add, or JSON_SEGMENTS_ERROR_INVALID_SEGMENT if the object is not a segment.
+ */
+JsonSegmentsError json_segments_decode_object(cJSON *json_obj, JsonSegmentsAddFunction add, void *target);
+
+/**
+ * @brief Decode a serialized segment frame, as json_segments_parse_raw() does, and pass its fields to add.
+ *
+ * @param frame Received frame (not necessarily NUL-terminated).
+ * @param length Number of bytes in frame.
+ * @param add Receives the decoded segment.
+ * @param target Passed to add.
+ * @return Result of add, or the reason the frame was dropped.
+ */
+JsonSegmentsError json_segments_decode_frame(const char *frame, size_t length, JsonSegmentsAddFunction add, void *target);
+
+/**
+ * @brief 64-bit FNV-1a hash of a decoded uid, used to assign uids to shards.
+ *
+ * @param unique_id Unique identifier (not necessarily NUL-terminated).
+ * @param unique_id_length Length of unique_id in bytes.
+ * @return Hash of the uid.
+ */
+uint64_t json_segments_unique_id_hash(const char *unique_id, size_t unique_id_length);
+
+/**
+ * @brief Hash the uid of a serialized segment frame without decoding the rest of it.
+ *
+ * Frames in the layout the library writes ({"uid":"...",...) are handled by scanning the uid
+ * string alone. The hash is taken over the decoded uid, so it equals
+ * json_segments_unique_id_hash() of the uid json_segments_parse_raw() would add. Nothing is
+ * counted or reported: a frame that cannot be hashed can be handed to any shard, whose
+ * json_segments_parse_raw() reports it.
+ *
+ * @param frame Received frame (not necessarily NUL-terminated).
+ * @param length Number of bytes in frame.
+ * @param hash Receives the hash.
+ * @return JSON_SEGMENTS_OK, or JSON_SEGMENTS_ERROR_INVALID_SEGMENT if the frame has no uid string.
+ */
+JsonSegmentsError json_segments_frame_unique_id_hash(const char *frame, size_t length, uint64_t *hash);
+
+/**
+ * @brief Initialize an empty reassembly context.
+ *
+ * @param context Context to initialize.
+ * @param processing_function Receives complete messages, or NULL to use current_json_processing_function.
+ * @param user_data Passed to processing_function.
+ */
+void json_segments_context_init(JsonSegmentsContext *context, JsonSegmentsContextFunction processing_function, void *user_data);
+
+/**
+ * @brief Free all partial messages held by a context. The context can be reused afterwards.
+ *
+ * Also frees the slot map, so handles obtained before must not be used with the reused context.
+ *
+ * @param context Context to clear.
+ */
+void json_segments_context_free(JsonSegmentsContext *context);
+
+/**
+ * @brief Run the merge, parse and processing function of complete messages on an executor.
+ *
+ * The complete message is taken out of the context on the calling thread, so the call that
+ * added its last segment returns JSON_SEGMENTS_OK without waiting for it. A message that fails
+ * to parse is then reported through the diagnostic function and dropped instead of staying in
+ * the context. The processing function may run on several threads at once.
+ *
+ * @param context Context to configure.
+ * @param executor Executor receiving one task per complete message, or NULL to complete messages inline.
+ * @param executor_context Passed to executor.
+ */
+void json_segments_context_set_executor(JsonSegmentsContext *context, JsonSegmentsSubmitFunction executor, void *executor_context);
+
+/**
+ * @brief Deliver the complete messages of a context as segment payloads instead of parsing them.
+ *
+ * Forwarding a message then costs no payload copy: neither the merged text nor a cJSON tree is
+ * built, and the segment order is the only work done on completion. Single-frame messages are
+ * passed as one segment pointing into the caller's buffer. With an executor set, the function
+ * runs on the executor like the processing function would.
+ *
+ * @param context Context to configure.
+ * @param vector_function Function receiving complete messages, or NULL to parse them for the processing function again.
+ * @param user_data Passed to vector_function.
+ */
+void json_segments_context_set_vector_function(JsonSegmentsContext *context, JsonSegmentsVectorFunction vector_function, void *user_data);
+
+/**
+ * @brief Reassemble messages above a size threshold in files instead of memory.
+ *
+ * Every segment of such a message is written at its offset into a sparse file as it arrives and
+ * then dropped, so memory use no longer grows with the message: a spilled message holds one
+ * bit per segment. The file is handed to spill_function once the message is complete, instead
+ * of being parsed. The size is known from the first segment that is not the last one, as
+ * total_segments times its length, so all segments of a spilled message except the last must
+ * have the same length, as json_segments_split_string() and the other splitters produce them.
+ *
+ * @param context Context to configure.
+ * @param directory Directory for the spill files, which must stay valid; NULL for /tmp.
+ * @param threshold Messages of more bytes than this are spilled.
+ * @param spill_function Function receiving spilled messages, or NULL to keep every message in memory.
+ * @param user_data Passed to spill_function.
+ */
+void json_segments_context_set_spill(JsonSegmentsContext *context, const char *directory, size_t threshold,
+                                     JsonSegmentsSpillFunction spill_function, void *user_data);
+
+/**
+ * @brief Report every change of a context's partial messages to a persistence function.
+ *
+ * json_segments_context_free() does not report removals, so a table persisted up to a shutdown
+ * or crash can be rebuilt on the next start.
+ *
+ * @param context Context to configure.
+ * @param persist_function Function recording the changes, or NULL to stop recording.
+ * @param persist_context Passed to persist_function.
+ */
+void json_segments_context_set_persist(JsonSegmentsContext *context, JsonSegmentsPersistFunction persist_function, void *persist_context);
+
+/**
+ * @brief Report every stored segment of a context's partial messages as a SEGMENT event.
+ *
+ * Used to write a compact snapshot of the table, see json_segments_journal_compact().
+ *
+ * @param context Context to export.
+ * @param persist_function Function receiving the segments.
+ * @param persist_context Passed to persist_function.
+ * @return 0, or -1 if a spilled segment could not be read back.
+ */
+int json_segments_context_export(const JsonSegmentsContext *context, JsonSegmentsPersistFunction persist_function, void *persist_context);
+
+/**
+ * @brief List the sequence numbers a partial message still lacks, e.g. to ask the sender for them.
+ *
+ * @param context Context holding the message.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_numbers Receives the first capacity missing sequence numbers in ascending order; may be NULL if capacity is 0.
+ * @param capacity Number of entries sequence_numbers can hold.
+ * @return Number of missing segments, which may exceed capacity, or -1 if no message with this uid is buffered or memory ran out.
+ */
+int json_segments_context_missing(const JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length, int *sequence_numbers,
+                                  int capacity);
+
+/**
+ * @brief Parse a message delivered to a JsonSegmentsVectorFunction.
+ *
+ * A single segment is parsed in place. cJSON only parses contiguous text, so several segments
+ * are gathered into one temporary buffer first.
+ *
+ * @param segments Payloads of the segments in order.
+ * @param count Number of entries in segments.
+ * @return The parsed JSON object (to be freed with cJSON_Delete()), or NULL if it is not valid JSON or memory ran out.
+ */
+cJSON *json_segments_parse_iovec(const struct iovec *segments, int count);
+
+/**
+ * @brief Write segment payloads to a file descriptor with as few writev() calls as possible.
+ *
+ * Partial writes are resumed and interrupted calls retried, and arrays of any length are written
+ * in batches, so a message with more segments than IOV_MAX is fine.
+ *
+ * @param fd File descriptor to write to, e.g. a file, pipe or connected socket.
+ * @param segments Payloads to write in order.
+ * @param count Number of entries in segments.
+ * @return 0 once everything was written, or -1 with errno set.
+ */
+int json_segments_writev(int fd, const struct iovec *segments, int count);
+
+/**
+ * @brief Add a JSON segment to a context; see json_segments_add().
+ *
+ * uid and segment are given with explicit lengths and need not be NUL-terminated. The uid must
+ * not contain NUL bytes.
+ *
+ * A single-frame message (total_segments of 1) is delivered before the call returns and never
+ * stored. Duplicates are only detected while a message is buffered, so every copy of a
+ * single-frame message is delivered.
+ *
+ * @param context Context receiving the segment.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_number Sequence number of the segment, from 1 to total_segments.
+ * @param total_segments Total number of segments in the JSON object.
+ * @param json_segment Segment content.
+ * @param json_segment_length Length of json_segment in bytes.
+ * @return JSON_SEGMENTS_OK if the segment was stored (and, if it completed the message, the result of the merge), or the reason it was dropped.
+ */
+JsonSegmentsError json_segments_context_add(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                            int total_segments, const char *json_segment, size_t json_segment_length);
+
+/**
+ * @brief Add a JSON segment to a context without copying it; see json_segments_context_add().
+ *
+ * The context keeps a view of json_segment instead of a copy and concatenates the views only
+ * when the message is complete, so receivers whose packet buffers outlive the message, such as
+ * a receive ring or refcounted packets, ingest without allocating per segment. Ownership of
+ * the buffer passes to the context whatever the result: release is called with release_context
+ * exactly once, as soon as the buffer is no longer needed. That is before this call returns if
+ * the segment is dropped or completes its message inline, otherwise when the message is merged,
+ * deleted, timed out or the context is freed. With an executor set, release may run on a
+ * worker thread.
+ *
+ * @param context Context receiving the segment.
+ * @param unique_id Unique identifier for the JSON object; copied as by json_segments_context_add().
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_number Sequence number of the segment.
+ * @param total_segments Total number of segments in the JSON object.
+ * @param json_segment Segment content; must stay valid and unchanged until release is called.
+ * @param json_segment_length Length of json_segment in bytes.
+ * @param release Called once the buffer is no longer needed, or NULL if it outlives the context's use of it.
+ * @param release_context Passed to release.
+ * @return Same as json_segments_context_add().
+ */
+JsonSegmentsError json_segments_context_add_borrowed(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                     int sequence_number, int total_segments, const char *json_segment,
+                                                     size_t json_segment_length, JsonSegmentsReleaseFunction release, void *release_context);
+
+/**
+ * @brief Add a JSON segment to a context and return a handle to its message; see json_segments_context_add().
+ *
+ * @param context Context receiving the segment.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_number Sequence number of the segment.
+ * @param total_segments Total number of segments in the JSON object.
+ * @param json_segment Segment content.
+ * @param json_segment_length Length of json_segment in bytes.
+ * @param handle Set to the message's handle while it stays buffered, otherwise JSON_SEGMENTS_HANDLE_INVALID. May be NULL.
+ * @return Same as json_segments_context_add().
+ */
+JsonSegmentsError json_segments_context_add_handle(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length,
+                                                   int sequence_number, int total_segments, const char *json_segment,
+                                                   size_t json_segment_length, JsonSegmentsHandle *handle);
+
+/**
+ * @brief Add a further segment to the message a handle refers to, without looking up its uid.
+ *
+ * @param context Context holding the message.
+ * @param handle Handle of the message.
+ * @param sequence_number Sequence number of the segment.
+ * @param total_segments Total number of segments in the JSON object.
+ * @param json_segment Segment content.
+ * @param json_segment_length Length of json_segment in bytes.
+ * @return Same as json_segments_context_add(), or JSON_SEGMENTS_ERROR_NOT_FOUND if the handle is stale.
+ */
+JsonSegmentsError json_segments_context_add_by_handle(JsonSegmentsContext *context, JsonSegmentsHandle handle, int sequence_number,
+                                                      int total_segments, const char *json_segment, size_t json_segment_length);
+
+/**
+ * @brief Delete the message a handle refers to.
+ *
+ * @param context Context holding the message.
+ * @param handle Handle of the message.
+ * @return JSON_SEGMENTS_OK, or JSON_SEGMENTS_ERROR_NOT_FOUND if the handle is stale.
+ */
+JsonSegmentsError json_segments_context_delete_handle(JsonSegmentsContext *context, JsonSegmentsHandle handle);
+
+/**
+ * @brief Look up the entry a handle refers to in O(1).
+ *
+ * @param context Context holding the message.
+ * @param handle Handle of the message.
+ * @return The entry, valid until the next call modifying the context, or NULL if the handle is stale.
+ */
+JsonSegmentInfo *json_segments_context_entry(JsonSegmentsContext *context, JsonSegmentsHandle handle);
+
+/**
+ * @brief Content of a stored segment; NUL-terminated unless the segment is borrowed, so use its length.
+ */
+const char *json_segments_segment_content(const JsonSegment *segment);
+
+/**
+ * @brief NUL-terminated uid of a table entry.
+ */
+const char *json_segments_entry_unique_id(const JsonSegmentInfo *entry);
+
+/**
+ * @brief Find the handle of a buffered message by its uid.
+ *
+ * @param context Context holding the message.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @return The message's handle, or JSON_SEGMENTS_HANDLE_INVALID if no message with this uid is buffered.
+ */
+JsonSegmentsHandle json_segments_context_find_handle(const JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length);
+
+/**
+ * @brief Delete all segments associated with a unique_id from a context.
+ *
+ * @param context Context holding the message.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @return JSON_SEGMENTS_OK, or JSON_SEGMENTS_ERROR_NOT_FOUND if no message with this uid is buffered.
+ */
+JsonSegmentsError json_segments_context_delete_segments(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length);
+
+/**
+ * @brief Evict the partial messages of a context that received no segment for timeout seconds.
+ *
+ * @param context Context to check.
+ * @param timeout Time in seconds to consider a segment as timed out.
+ */
+void json_segments_context_check_timeout(JsonSegmentsContext *context, int timeout);
+
+/**
+ * @brief Merge a complete message of a context and hand it to the context's processing function.
+ *
+ * The entry is removed before the processing function runs, so the function may call back into the context.
+ *
+ * @param context Context holding the message.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @return JSON_SEGMENTS_OK if the message was processed, otherwise the reason it was not.
+ */
+JsonSegmentsError json_segments_context_merge(JsonSegmentsContext *context, const char *unique_id, size_t unique_id_length);
+
+/**
+ * @brief Parse a cJSON segment object into a context; see json_segments_parse_input().
+ *
+ * @param context Context receiving the segment.
+ * @param json_obj cJSON object to parse and add.
+ * @return Result of json_segments_context_add(), or JSON_SEGMENTS_ERROR_INVALID_SEGMENT if the object is not a segment.
+ */
+JsonSegmentsError json_segments_context_parse_input(JsonSegmentsContext *context, cJSON *json_obj);
+
+/**
+ * @brief Parse a serialized segment frame into a context; see json_segments_parse_raw().
+ *
+ * @param context Context receiving the segment.
+ * @param frame Received frame (not necessarily NUL-terminated).
+ * @param length Number of bytes in frame.
+ * @return Result of json_segments_context_add(), or the reason the frame was dropped.
+ */
+JsonSegmentsError json_segments_context_parse_raw(JsonSegmentsContext *context, const char *frame, size_t length);
+
+/**
+ * @brief Deliver a diagnostic to current_json_segments_diagnostic_function, subject to the rate limit.
+ *
+ * Used by all modules of the library; applications normally only read the returned codes.
+ *
+ * @param error Error being reported.
+ * @param message Short static description.
+ * @param unique_id Unique identifier the error relates to, or NULL.
+ * @return error, so failures can be reported and returned in one statement.
+ */
+JsonSegmentsError json_segments_report_error(JsonSegmentsError error, const char *message, const char *unique_id);
+
+/**
+ * @brief Diagnostic function printing to stderr, matching the library's former default output.
+ */
+void json_segments_stderr_diagnostic(JsonSegmentsError error, const char *message, const char *unique_id, unsigned long suppressed);
+
+/**
+ * @brief Short name of an error code, e.g. "duplicate segment".
+ *
+ * @param error Error code.
+ * @return Static string describing the error.
+ */
+const char *json_segments_error_string(JsonSegmentsError error);
+
+/**
+ * @brief Read the reassembler's runtime counters.
+ *
+ * Each counter is read atomically, but the snapshot as a whole is not a consistent cut while
+ * other threads are adding segments.
+ *
+ * @param stats Structure to fill in.
+ */
+void json_segments_stats_snapshot(JsonSegmentsStats *stats);
+
+/**
+ * @brief Reset the cumulative counters to zero. The in_flight_uids and buffered_bytes gauges are kept.
+ */
+void json_segments_stats_reset(void);
+
+/**
+ * @brief Counters that modules of the library update through json_segments_stats_add().
+ */
+typedef enum {
+    JSON_SEGMENTS_COUNTER_IN_FLIGHT_UIDS,
+    JSON_SEGMENTS_COUNTER_BUFFERED_BYTES,
+    JSON_SEGMENTS_COUNTER_SEGMENTS_ACCEPTED,
+    JSON_SEGMENTS_COUNTER_SEGMENTS_DUPLICATE,
+    JSON_SEGMENTS_COUNTER_SEGMENTS_INCONSISTENT,
+    JSON_SEGMENTS_COUNTER_SEGMENTS_INVALID,
+    JSON_SEGMENTS_COUNTER_SEGMENTS_OUT_OF_MEMORY,
+    JSON_SEGMENTS_COUNTER_MESSAGES_PARSE_FAILED,
+    JSON_SEGMENTS_COUNTER_MESSAGES_TIMED_OUT
+} JsonSegmentsStatCounter;
+
+/**
+ * @brief Adjust a runtime counter. Used by the modules of the library that keep their own tables.
+ *
+ * @param counter Counter to adjust.
+ * @param delta Amount to add; negative values decrement the gauges.
+ */
+void json_segments_stats_add(JsonSegmentsStatCounter counter, long long delta);
+
+/**
+ * @brief Count a merged message and its time to complete. Used by the modules of the library that keep their own tables.
+ *
+ * @param first_received_timestamp Timestamp of the message's first segment.
+ */
+void json_segments_stats_record_completion(time_t first_received_timestamp);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // JSON_SEGMENTS_H
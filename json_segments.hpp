@@ -0,0 +1,282 @@
+// json_segments.hpp
+
+/**
+ * @file json_segments.hpp
+ * @brief Header-only C++17 interface to the json_segments library.
+ *
+ * Thin wrappers over the C API: Reassembler owns a JsonSegmentsContext and calls a templated
+ * callable for each complete message, Splitter produces frames into caller-provided buffers, and
+ * SegmentArray owns the result of json_segments_split_string(). Reassembler takes std::string_view
+ * and passes it to the library with its length, so the receive path makes no copies and allocates
+ * nothing beyond the C functions. Splitter copies the uid once into a std::string and split_string()
+ * takes const std::string &, because the C functions need NUL-terminated strings.
+ */
+
+#ifndef JSON_SEGMENTS_HPP
+#define JSON_SEGMENTS_HPP
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
+
+#include "json_segments.h"
+
+namespace json_segments {
+
+#if defined(__cpp_lib_span)
+/// Writable byte buffer receiving frames.
+using ByteSpan = std::span<std::byte>;
+#else
+/// Writable byte buffer receiving frames (minimal stand-in for std::span<std::byte> before C++20).
+class ByteSpan {
+public:
+    constexpr ByteSpan() noexcept = default;
+    constexpr ByteSpan(std::byte *data, std::size_t size) noexcept : data_(data), size_(size) {}
+    template <std::size_t N>
+    constexpr ByteSpan(std::byte (&array)[N]) noexcept : data_(array), size_(N) {}
+    template <class Container, class = std::enable_if_t<std::is_same_v<decltype(std::declval<Container &>().data()), std::byte *>>>
+    constexpr ByteSpan(Container &container) noexcept : data_(container.data()), size_(container.size()) {}
+
+    constexpr std::byte *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+
+private:
+    std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+/**
+ * @brief Move-only owner of an independent reassembly table.
+ *
+ * Callback is any callable accepting a cJSON pointer; it is stored by value and called directly,
+ * without std::function. The cJSON object is only valid during the call. An exception thrown by
+ * the callback is held while the C code finishes and rethrown from the call that merged the message.
+ * Move assignment also needs a move-assignable Callback, which a lambda is not.
+ *
+ * @code
+ * json_segments::Reassembler receiver([&](cJSON *json) { handle(json); });
+ * receiver.ingest(std::string_view(frame, frame_length));
+ * @endcode
+ */
+template <class Callback>
+class Reassembler {
+public:
+    explicit Reassembler(Callback callback) : callback_(std::move(callback)) {
+        json_segments_context_init(&context_, &Reassembler::dispatch, this);
+    }
+
+    Reassembler(Reassembler &&other) noexcept(std::is_nothrow_move_constructible_v<Callback>)
+        : context_(other.context_), callback_(std::move(other.callback_)) {
+        context_.user_data = this;
+        json_segments_context_init(&other.context_, &Reassembler::dispatch, &other);
+    }
+
+    Reassembler &operator=(Reassembler &&other) noexcept(std::is_nothrow_move_assignable_v<Callback>) {
+        if (this != &other) {
+            json_segments_context_free(&context_);
+            context_ = other.context_;
+            context_.user_data = this;
+            callback_ = std::move(other.callback_);
+            json_segments_context_init(&other.context_, &Reassembler::dispatch, &other);
+        }
+        return *this;
+    }
+
+    Reassembler(const Reassembler &) = delete;
+    Reassembler &operator=(const Reassembler &) = delete;
+
+    ~Reassembler() { json_segments_context_free(&context_); }
+
+    /// Add a segment; see json_segments_context_add().
+    JsonSegmentsError add(std::string_view unique_id, int sequence_number, int total_segments, std::string_view json_segment) {
+        return rethrow(json_segments_context_add(&context_, unique_id.data(), unique_id.size(), sequence_number, total_segments,
+                                                 json_segment.data(), json_segment.size()));
+    }
+
+    /// Add a received frame without building a cJSON tree; see json_segments_context_parse_raw().
+    JsonSegmentsError ingest(std::string_view frame) {
+        return rethrow(json_segments_context_parse_raw(&context_, frame.data(), frame.size()));
+    }
+
+    /// Add a segment object; see json_segments_context_parse_input().
+    JsonSegmentsError ingest(cJSON *json_obj) { return rethrow(json_segments_context_parse_input(&context_, json_obj)); }
+
+    /// Merge a complete message; see json_segments_context_merge().
+    JsonSegmentsError merge(std::string_view unique_id) {
+        return rethrow(json_segments_context_merge(&context_, unique_id.data(), unique_id.size()));
+    }
+
+    /// Drop a partial message; see json_segments_context_delete_segments().
+    JsonSegmentsError erase(std::string_view unique_id) {
+        return json_segments_context_delete_segments(&context_, unique_id.data(), unique_id.size());
+    }
+
+    /// Evict partial messages idle for more than timeout seconds.
+    void check_timeout(int timeout) { json_segments_context_check_timeout(&context_, timeout); }
+
+    /// Drop all partial messages.
+    void clear() { json_segments_context_free(&context_); }
+
+    /// Number of partial messages buffered.
+    std::size_t size() const noexcept { return static_cast<std::size_t>(context_.segments_count); }
+
+    /// The underlying C context, e.g. to inspect the entries.
+    const JsonSegmentsContext &context() const noexcept { return context_; }
+
+    Callback &callback() noexcept { return callback_; }
+
+private:
+    static void dispatch(cJSON *json, void *user_data) {
+        Reassembler *self = static_cast<Reassembler *>(user_data);
+        // Exceptions must not unwind through the C frames
+        try {
+            self->callback_(json);
+        } catch (...) {
+            self->pending_ = std::current_exception();
+        }
+    }
+
+    JsonSegmentsError rethrow(JsonSegmentsError result) {
+        if (pending_) {
+            std::rethrow_exception(std::exchange(pending_, nullptr));
+        }
+        return result;
+    }
+
+    JsonSegmentsContext context_;
+    Callback callback_;
+    std::exception_ptr pending_;
+};
+
+/**
+ * @brief Lazy splitter producing frames into caller-provided buffers; wraps JsonSegmentsIterator.
+ *
+ * The payload is borrowed and must outlive the splitter. The uid is copied once, because the C
+ * iterator needs it NUL-terminated. Check valid() after construction.
+ */
+class Splitter {
+public:
+    Splitter(std::string_view payload, std::string_view unique_id, int max_length) : unique_id_(unique_id) {
+        valid_ = json_segments_iterator_init(&iterator_, payload.data(), payload.size(), unique_id_.c_str(), max_length) == 0;
+        rebind();
+    }
+
+    Splitter(const Splitter &other) : unique_id_(other.unique_id_), iterator_(other.iterator_), valid_(other.valid_) { rebind(); }
+
+    Splitter(Splitter &&other) noexcept : unique_id_(std::move(other.unique_id_)), iterator_(other.iterator_), valid_(other.valid_) {
+        rebind();
+    }
+
+    Splitter &operator=(const Splitter &other) {
+        if (this != &other) {
+            unique_id_ = other.unique_id_;
+            iterator_ = other.iterator_;
+            valid_ = other.valid_;
+            rebind();
+        }
+        return *this;
+    }
+
+    Splitter &operator=(Splitter &&other) noexcept {
+        if (this != &other) {
+            unique_id_ = std::move(other.unique_id_);
+            iterator_ = other.iterator_;
+            valid_ = other.valid_;
+            rebind();
+        }
+        return *this;
+    }
+
+    /// Whether the arguments were accepted; see json_segments_iterator_init().
+    bool valid() const noexcept { return valid_; }
+
+    int total_segments() const noexcept { return iterator_.total_segments; }
+
+    /// Sequence number of the frame produced by the next call to next().
+    int position() const noexcept { return iterator_.next_sequence_number; }
+
+    /// Buffer size that always fits a frame of this split.
+    std::size_t frame_capacity() const {
+        return json_segments_frame_capacity(unique_id_.c_str(), iterator_.segment_length, iterator_.total_segments);
+    }
+
+    /**
+     * @brief Serialize the next frame into buffer; see json_segments_iterator_next().
+     * @return Length of the frame, 0 after the last frame, or -1 if the buffer is too small.
+     */
+    int next(ByteSpan buffer) {
+        if (!valid_) {
+            return -1;
+        }
+        return json_segments_iterator_next(&iterator_, reinterpret_cast<char *>(buffer.data()), buffer.size());
+    }
+
+    /// Reposition to a sequence number, e.g. to retransmit; see json_segments_iterator_seek().
+    int seek(int sequence_number) { return valid_ ? json_segments_iterator_seek(&iterator_, sequence_number) : -1; }
+
+    /**
+     * @brief Serialize all remaining frames into buffer, calling f(std::string_view) for each.
+     *
+     * Each frame overwrites the previous one, so f must copy or send it before returning.
+     *
+     * @return 0 once all frames were produced, -1 if the splitter is invalid or the buffer is too small.
+     */
+    template <class F>
+    int for_each_frame(ByteSpan buffer, F &&f) {
+        int length;
+        while ((length = next(buffer)) > 0) {
+            f(std::string_view(reinterpret_cast<const char *>(buffer.data()), static_cast<std::size_t>(length)));
+        }
+        return length;
+    }
+
+    const JsonSegmentsIterator &iterator() const noexcept { return iterator_; }
+
+private:
+    // The iterator borrows the uid; point it at this object's copy
+    void rebind() noexcept {
+        iterator_.unique_id = unique_id_.c_str();
+        iterator_.envelope.unique_id = unique_id_.c_str();
+    }
+
+    std::string unique_id_;
+    JsonSegmentsIterator iterator_{};
+    bool valid_ = false;
+};
+
+/// Deleter for arrays returned by json_segments_split_string().
+struct SegmentArrayDeleter {
+    void operator()(cJSON **segments) const noexcept { json_segments_free_segments_array(segments); }
+};
+
+/// Owning array of segment objects; the number of elements is the "abs" value of the first one.
+using SegmentArray = std::unique_ptr<cJSON *[], SegmentArrayDeleter>;
+
+/**
+ * @brief Split a string into segment objects; see json_segments_split_string().
+ *
+ * Takes std::string rather than std::string_view because the C function needs NUL-terminated input.
+ *
+ * @return Owning array, empty on failure.
+ */
+inline SegmentArray split_string(const std::string &payload, const std::string &unique_id, int max_length) {
+    return SegmentArray(json_segments_split_string(payload.c_str(), unique_id.c_str(), max_length));
+}
+
+} // namespace json_segments
+
+#endif // JSON_SEGMENTS_HPP
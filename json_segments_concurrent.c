@@ -0,0 +1,658 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+
+#include "json_segments_concurrent.h"
+
+// Retired entries a thread accumulates before it tries to advance the epoch
+// and free the old ones.
+#define JSON_SEGMENTS_EPOCH_BATCH 64
+
+// Bits per word of a message's received bitmap.
+#define JSON_SEGMENTS_BITMAP_BITS (sizeof(unsigned long) * CHAR_BIT)
+
+// An entry removed from a table, waiting until no thread can reference it.
+typedef struct JsonSegmentsRetired {
+    struct JsonSegmentsRetired *next;
+    unsigned long epoch;                    // Global epoch when the entry was unlinked
+    void (*destroy)(struct JsonSegmentsRetired *retired);
+} JsonSegmentsRetired;
+
+// Per-thread reclamation state. Records are never freed: when a thread exits
+// its record is released and adopted by the next thread that needs one,
+// together with the entries still waiting in its limbo list.
+typedef struct JsonSegmentsEpochRecord {
+    atomic_ulong announced;                 // 0 outside critical sections, otherwise epoch << 1 | 1
+    atomic_int in_use;
+    struct JsonSegmentsEpochRecord *next;
+    int nesting;
+    JsonSegmentsRetired *limbo;
+    size_t limbo_count;
+    size_t collect_at;
+} JsonSegmentsEpochRecord;
+
+static atomic_ulong json_segments_epoch = 1;
+static _Atomic(JsonSegmentsEpochRecord *) json_segments_epoch_records;
+static pthread_once_t json_segments_epoch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t json_segments_epoch_key;
+static _Thread_local JsonSegmentsEpochRecord *json_segments_epoch_self;
+
+// Message states. Whoever moves a message out of ACTIVE removes it from the
+// table, so completion, eviction and deletion happen exactly once.
+enum {
+    JSON_SEGMENTS_MESSAGE_ACTIVE,
+    JSON_SEGMENTS_MESSAGE_MERGING,
+    JSON_SEGMENTS_MESSAGE_REMOVED
+};
+
+typedef struct {
+    size_t length;
+    char data[];
+} JsonSegmentsConcurrentSegment;
+
+// A partial message. The segment pointers, the bitmap and the uid live in
+// the same allocation, directly after the structure.
+typedef struct JsonSegmentsConcurrentMessage {
+    JsonSegmentsRetired retired;            // First member, so a retired entry can be cast back
+    _Atomic uintptr_t next;                 // Next message in the bucket; the low bit marks this one as removed
+    uint64_t hash;
+    int total_segments;
+    atomic_int received_segments;
+    atomic_int state;
+    _Atomic time_t first_received_timestamp;
+    _Atomic time_t last_received_timestamp;
+    atomic_size_t buffered_bytes;
+    _Atomic(JsonSegmentsConcurrentSegment *) *segments;
+    atomic_ulong *received;
+    size_t unique_id_length;
+    char *unique_id;
+} JsonSegmentsConcurrentMessage;
+
+struct JsonSegmentsConcurrentTable {
+    size_t bucket_mask;
+    JsonSegmentsContextFunction processing_function;
+    void *user_data;
+    atomic_size_t count;
+    _Atomic uintptr_t buckets[];
+};
+
+// Position in a bucket list: the link pointing at current.
+typedef struct {
+    _Atomic uintptr_t *previous;
+    JsonSegmentsConcurrentMessage *current;
+} JsonSegmentsConcurrentPosition;
+
+static time_t json_segments_concurrent_now(void) {
+    return current_json_segments_clock_function != NULL ? current_json_segments_clock_function() : time(NULL);
+}
+
+// Mark a thread's record as free when the thread exits.
+static void json_segments_epoch_release(void *argument) {
+    JsonSegmentsEpochRecord *record = argument;
+
+    atomic_store_explicit(&record->announced, 0, memory_order_release);
+    atomic_store_explicit(&record->in_use, 0, memory_order_release);
+}
+
+static void json_segments_epoch_create_key(void) {
+    pthread_key_create(&json_segments_epoch_key, json_segments_epoch_release);
+}
+
+// Find the calling thread's record, adopting a released one or registering
+// a new one on first use.
+static JsonSegmentsEpochRecord *json_segments_epoch_record(void) {
+    JsonSegmentsEpochRecord *record = json_segments_epoch_self;
+
+    if (record != NULL) {
+        return record;
+    }
+
+    pthread_once(&json_segments_epoch_once, json_segments_epoch_create_key);
+    for (record = atomic_load(&json_segments_epoch_records); record != NULL; record = record->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&record->in_use, &expected, 1)) {
+            break;
+        }
+    }
+
+    if (record == NULL) {
+        record = calloc(1, sizeof(*record));
+        if (record == NULL) {
+            return NULL;
+        }
+        atomic_init(&record->announced, 0);
+        atomic_init(&record->in_use, 1);
+        record->collect_at = JSON_SEGMENTS_EPOCH_BATCH;
+        record->next = atomic_load(&json_segments_epoch_records);
+        while (!atomic_compare_exchange_weak(&json_segments_epoch_records, &record->next, record)) {
+        }
+    }
+
+    json_segments_epoch_self = record;
+    pthread_setspecific(json_segments_epoch_key, record);
+    return record;
+}
+
+// Enter a critical section: entries reachable now are not freed until the
+// matching json_segments_epoch_exit. Sections nest.
+static JsonSegmentsEpochRecord *json_segments_epoch_enter(void) {
+    JsonSegmentsEpochRecord *record = json_segments_epoch_record();
+
+    if (record != NULL && record->nesting++ == 0) {
+        unsigned long epoch = atomic_load(&json_segments_epoch);
+        atomic_store_explicit(&record->announced, epoch << 1 | 1, memory_order_relaxed);
+        // The announcement must be visible before any entry is read
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+    return record;
+}
+
+static void json_segments_epoch_exit(JsonSegmentsEpochRecord *record) {
+    if (--record->nesting == 0) {
+        atomic_store_explicit(&record->announced, 0, memory_order_release);
+    }
+}
+
+// Advance the global epoch if every thread inside a critical section has
+// announced the current one.
+static void json_segments_epoch_try_advance(void) {
+    unsigned long epoch = atomic_load(&json_segments_epoch);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for (JsonSegmentsEpochRecord *record = atomic_load(&json_segments_epoch_records); record != NULL; record = record->next) {
+        unsigned long announced = atomic_load_explicit(&record->announced, memory_order_acquire);
+        if ((announced & 1) && (announced >> 1) != epoch) {
+            return;
+        }
+    }
+    atomic_compare_exchange_strong(&json_segments_epoch, &epoch, epoch + 1);
+}
+
+// Free the entries of a limbo list that were retired at least two epochs ago:
+// every thread that could have seen them has left its critical section since.
+static void json_segments_epoch_collect(JsonSegmentsEpochRecord *record) {
+    unsigned long epoch = atomic_load(&json_segments_epoch);
+    JsonSegmentsRetired **link = &record->limbo;
+
+    while (*link != NULL) {
+        JsonSegmentsRetired *retired = *link;
+        if (retired->epoch + 2 <= epoch) {
+            *link = retired->next;
+            retired->destroy(retired);
+            record->limbo_count--;
+        } else {
+            link = &retired->next;
+        }
+    }
+    record->collect_at = record->limbo_count + JSON_SEGMENTS_EPOCH_BATCH;
+}
+
+// Hand an unlinked entry to the reclamation scheme.
+static void json_segments_epoch_retire(JsonSegmentsEpochRecord *record, JsonSegmentsRetired *retired, void (*destroy)(JsonSegmentsRetired *retired)) {
+    retired->destroy = destroy;
+    retired->epoch = atomic_load(&json_segments_epoch);
+    retired->next = record->limbo;
+    record->limbo = retired;
+    if (++record->limbo_count >= record->collect_at) {
+        json_segments_epoch_try_advance();
+        json_segments_epoch_collect(record);
+    }
+}
+
+// Free old entries of the calling thread and of exited threads.
+void json_segments_concurrent_reclaim(void) {
+    JsonSegmentsEpochRecord *self = json_segments_epoch_record();
+
+    if (self != NULL && self->nesting > 0) {
+        return;
+    }
+
+    // Entries retired up to now become old enough after two advances; a third covers a concurrent retire
+    for (int i = 0; i < 3; i++) {
+        json_segments_epoch_try_advance();
+    }
+    for (JsonSegmentsEpochRecord *record = atomic_load(&json_segments_epoch_records); record != NULL; record = record->next) {
+        int expected = 0;
+        if (record == self) {
+            json_segments_epoch_collect(record);
+        } else if (atomic_compare_exchange_strong(&record->in_use, &expected, 1)) {
+            json_segments_epoch_collect(record);
+            atomic_store_explicit(&record->in_use, 0, memory_order_release);
+        }
+    }
+}
+
+// Allocate a message with an empty bitmap, or NULL if the allocation fails.
+static JsonSegmentsConcurrentMessage *json_segments_concurrent_create_message(uint64_t hash, const char *unique_id, size_t unique_id_length,
+                                                                              int total_segments, time_t now) {
+    size_t words = ((size_t)total_segments + JSON_SEGMENTS_BITMAP_BITS - 1) / JSON_SEGMENTS_BITMAP_BITS;
+    size_t per_segment = sizeof(_Atomic(JsonSegmentsConcurrentSegment *));
+
+    if ((size_t)total_segments > (SIZE_MAX - sizeof(JsonSegmentsConcurrentMessage) - unique_id_length - 1) / (per_segment + sizeof(atomic_ulong))) {
+        return NULL;
+    }
+
+    JsonSegmentsConcurrentMessage *message = malloc(sizeof(*message) + (size_t)total_segments * per_segment + words * sizeof(atomic_ulong) + unique_id_length + 1);
+    if (message == NULL) {
+        return NULL;
+    }
+
+    message->segments = (_Atomic(JsonSegmentsConcurrentSegment *) *)(message + 1);
+    message->received = (atomic_ulong *)(message->segments + total_segments);
+    message->unique_id = (char *)(message->received + words);
+    for (int i = 0; i < total_segments; i++) {
+        atomic_init(&message->segments[i], NULL);
+    }
+    for (size_t i = 0; i < words; i++) {
+        atomic_init(&message->received[i], 0);
+    }
+    memcpy(message->unique_id, unique_id, unique_id_length);
+    message->unique_id[unique_id_length] = '\0';
+    message->unique_id_length = unique_id_length;
+
+    atomic_init(&message->next, 0);
+    message->hash = hash;
+    message->total_segments = total_segments;
+    atomic_init(&message->received_segments, 0);
+    atomic_init(&message->state, JSON_SEGMENTS_MESSAGE_ACTIVE);
+    atomic_init(&message->first_received_timestamp, now);
+    atomic_init(&message->last_received_timestamp, now);
+    atomic_init(&message->buffered_bytes, 0);
+    return message;
+}
+
+// Free a message and every segment stored in it, including segments that
+// arrived after it was removed.
+static void json_segments_concurrent_destroy_message(JsonSegmentsConcurrentMessage *message) {
+    json_segments_stats_add(JSON_SEGMENTS_COUNTER_BUFFERED_BYTES, -(long long)atomic_load(&message->buffered_bytes));
+    for (int i = 0; i < message->total_segments; i++) {
+        free(atomic_load_explicit(&message->segments[i], memory_order_relaxed));
+    }
+    free(message);
+}
+
+static void json_segments_concurrent_destroy_retired(JsonSegmentsRetired *retired) {
+    json_segments_concurrent_destroy_message((JsonSegmentsConcurrentMessage *)retired);
+}
+
+// Order of the bucket lists: hash, then uid length, then uid bytes.
+static int json_segments_concurrent_compare(const JsonSegmentsConcurrentMessage *message, uint64_t hash, const char *unique_id, size_t unique_id_length) {
+    if (message->hash != hash) {
+        return message->hash < hash ? -1 : 1;
+    }
+    if (message->unique_id_length != unique_id_length) {
+        return message->unique_id_length < unique_id_length ? -1 : 1;
+    }
+    return memcmp(message->unique_id, unique_id, unique_id_length);
+}
+
+// Locate the first message not ordered before the key, unlinking and
+// retiring removed messages on the way. Returns 1 if it has the key.
+static int json_segments_concurrent_find(JsonSegmentsConcurrentTable *table, JsonSegmentsEpochRecord *record, uint64_t hash,
+                                         const char *unique_id, size_t unique_id_length, JsonSegmentsConcurrentPosition *position) {
+    _Atomic uintptr_t *head = &table->buckets[hash & table->bucket_mask];
+
+retry:
+    position->previous = head;
+    position->current = (JsonSegmentsConcurrentMessage *)atomic_load(head);
+    for (;;) {
+        JsonSegmentsConcurrentMessage *current = position->current;
+        if (current == NULL) {
+            return 0;
+        }
+
+        uintptr_t next = atomic_load(&current->next);
+        if (atomic_load(position->previous) != (uintptr_t)current) {
+            goto retry;
+        }
+
+        if (!(next & 1)) {
+            int order = json_segments_concurrent_compare(current, hash, unique_id, unique_id_length);
+            if (order >= 0) {
+                return order == 0;
+            }
+            position->previous = &current->next;
+        } else {
+            // current is removed: unlink it, and whoever succeeds retires it
+            uintptr_t expected = (uintptr_t)current;
+            if (!atomic_compare_exchange_strong(position->previous, &expected, next & ~(uintptr_t)1)) {
+                goto retry;
+            }
+            json_segments_epoch_retire(record, &current->retired, json_segments_concurrent_destroy_retired);
+        }
+        position->current = (JsonSegmentsConcurrentMessage *)(next & ~(uintptr_t)1);
+    }
+}
+
+// Return the message for a uid, inserting a new one with a single CAS if
+// there is none. Sets *created if this call inserted it.
+static JsonSegmentsConcurrentMessage *json_segments_concurrent_lookup(JsonSegmentsConcurrentTable *table, JsonSegmentsEpochRecord *record, uint64_t hash,
+                                                                      const char *unique_id, size_t unique_id_length, int total_segments, int *created) {
+    JsonSegmentsConcurrentMessage *message = NULL;
+    JsonSegmentsConcurrentPosition position;
+
+    *created = 0;
+    for (;;) {
+        if (json_segments_concurrent_find(table, record, hash, unique_id, unique_id_length, &position)) {
+            free(message);
+            return position.current;
+        }
+        if (message == NULL) {
+            message = json_segments_concurrent_create_message(hash, unique_id, unique_id_length, total_segments, json_segments_concurrent_now());
+            if (message == NULL) {
+                return NULL;
+            }
+        }
+
+        uintptr_t expected = (uintptr_t)position.current;
+        atomic_store_explicit(&message->next, expected, memory_order_relaxed);
+        if (atomic_compare_exchange_strong(position.previous, &expected, (uintptr_t)message)) {
+            atomic_fetch_add(&table->count, 1);
+            json_segments_stats_add(JSON_SEGMENTS_COUNTER_IN_FLIGHT_UIDS, 1);
+            *created = 1;
+            return message;
+        }
+    }
+}
+
+// Remove a message whose state the caller moved out of ACTIVE: mark it, then
+// let a search unlink and retire it.
+static void json_segments_concurrent_remove(JsonSegmentsConcurrentTable *table, JsonSegmentsEpochRecord *record, JsonSegmentsConcurrentMessage *message) {
+    JsonSegmentsConcurrentPosition position;
+    uintptr_t next = atomic_load(&message->next);
+
+    while (!(next & 1) && !atomic_compare_exchange_weak(&message->next, &next, next | 1)) {
+    }
+    json_segments_concurrent_find(table, record, message->hash, message->unique_id, message->unique_id_length, &position);
+    atomic_fetch_sub(&table->count, 1);
+    json_segments_stats_add(JSON_SEGMENTS_COUNTER_IN_FLIGHT_UIDS, -1);
+}
+
+// Concatenate the segments of a complete message, followed by a NUL and the
+// uid for diagnostics, so the message can be released before parsing.
+static char *json_segments_concurrent_assemble(JsonSegmentsConcurrentMessage *message, size_t *length) {
+    size_t total_length = 0;
+
+    for (int i = 0; i < message->total_segments; i++) {
+        total_length += atomic_load_explicit(&message->segments[i], memory_order_relaxed)->length;
+    }
+
+    char *text = malloc(total_length + message->unique_id_length + 2);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    char *out = text;
+    for (int i = 0; i < message->total_segments; i++) {
+        JsonSegmentsConcurrentSegment *segment = atomic_load_explicit(&message->segments[i], memory_order_relaxed);
+        memcpy(out, segment->data, segment->length);
+        out += segment->length;
+    }
+    *out++ = '\0';
+    memcpy(out, message->unique_id, message->unique_id_length + 1);
+    *length = total_length;
+    return text;
+}
+
+// Parse a reassembled message and hand it to the processing function.
+static JsonSegmentsError json_segments_concurrent_deliver(JsonSegmentsConcurrentTable *table, const char *text, size_t length, time_t first_received_timestamp) {
+    const char *unique_id = text + length + 1;
+    cJSON *json = cJSON_ParseWithLength(text, length);
+
+    if (json == NULL) {
+        json_segments_stats_add(JSON_SEGMENTS_COUNTER_MESSAGES_PARSE_FAILED, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_PARSE, "Fehler beim Parsen von JSON", unique_id);
+    }
+
+    JsonSegmentsError result = JSON_SEGMENTS_OK;
+    json_segments_stats_record_completion(first_received_timestamp);
+    if (table->processing_function != NULL) {
+        table->processing_function(json, table->user_data);
+    } else if (current_json_processing_function != NULL) {
+        current_json_processing_function(json);
+    } else {
+        result = json_segments_report_error(JSON_SEGMENTS_ERROR_NO_HANDLER, "Keine Verarbeitungsfunktion gesetzt", NULL);
+    }
+    cJSON_Delete(json);
+    return result;
+}
+
+// Create an empty table with a power-of-two number of buckets.
+JsonSegmentsConcurrentTable *json_segments_concurrent_create(size_t bucket_count, JsonSegmentsContextFunction processing_function, void *user_data) {
+    size_t buckets = 1;
+
+    while (buckets < bucket_count && buckets <= (SIZE_MAX - sizeof(JsonSegmentsConcurrentTable)) / sizeof(_Atomic uintptr_t) / 2) {
+        buckets *= 2;
+    }
+
+    JsonSegmentsConcurrentTable *table = malloc(sizeof(*table) + buckets * sizeof(_Atomic uintptr_t));
+    if (table == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        return NULL;
+    }
+
+    table->bucket_mask = buckets - 1;
+    table->processing_function = processing_function;
+    table->user_data = user_data;
+    atomic_init(&table->count, 0);
+    for (size_t i = 0; i < buckets; i++) {
+        atomic_init(&table->buckets[i], 0);
+    }
+    return table;
+}
+
+// Free a table. Messages still linked are freed directly; unlinked ones are
+// already owned by the reclamation scheme.
+void json_segments_concurrent_free(JsonSegmentsConcurrentTable *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i <= table->bucket_mask; i++) {
+        uintptr_t link = atomic_load(&table->buckets[i]);
+        while (link != 0) {
+            JsonSegmentsConcurrentMessage *message = (JsonSegmentsConcurrentMessage *)link;
+            link = atomic_load(&message->next) & ~(uintptr_t)1;
+            json_segments_concurrent_destroy_message(message);
+        }
+    }
+    json_segments_stats_add(JSON_SEGMENTS_COUNTER_IN_FLIGHT_UIDS, -(long long)atomic_load(&table->count));
+    free(table);
+    json_segments_concurrent_reclaim();
+}
+
+// Add a segment. Claiming the sequence number in the bitmap decides
+// duplicates; the increment of received_segments that reaches the total
+// decides which thread merges.
+JsonSegmentsError json_segments_concurrent_add(JsonSegmentsConcurrentTable *table, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                               int total_segments, const char *json_segment, size_t json_segment_length) {
+    if (table == NULL || unique_id == NULL || json_segment == NULL || total_segments <= 0 || sequence_number <= 0 ||
+        sequence_number > total_segments || memchr(unique_id, '\0', unique_id_length) != NULL) {
+        json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_INVALID, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_INVALID_SEGMENT, "Error: Invalid segment", NULL);
+    }
+
+    JsonSegmentsConcurrentSegment *segment = malloc(sizeof(*segment) + json_segment_length + 1);
+    JsonSegmentsEpochRecord *record = segment != NULL ? json_segments_epoch_enter() : NULL;
+    if (record == NULL) {
+        free(segment);
+        json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_OUT_OF_MEMORY, 1);
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+    }
+    segment->length = json_segment_length;
+    memcpy(segment->data, json_segment, json_segment_length);
+    segment->data[json_segment_length] = '\0';
+
+    int created;
+    uint64_t hash = json_segments_unique_id_hash(unique_id, unique_id_length);
+    JsonSegmentsConcurrentMessage *message = json_segments_concurrent_lookup(table, record, hash, unique_id, unique_id_length, total_segments, &created);
+    JsonSegmentsError result = JSON_SEGMENTS_OK;
+
+    if (message == NULL) {
+        json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_OUT_OF_MEMORY, 1);
+        result = json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error!", NULL);
+    } else if (message->total_segments != total_segments) {
+        json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_INCONSISTENT, 1);
+        result = json_segments_report_error(JSON_SEGMENTS_ERROR_INCONSISTENT, "Error: Inconsistent total number of segments", message->unique_id);
+    } else {
+        size_t index = (size_t)sequence_number - 1;
+        unsigned long bit = 1UL << (index % JSON_SEGMENTS_BITMAP_BITS);
+        if (atomic_fetch_or(&message->received[index / JSON_SEGMENTS_BITMAP_BITS], bit) & bit) {
+            json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_DUPLICATE, 1);
+            result = JSON_SEGMENTS_ERROR_DUPLICATE;
+        }
+    }
+    if (result != JSON_SEGMENTS_OK) {
+        json_segments_epoch_exit(record);
+        free(segment);
+        return result;
+    }
+
+    atomic_store_explicit(&message->segments[sequence_number - 1], segment, memory_order_relaxed);
+    atomic_fetch_add_explicit(&message->buffered_bytes, json_segment_length, memory_order_relaxed);
+    if (!created) {
+        atomic_store_explicit(&message->last_received_timestamp, json_segments_concurrent_now(), memory_order_relaxed);
+    }
+    json_segments_stats_add(JSON_SEGMENTS_COUNTER_SEGMENTS_ACCEPTED, 1);
+    json_segments_stats_add(JSON_SEGMENTS_COUNTER_BUFFERED_BYTES, (long long)json_segment_length);
+
+    // Release publishes the segment pointer; the completing thread's acquire sees all of them
+    char *text = NULL;
+    size_t text_length = 0;
+    time_t first_received_timestamp = 0;
+    int merging = 0;
+    if (atomic_fetch_add_explicit(&message->received_segments, 1, memory_order_acq_rel) + 1 == total_segments) {
+        int expected = JSON_SEGMENTS_MESSAGE_ACTIVE;
+        if (atomic_compare_exchange_strong(&message->state, &expected, JSON_SEGMENTS_MESSAGE_MERGING)) {
+            merging = 1;
+            first_received_timestamp = atomic_load(&message->first_received_timestamp);
+            text = json_segments_concurrent_assemble(message, &text_length);
+            json_segments_concurrent_remove(table, record, message);
+        }
+    }
+    json_segments_epoch_exit(record);
+
+    if (!merging) {
+        return JSON_SEGMENTS_OK;
+    }
+    if (text == NULL) {
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+    }
+    result = json_segments_concurrent_deliver(table, text, text_length, first_received_timestamp);
+    free(text);
+    return result;
+}
+
+// Adapter passing decoded frames to json_segments_concurrent_add.
+static JsonSegmentsError json_segments_concurrent_add_decoded(void *target, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                                              int total_segments, const char *json_segment, size_t json_segment_length) {
+    return json_segments_concurrent_add((JsonSegmentsConcurrentTable *)target, unique_id, unique_id_length, sequence_number, total_segments,
+                                        json_segment, json_segment_length);
+}
+
+// Parse a serialized segment frame into the table.
+JsonSegmentsError json_segments_concurrent_parse_raw(JsonSegmentsConcurrentTable *table, const char *frame, size_t length) {
+    return json_segments_decode_frame(frame, length, json_segments_concurrent_add_decoded, table);
+}
+
+// Drop a partial message if it is still active.
+JsonSegmentsError json_segments_concurrent_delete_segments(JsonSegmentsConcurrentTable *table, const char *unique_id, size_t unique_id_length) {
+    if (table == NULL || unique_id == NULL) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+
+    JsonSegmentsEpochRecord *record = json_segments_epoch_enter();
+    if (record == NULL) {
+        return json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+    }
+
+    JsonSegmentsConcurrentPosition position;
+    JsonSegmentsError result = JSON_SEGMENTS_ERROR_NOT_FOUND;
+    uint64_t hash = json_segments_unique_id_hash(unique_id, unique_id_length);
+    if (json_segments_concurrent_find(table, record, hash, unique_id, unique_id_length, &position)) {
+        int expected = JSON_SEGMENTS_MESSAGE_ACTIVE;
+        if (atomic_compare_exchange_strong(&position.current->state, &expected, JSON_SEGMENTS_MESSAGE_REMOVED)) {
+            json_segments_concurrent_remove(table, record, position.current);
+            result = JSON_SEGMENTS_OK;
+        }
+    }
+    json_segments_epoch_exit(record);
+    return result;
+}
+
+// Evict the messages that received no segment for more than timeout seconds.
+void json_segments_concurrent_check_timeout(JsonSegmentsConcurrentTable *table, int timeout) {
+    if (table == NULL) {
+        return;
+    }
+
+    JsonSegmentsEpochRecord *record = json_segments_epoch_enter();
+    if (record == NULL) {
+        return;
+    }
+
+    time_t now = json_segments_concurrent_now();
+    for (size_t i = 0; i <= table->bucket_mask; i++) {
+        uintptr_t link = atomic_load(&table->buckets[i]);
+        // A removed tail's next is the bare mark, so test the pointer part
+        while ((link & ~(uintptr_t)1) != 0) {
+            JsonSegmentsConcurrentMessage *message = (JsonSegmentsConcurrentMessage *)(link & ~(uintptr_t)1);
+            link = atomic_load(&message->next);
+            if (link & 1) {
+                continue;
+            }
+            if (difftime(now, atomic_load(&message->last_received_timestamp)) > timeout) {
+                int expected = JSON_SEGMENTS_MESSAGE_ACTIVE;
+                if (atomic_compare_exchange_strong(&message->state, &expected, JSON_SEGMENTS_MESSAGE_REMOVED)) {
+                    json_segments_stats_add(JSON_SEGMENTS_COUNTER_MESSAGES_TIMED_OUT, 1);
+                    json_segments_concurrent_remove(table, record, message);
+                }
+            }
+        }
+    }
+    json_segments_epoch_exit(record);
+}
+
+// Visit every active message. Removed messages stay readable until the walk
+// ends, so the walk never blocks or is blocked by ingest.
+void json_segments_concurrent_for_each(JsonSegmentsConcurrentTable *table, JsonSegmentsConcurrentVisitor visitor, void *user_data) {
+    if (table == NULL || visitor == NULL) {
+        return;
+    }
+
+    JsonSegmentsEpochRecord *record = json_segments_epoch_enter();
+    if (record == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i <= table->bucket_mask; i++) {
+        uintptr_t link = atomic_load(&table->buckets[i]);
+        while ((link & ~(uintptr_t)1) != 0) {
+            JsonSegmentsConcurrentMessage *message = (JsonSegmentsConcurrentMessage *)(link & ~(uintptr_t)1);
+            link = atomic_load(&message->next);
+            if ((link & 1) || atomic_load(&message->state) != JSON_SEGMENTS_MESSAGE_ACTIVE) {
+                continue;
+            }
+
+            JsonSegmentsConcurrentEntry entry;
+            entry.unique_id = message->unique_id;
+            entry.unique_id_length = message->unique_id_length;
+            entry.received_segments = atomic_load_explicit(&message->received_segments, memory_order_relaxed);
+            entry.total_segments = message->total_segments;
+            entry.first_received_timestamp = atomic_load_explicit(&message->first_received_timestamp, memory_order_relaxed);
+            entry.last_received_timestamp = atomic_load_explicit(&message->last_received_timestamp, memory_order_relaxed);
+            entry.buffered_bytes = atomic_load_explicit(&message->buffered_bytes, memory_order_relaxed);
+            visitor(&entry, user_data);
+        }
+    }
+    json_segments_epoch_exit(record);
+}
+
+size_t json_segments_concurrent_count(const JsonSegmentsConcurrentTable *table) {
+    return table != NULL ? atomic_load(&((JsonSegmentsConcurrentTable *)table)->count) : 0;
+}
@@ -0,0 +1,144 @@
+// json_segments_concurrent.h
+
+/**
+ * @file json_segments_concurrent.h
+ * @brief Lock-free reassembly table that many threads can feed at once.
+ *
+ * The table is a fixed array of buckets, each a sorted lock-free linked list (Harris-Michael):
+ * a new uid claims its place with a single compare-and-swap, and removal first marks the entry
+ * and then unlinks it. Every message has an atomic bitmap of received sequence numbers, so
+ * threads adding different segments of the same uid never wait for each other, duplicates are
+ * detected with one fetch-or, and exactly one thread (the one adding the last segment) merges
+ * the message. Removed entries are freed by epoch-based reclamation once no thread can still
+ * be reading them, so monitoring threads may walk the table while ingest runs.
+ *
+ * Merging and the processing function run outside the table, on the thread that completed the
+ * message. Statistics and diagnostics are shared with the rest of the library.
+ */
+
+#ifndef JSON_SEGMENTS_CONCURRENT_H
+#define JSON_SEGMENTS_CONCURRENT_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Opaque lock-free reassembly table.
+ */
+typedef struct JsonSegmentsConcurrentTable JsonSegmentsConcurrentTable;
+
+/**
+ * @brief Snapshot of one in-flight message, passed to a json_segments_concurrent_for_each() visitor.
+ */
+typedef struct {
+    const char *unique_id;                  ///< Unique identifier, valid only during the visit.
+    size_t unique_id_length;                ///< Length of unique_id in bytes.
+    int received_segments;                  ///< Number of segments received so far.
+    int total_segments;                     ///< Total number of segments expected.
+    time_t first_received_timestamp;        ///< Timestamp of the first received segment.
+    time_t last_received_timestamp;         ///< Timestamp of the last received segment.
+    size_t buffered_bytes;                  ///< Bytes of segment content held for this message.
+} JsonSegmentsConcurrentEntry;
+
+/**
+ * @brief Visitor called for every in-flight message.
+ */
+typedef void (*JsonSegmentsConcurrentVisitor)(const JsonSegmentsConcurrentEntry *entry, void *user_data);
+
+/**
+ * @brief Create an empty table.
+ *
+ * The number of buckets is fixed; choose it near the expected number of in-flight messages.
+ *
+ * @param bucket_count Number of buckets (rounded up to a power of two).
+ * @param processing_function Receives complete messages, or NULL to use current_json_processing_function.
+ * @param user_data Passed to processing_function.
+ * @return New table, or NULL on allocation failure.
+ */
+JsonSegmentsConcurrentTable *json_segments_concurrent_create(size_t bucket_count, JsonSegmentsContextFunction processing_function, void *user_data);
+
+/**
+ * @brief Free a table and all partial messages in it.
+ *
+ * No other thread may use the table during or after the call.
+ *
+ * @param table Table to free.
+ */
+void json_segments_concurrent_free(JsonSegmentsConcurrentTable *table);
+
+/**
+ * @brief Add a JSON segment; safe to call from any number of threads.
+ *
+ * @param table Table receiving the segment.
+ * @param unique_id Unique identifier for the JSON object (not necessarily NUL-terminated, without NUL bytes).
+ * @param unique_id_length Length of unique_id in bytes.
+ * @param sequence_number Sequence number of the segment (1-based).
+ * @param total_segments Total number of segments in the JSON object.
+ * @param json_segment Segment content.
+ * @param json_segment_length Length of json_segment in bytes.
+ * @return JSON_SEGMENTS_OK if the segment was stored (and, if it completed the message, the result of the merge), or the reason it was dropped.
+ */
+JsonSegmentsError json_segments_concurrent_add(JsonSegmentsConcurrentTable *table, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                               int total_segments, const char *json_segment, size_t json_segment_length);
+
+/**
+ * @brief Parse a serialized segment frame into the table; see json_segments_parse_raw().
+ *
+ * @param table Table receiving the segment.
+ * @param frame Received frame (not necessarily NUL-terminated).
+ * @param length Number of bytes in frame.
+ * @return Result of json_segments_concurrent_add(), or the reason the frame was dropped.
+ */
+JsonSegmentsError json_segments_concurrent_parse_raw(JsonSegmentsConcurrentTable *table, const char *frame, size_t length);
+
+/**
+ * @brief Drop a partial message.
+ *
+ * @param table Table holding the message.
+ * @param unique_id Unique identifier for the JSON object.
+ * @param unique_id_length Length of unique_id in bytes.
+ * @return JSON_SEGMENTS_OK, or JSON_SEGMENTS_ERROR_NOT_FOUND if no message with this uid is buffered.
+ */
+JsonSegmentsError json_segments_concurrent_delete_segments(JsonSegmentsConcurrentTable *table, const char *unique_id, size_t unique_id_length);
+
+/**
+ * @brief Evict the partial messages that received no segment for timeout seconds.
+ *
+ * @param table Table to check.
+ * @param timeout Time in seconds to consider a message as timed out.
+ */
+void json_segments_concurrent_check_timeout(JsonSegmentsConcurrentTable *table, int timeout);
+
+/**
+ * @brief Call visitor for every in-flight message, concurrently with ingest.
+ *
+ * Messages added or removed during the walk may or may not be visited. The visitor must not
+ * call back into the table.
+ *
+ * @param table Table to walk.
+ * @param visitor Function called for every message.
+ * @param user_data Passed to visitor.
+ */
+void json_segments_concurrent_for_each(JsonSegmentsConcurrentTable *table, JsonSegmentsConcurrentVisitor visitor, void *user_data);
+
+/**
+ * @brief Number of in-flight messages.
+ */
+size_t json_segments_concurrent_count(const JsonSegmentsConcurrentTable *table);
+
+/**
+ * @brief Free removed entries that no thread can reference any more.
+ *
+ * Reclamation also happens automatically as entries are removed; call this after worker threads
+ * have exited to release what they left behind.
+ */
+void json_segments_concurrent_reclaim(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_CONCURRENT_H
@@ -0,0 +1,306 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(JSON_SEGMENTS_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JSON_SEGMENTS_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSON_SEGMENTS_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define JSON_SEGMENTS_SIMD_NEON 1
+#endif
+#endif
+
+#include "json_segments.h"
+
+// Index of the lowest set bit of a non-zero SIMD comparison mask.
+static inline unsigned json_segments_lowest_bit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned index = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Scalar check for a byte that has to be escaped inside a JSON string
+// (or, with include_control == 0, a byte that ends or escapes a string).
+static inline int json_segments_is_special(unsigned char c, int include_control) {
+    return c == '"' || c == '\\' || (include_control && c < 0x20);
+}
+
+// Find the first quote, backslash or (optionally) control byte in s. This is
+// the hot loop of both escaping and unescaping: plain runs in between are
+// copied with memcpy. Returns length if no such byte exists.
+static size_t json_segments_find_special(const unsigned char *s, size_t length, int include_control) {
+    size_t i = 0;
+
+#if defined(JSON_SEGMENTS_SIMD_AVX2)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash));
+        if (include_control) {
+            // v <= 0x1F exactly when min(v, 0x1F) == v (unsigned compare)
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+        }
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return i + json_segments_lowest_bit(mask);
+        }
+    }
+#elif defined(JSON_SEGMENTS_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+        if (include_control) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        }
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+        if (mask != 0) {
+            return i + json_segments_lowest_bit(mask);
+        }
+    }
+#elif defined(JSON_SEGMENTS_SIMD_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control = vdupq_n_u8(0x20);
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(s + i);
+        uint8x16_t m = vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash));
+        if (include_control) {
+            m = vorrq_u8(m, vcltq_u8(v, control));
+        }
+        uint64x2_t wide = vreinterpretq_u64_u8(m);
+        if ((vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0) {
+            // NEON has no movemask; the hit is inside this block, finish it bytewise
+            break;
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (json_segments_is_special(s[i], include_control)) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// Number of output bytes needed for a single special byte.
+static inline size_t json_segments_escape_width(unsigned char c) {
+    switch (c) {
+        case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+            return 2;
+        default:
+            return 6; // \u00XX
+    }
+}
+
+// Write the escape sequence for a single special byte, using the same short
+// forms and lowercase \u00XX notation as cJSON so frames are byte-identical.
+static inline size_t json_segments_escape_byte(char *out, unsigned char c) {
+    static const char hex[] = "0123456789abcdef";
+
+    out[0] = '\\';
+    switch (c) {
+        case '"':  out[1] = '"';  return 2;
+        case '\\': out[1] = '\\'; return 2;
+        case '\b': out[1] = 'b';  return 2;
+        case '\f': out[1] = 'f';  return 2;
+        case '\n': out[1] = 'n';  return 2;
+        case '\r': out[1] = 'r';  return 2;
+        case '\t': out[1] = 't';  return 2;
+        default:
+            out[1] = 'u';
+            out[2] = '0';
+            out[3] = '0';
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 0x0F];
+            return 6;
+    }
+}
+
+// Compute the escaped length of a JSON string body. Only the special bytes
+// are visited individually, everything else is skipped a vector at a time.
+size_t json_segments_escaped_length(const char *src, size_t length) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t total = length;
+    size_t i = 0;
+
+    while ((i += json_segments_find_special(s + i, length - i, 1)) < length) {
+        total += json_segments_escape_width(s[i]) - 1;
+        i++;
+    }
+
+    return total;
+}
+
+// Escape a JSON string body into dst. Plain runs are copied with memcpy,
+// special bytes are expanded to their escape sequences.
+size_t json_segments_escape(char *dst, const char *src, size_t length) {
+    const unsigned char *s = (const unsigned char *)src;
+    char *out = dst;
+    size_t i = 0;
+
+    while (i < length) {
+        size_t run = json_segments_find_special(s + i, length - i, 1);
+        memcpy(out, src + i, run);
+        out += run;
+        i += run;
+        if (i == length) {
+            break;
+        }
+        out += json_segments_escape_byte(out, s[i]);
+        i++;
+    }
+
+    return (size_t)(out - dst);
+}
+
+// Decode four hex digits of a \u escape. Returns 0 on malformed input.
+static int json_segments_parse_hex4(const char *p, unsigned *value) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= (unsigned)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            v |= (unsigned)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            v |= (unsigned)(c - 'A' + 10);
+        } else {
+            return 0;
+        }
+    }
+    *value = v;
+    return 1;
+}
+
+// Encode a code point as UTF-8. Returns the number of bytes written.
+static size_t json_segments_put_utf8(char *out, unsigned cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Unescape a JSON string body into dst. The output is never longer than the
+// input, so dst may equal src for in-place decoding. Plain runs between
+// backslashes are moved in bulk; \u escapes (including surrogate pairs) are
+// decoded to UTF-8 the same way cJSON does.
+size_t json_segments_unescape(char *dst, const char *src, size_t length) {
+    const unsigned char *s = (const unsigned char *)src;
+    char *out = dst;
+    size_t i = 0;
+
+    while (i < length) {
+        size_t run = json_segments_find_special(s + i, length - i, 0);
+        if (out != src + i) {
+            memmove(out, src + i, run);
+        }
+        out += run;
+        i += run;
+        if (i == length) {
+            break;
+        }
+        if (s[i] == '"') {
+            // A bare quote cannot occur in a well-formed body; keep it verbatim
+            *out++ = '"';
+            i++;
+            continue;
+        }
+        if (i + 1 >= length) {
+            return (size_t)-1;
+        }
+
+        switch (src[i + 1]) {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (i + 6 > length || !json_segments_parse_hex4(src + i + 2, &cp)) {
+                    return (size_t)-1;
+                }
+                if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    return (size_t)-1; // lone low surrogate
+                }
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    unsigned low;
+                    if (i + 12 > length || src[i + 6] != '\\' || src[i + 7] != 'u' ||
+                        !json_segments_parse_hex4(src + i + 8, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return (size_t)-1;
+                    }
+                    cp = 0x10000 + (((cp & 0x3FF) << 10) | (low & 0x3FF));
+                    i += 6;
+                }
+                out += json_segments_put_utf8(out, cp);
+                i += 6;
+                continue;
+            }
+            default:
+                return (size_t)-1;
+        }
+        i += 2;
+    }
+
+    return (size_t)(out - dst);
+}
+
+// Find the end of a JSON string body starting right after its opening quote.
+// Returns the offset of the closing quote, or length if it is missing.
+// *has_escapes is set when the body contains at least one backslash.
+size_t json_segments_string_end(const char *src, size_t length, int *has_escapes) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t i = 0;
+
+    *has_escapes = 0;
+    while ((i += json_segments_find_special(s + i, length - i, 0)) < length) {
+        if (s[i] == '"') {
+            return i;
+        }
+        *has_escapes = 1;
+        i += 2; // skip the escaped character
+        if (i > length) {
+            break;
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,335 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "json_segments_journal.h"
+
+#define JSON_SEGMENTS_JOURNAL_MAGIC "JSEGJ001"
+#define JSON_SEGMENTS_JOURNAL_MAGIC_LENGTH 8
+// crc32 and length of the body, then the body's fixed part: type, sequence
+// number, total, uid length and segment length. The uid and segment follow.
+#define JSON_SEGMENTS_JOURNAL_HEADER_LENGTH 8
+#define JSON_SEGMENTS_JOURNAL_FIXED_LENGTH 17
+
+struct JsonSegmentsJournal {
+    int fd;
+    char *path;
+    int sync;                               // fdatasync after every record
+    int replaying;                          // Set by recover, so replayed changes are not appended again
+    int failed;                             // A write failed; nothing is appended until the next compaction
+    uint32_t crc_table[256];
+};
+
+// Fill the table of the reflected CRC-32 polynomial used by zlib and Ethernet.
+static void json_segments_journal_crc_init(uint32_t *table) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+}
+
+// Continue a CRC-32 over more data; start with 0.
+static uint32_t json_segments_journal_crc(const uint32_t *table, uint32_t crc, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void json_segments_journal_put32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t json_segments_journal_get32(const unsigned char *in) {
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// Read exactly length bytes at offset; -1 on an error or the end of the file.
+static int json_segments_journal_read(int fd, void *data, size_t length, off_t offset) {
+    char *out = data;
+
+    while (length > 0) {
+        ssize_t read_length = pread(fd, out, length, offset);
+        if (read_length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_length <= 0) {
+            return -1;
+        }
+        out += read_length;
+        length -= (size_t)read_length;
+        offset += read_length;
+    }
+    return 0;
+}
+
+// Write the magic to an empty journal file.
+static int json_segments_journal_write_magic(int fd) {
+    struct iovec magic = { (void *)JSON_SEGMENTS_JOURNAL_MAGIC, JSON_SEGMENTS_JOURNAL_MAGIC_LENGTH };
+    return json_segments_writev(fd, &magic, 1);
+}
+
+// Open a journal file for appending and check or write its magic.
+static int json_segments_journal_open_file(const char *path, int flags) {
+    struct stat st;
+    char magic[JSON_SEGMENTS_JOURNAL_MAGIC_LENGTH];
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | flags, 0600);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        if (json_segments_journal_write_magic(fd) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else if (json_segments_journal_read(fd, magic, sizeof(magic), 0) != 0 ||
+               memcmp(magic, JSON_SEGMENTS_JOURNAL_MAGIC, JSON_SEGMENTS_JOURNAL_MAGIC_LENGTH) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Open or create a journal.
+JsonSegmentsJournal *json_segments_journal_open(const char *path, int sync) {
+    if (path == NULL) {
+        return NULL;
+    }
+
+    JsonSegmentsJournal *journal = malloc(sizeof(JsonSegmentsJournal));
+    if (journal == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        return NULL;
+    }
+    journal->path = strdup(path);
+    if (journal->path == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        free(journal);
+        return NULL;
+    }
+    journal->fd = json_segments_journal_open_file(path, 0);
+    if (journal->fd < 0) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Journal kann nicht geöffnet werden", NULL);
+        free(journal->path);
+        free(journal);
+        return NULL;
+    }
+    journal->sync = sync;
+    journal->replaying = 0;
+    journal->failed = 0;
+    json_segments_journal_crc_init(journal->crc_table);
+    return journal;
+}
+
+// Close a journal and keep its file.
+void json_segments_journal_close(JsonSegmentsJournal *journal) {
+    if (journal == NULL) {
+        return;
+    }
+    close(journal->fd);
+    free(journal->path);
+    free(journal);
+}
+
+// Append one record with a single writev, so it is either whole or torn at
+// the end of the file.
+void json_segments_journal_persist(JsonSegmentsPersistEvent event, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                   int total_segments, const char *json_segment, size_t json_segment_length, void *journal_context) {
+    JsonSegmentsJournal *journal = journal_context;
+    unsigned char header[JSON_SEGMENTS_JOURNAL_HEADER_LENGTH + JSON_SEGMENTS_JOURNAL_FIXED_LENGTH];
+    unsigned char *fixed = header + JSON_SEGMENTS_JOURNAL_HEADER_LENGTH;
+
+    if (journal == NULL || journal->replaying || journal->failed) {
+        return;
+    }
+    if (event != JSON_SEGMENTS_PERSIST_SEGMENT) {
+        json_segment = NULL;
+        json_segment_length = 0;
+        sequence_number = 0;
+        total_segments = 0;
+    }
+    if (unique_id_length > UINT32_MAX - JSON_SEGMENTS_JOURNAL_FIXED_LENGTH ||
+        json_segment_length > UINT32_MAX - JSON_SEGMENTS_JOURNAL_FIXED_LENGTH - unique_id_length) {
+        journal->failed = 1;
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Journal-Eintrag zu groß", unique_id);
+        return;
+    }
+
+    size_t body_length = JSON_SEGMENTS_JOURNAL_FIXED_LENGTH + unique_id_length + json_segment_length;
+    fixed[0] = (unsigned char)event;
+    json_segments_journal_put32(fixed + 1, (uint32_t)sequence_number);
+    json_segments_journal_put32(fixed + 5, (uint32_t)total_segments);
+    json_segments_journal_put32(fixed + 9, (uint32_t)unique_id_length);
+    json_segments_journal_put32(fixed + 13, (uint32_t)json_segment_length);
+
+    uint32_t crc = json_segments_journal_crc(journal->crc_table, 0, fixed, JSON_SEGMENTS_JOURNAL_FIXED_LENGTH);
+    crc = json_segments_journal_crc(journal->crc_table, crc, unique_id, unique_id_length);
+    crc = json_segments_journal_crc(journal->crc_table, crc, json_segment, json_segment_length);
+    json_segments_journal_put32(header, crc);
+    json_segments_journal_put32(header + 4, (uint32_t)body_length);
+
+    struct iovec record[3] = {
+        { header, sizeof(header) },
+        { (void *)unique_id, unique_id_length },
+        { (void *)json_segment, json_segment_length },
+    };
+    if (json_segments_writev(journal->fd, record, json_segment_length > 0 ? 3 : 2) != 0 ||
+        (journal->sync && fdatasync(journal->fd) != 0)) {
+        journal->failed = 1;
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Fehler beim Schreiben des Journals", unique_id);
+    }
+}
+
+// Replay the records into a context until the end of the file or the first
+// record that is torn or fails its checksum, and cut the file off there.
+int json_segments_journal_recover(JsonSegmentsJournal *journal, JsonSegmentsContext *context) {
+    struct stat st;
+    unsigned char header[JSON_SEGMENTS_JOURNAL_HEADER_LENGTH];
+    unsigned char *body = NULL;
+    size_t body_capacity = 0;
+    off_t offset = JSON_SEGMENTS_JOURNAL_MAGIC_LENGTH;
+
+    if (journal == NULL || context == NULL || fstat(journal->fd, &st) != 0) {
+        return -1;
+    }
+
+    journal->replaying = 1;
+    while (offset + JSON_SEGMENTS_JOURNAL_HEADER_LENGTH <= st.st_size) {
+        if (json_segments_journal_read(journal->fd, header, sizeof(header), offset) != 0) {
+            break;
+        }
+        uint32_t crc = json_segments_journal_get32(header);
+        size_t body_length = json_segments_journal_get32(header + 4);
+        if (body_length < JSON_SEGMENTS_JOURNAL_FIXED_LENGTH || (off_t)body_length > st.st_size - offset - JSON_SEGMENTS_JOURNAL_HEADER_LENGTH) {
+            break;
+        }
+        if (body_length > body_capacity) {
+            unsigned char *grown = realloc(body, body_length);
+            if (grown == NULL) {
+                json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+                free(body);
+                journal->replaying = 0;
+                return -1;
+            }
+            body = grown;
+            body_capacity = body_length;
+        }
+        if (json_segments_journal_read(journal->fd, body, body_length, offset + JSON_SEGMENTS_JOURNAL_HEADER_LENGTH) != 0 ||
+            json_segments_journal_crc(journal->crc_table, 0, body, body_length) != crc) {
+            break;
+        }
+
+        size_t unique_id_length = json_segments_journal_get32(body + 9);
+        size_t json_segment_length = json_segments_journal_get32(body + 13);
+        if (unique_id_length > body_length - JSON_SEGMENTS_JOURNAL_FIXED_LENGTH ||
+            json_segment_length != body_length - JSON_SEGMENTS_JOURNAL_FIXED_LENGTH - unique_id_length) {
+            break;
+        }
+        const char *unique_id = (const char *)body + JSON_SEGMENTS_JOURNAL_FIXED_LENGTH;
+        if (body[0] == JSON_SEGMENTS_PERSIST_SEGMENT) {
+            json_segments_context_add(context, unique_id, unique_id_length, (int)json_segments_journal_get32(body + 1),
+                                      (int)json_segments_journal_get32(body + 5), unique_id + unique_id_length, json_segment_length);
+        } else if (body[0] == JSON_SEGMENTS_PERSIST_REMOVE) {
+            json_segments_context_delete_segments(context, unique_id, unique_id_length);
+        } else {
+            break;
+        }
+        offset += JSON_SEGMENTS_JOURNAL_HEADER_LENGTH + (off_t)body_length;
+    }
+    journal->replaying = 0;
+    free(body);
+
+    // Records appended after a torn one would never be replayed
+    if (offset < st.st_size && ftruncate(journal->fd, offset) != 0) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Journal kann nicht gekürzt werden", NULL);
+        return -1;
+    }
+    return context->segments_count;
+}
+
+// Flush the directory holding path, so a rename in it is durable. Some file
+// systems refuse fsync on directories; the rename has happened either way.
+static void json_segments_journal_sync_directory(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *directory = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : (size_t)(slash - path));
+
+    if (directory == NULL) {
+        return;
+    }
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(directory);
+}
+
+// Write the live table to a temporary file and rename it over the journal.
+int json_segments_journal_compact(JsonSegmentsJournal *journal, const JsonSegmentsContext *context) {
+    if (journal == NULL || context == NULL) {
+        return -1;
+    }
+
+    size_t path_length = strlen(journal->path);
+    char *temporary_path = malloc(path_length + sizeof(".tmp"));
+    if (temporary_path == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        return -1;
+    }
+    memcpy(temporary_path, journal->path, path_length);
+    memcpy(temporary_path + path_length, ".tmp", sizeof(".tmp"));
+
+    int fd = json_segments_journal_open_file(temporary_path, O_TRUNC);
+    if (fd < 0) {
+        free(temporary_path);
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Journal kann nicht geöffnet werden", NULL);
+        return -1;
+    }
+
+    // Export through the persist function into the new file, flushed once at the end
+    JsonSegmentsJournal snapshot = *journal;
+    snapshot.fd = fd;
+    snapshot.sync = 0;
+    snapshot.replaying = 0;
+    snapshot.failed = 0;
+    if (json_segments_context_export(context, json_segments_journal_persist, &snapshot) != 0 || snapshot.failed || fsync(fd) != 0 ||
+        rename(temporary_path, journal->path) != 0) {
+        close(fd);
+        unlink(temporary_path);
+        free(temporary_path);
+        json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Fehler beim Kompaktieren des Journals", NULL);
+        return -1;
+    }
+    json_segments_journal_sync_directory(journal->path);
+    free(temporary_path);
+
+    close(journal->fd);
+    journal->fd = fd;
+    journal->failed = 0;
+    return 0;
+}
+
+// Whether a write failed since the journal was opened or last compacted.
+int json_segments_journal_failed(const JsonSegmentsJournal *journal) {
+    return journal != NULL && journal->failed;
+}
@@ -0,0 +1,103 @@
+// json_segments_journal.h
+
+/**
+ * @file json_segments_journal.h
+ * @brief Append-only journal of a context's partial messages, for recovery after a restart.
+ *
+ * The journal is a persistence function: every segment stored for an incomplete message and
+ * every removal of a message is appended to a file as a checksummed record. After a crash or
+ * restart, json_segments_journal_recover() replays the records into a fresh context, so the
+ * sender only has to resend what json_segments_context_missing() reports instead of every
+ * message in flight. A record torn by the crash ends the replay and is cut off.
+ *
+ * A message is removed from the journal before its processing function runs, so a crash during
+ * the callback loses that message rather than delivering it twice. Records of completed messages
+ * stay in the file until json_segments_journal_compact() rewrites it from the live table.
+ * Single-frame messages are delivered without entering the table, so they are not journaled, and
+ * a retransmitted copy of one is delivered again.
+ *
+ * @code
+ * JsonSegmentsJournal *journal = json_segments_journal_open("/var/lib/receiver/journal", 0);
+ * json_segments_context_set_persist(&context, json_segments_journal_persist, journal);
+ * json_segments_journal_recover(journal, &context);
+ * // ... ingest, and compact now and then ...
+ * json_segments_journal_compact(journal, &context);
+ * @endcode
+ */
+
+#ifndef JSON_SEGMENTS_JOURNAL_H
+#define JSON_SEGMENTS_JOURNAL_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Opaque journal file.
+ */
+typedef struct JsonSegmentsJournal JsonSegmentsJournal;
+
+/**
+ * @brief Open or create a journal.
+ *
+ * @param path Path of the journal file; compaction also uses path with ".tmp" appended.
+ * @param sync Nonzero to flush every record to disk before returning, so an acknowledged
+ *             segment survives a power failure. Zero only survives a crash of the process.
+ * @return New journal, or NULL if the file could not be opened or is not a journal.
+ */
+JsonSegmentsJournal *json_segments_journal_open(const char *path, int sync);
+
+/**
+ * @brief Close a journal. The file is kept for the next start.
+ *
+ * @param journal Journal to close.
+ */
+void json_segments_journal_close(JsonSegmentsJournal *journal);
+
+/**
+ * @brief Append a record; matches JsonSegmentsPersistFunction.
+ *
+ * After a failed write the journal stops appending, because the replay would end at the
+ * damaged record anyway; json_segments_journal_compact() starts a new file.
+ *
+ * @param journal The JsonSegmentsJournal, passed as the persist context.
+ */
+void json_segments_journal_persist(JsonSegmentsPersistEvent event, const char *unique_id, size_t unique_id_length, int sequence_number,
+                                   int total_segments, const char *json_segment, size_t json_segment_length, void *journal);
+
+/**
+ * @brief Replay the journal into a context.
+ *
+ * The context may already be recording to this journal; the replayed changes are not appended
+ * again. Records after the first torn or corrupt one are discarded and the file is truncated there.
+ *
+ * @param journal Journal to replay.
+ * @param context Context receiving the partial messages.
+ * @return Number of partial messages in the context afterwards, or -1 if the file could not be read.
+ */
+int json_segments_journal_recover(JsonSegmentsJournal *journal, JsonSegmentsContext *context);
+
+/**
+ * @brief Replace the journal with a snapshot of the context's partial messages.
+ *
+ * The snapshot is written to a temporary file, flushed and renamed over the journal, so a crash
+ * leaves either the old or the new file.
+ *
+ * @param journal Journal to rewrite.
+ * @param context Context whose table is written.
+ * @return 0, or -1 if the snapshot could not be written; the old journal is then kept.
+ */
+int json_segments_journal_compact(JsonSegmentsJournal *journal, const JsonSegmentsContext *context);
+
+/**
+ * @brief Whether a write failed since the journal was opened or last compacted.
+ */
+int json_segments_journal_failed(const JsonSegmentsJournal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_JOURNAL_H
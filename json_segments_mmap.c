@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_segments_mmap.h"
+
+// Map a whole regular file read-only and compute its segment layout. The
+// mapping stays valid after the descriptor is closed.
+int json_segments_mmap_open_fd(JsonSegmentsMapping *mapping, int fd, const char *uid, int max_length) {
+    struct stat st;
+
+    if (mapping == NULL || uid == NULL) {
+        return -1;
+    }
+
+    memset(mapping, 0, sizeof(*mapping));
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uintmax_t)st.st_size > SIZE_MAX) {
+        return -1;
+    }
+
+    size_t length = (size_t)st.st_size;
+    if (json_segments_layout(uid, length, max_length, &mapping->segment_length, &mapping->total_segments) != 0) {
+        return -1;
+    }
+
+    mapping->unique_id = strdup(uid);
+    if (mapping->unique_id == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", uid);
+        return -1;
+    }
+    json_segments_envelope_init(&mapping->envelope, mapping->unique_id, mapping->total_segments);
+
+    // mmap rejects zero-length mappings; an empty file simply has no segments
+    if (length > 0) {
+        void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            free(mapping->unique_id);
+            mapping->unique_id = NULL;
+            return -1;
+        }
+        // Frames are usually produced front to back
+        madvise(data, length, MADV_SEQUENTIAL);
+        mapping->data = data;
+        mapping->length = length;
+    }
+
+    return 0;
+}
+
+// Open and map a file by path.
+int json_segments_mmap_open(JsonSegmentsMapping *mapping, const char *path, const char *uid, int max_length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int result = json_segments_mmap_open_fd(mapping, fd, uid, max_length);
+    close(fd);
+    return result;
+}
+
+// Compute the (offset, length) view of a segment. Every segment except the
+// last one carries exactly segment_length bytes.
+int json_segments_mmap_segment(const JsonSegmentsMapping *mapping, int sequence_number, size_t *offset, size_t *length) {
+    if (mapping == NULL || sequence_number < 1 || sequence_number > mapping->total_segments) {
+        return -1;
+    }
+
+    size_t start = (size_t)(sequence_number - 1) * mapping->segment_length;
+    size_t remaining = mapping->length - start;
+
+    *offset = start;
+    *length = remaining < mapping->segment_length ? remaining : mapping->segment_length;
+    return 0;
+}
+
+// Escape a segment directly from the mapping into the frame buffer; the
+// payload is never copied anywhere else.
+int json_segments_mmap_write_frame(const JsonSegmentsMapping *mapping, int sequence_number, char *frame, size_t frame_size) {
+    size_t offset;
+    size_t length;
+
+    if (json_segments_mmap_segment(mapping, sequence_number, &offset, &length) != 0) {
+        return -1;
+    }
+
+    return json_segments_envelope_write(&mapping->envelope, frame, frame_size, sequence_number, mapping->data + offset, length);
+}
+
+// Tell the kernel the pages backing a range of segments are no longer
+// needed. Only whole pages inside the range are released.
+void json_segments_mmap_release(const JsonSegmentsMapping *mapping, int first_sequence_number, int last_sequence_number) {
+    size_t first_offset;
+    size_t last_offset;
+    size_t last_length;
+
+    if (mapping == NULL || mapping->data == NULL ||
+        json_segments_mmap_segment(mapping, first_sequence_number, &first_offset, &last_length) != 0 ||
+        json_segments_mmap_segment(mapping, last_sequence_number, &last_offset, &last_length) != 0 ||
+        last_offset < first_offset) {
+        return;
+    }
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (first_offset + page_size - 1) / page_size * page_size;
+    size_t end = last_offset + last_length;
+    if (end != mapping->length) {
+        end = end / page_size * page_size;
+    }
+
+    if (end > start) {
+        madvise((void *)(mapping->data + start), end - start, MADV_DONTNEED);
+    }
+}
+
+// Unmap the payload and free the uid copy.
+void json_segments_mmap_close(JsonSegmentsMapping *mapping) {
+    if (mapping == NULL) {
+        return;
+    }
+
+    if (mapping->data != NULL) {
+        munmap((void *)mapping->data, mapping->length);
+    }
+    free(mapping->unique_id);
+    memset(mapping, 0, sizeof(*mapping));
+}
@@ -0,0 +1,103 @@
+// json_segments_mmap.h
+
+/**
+ * @file json_segments_mmap.h
+ * @brief Zero-copy splitting of payloads stored in files.
+ *
+ * The file is memory-mapped read-only and each segment is described by an (offset, length)
+ * pair into the mapping. Frames are escaped directly from the mapping into the caller's
+ * transmit buffer, so splitting does not copy the payload to the heap at all.
+ */
+
+#ifndef JSON_SEGMENTS_MMAP_H
+#define JSON_SEGMENTS_MMAP_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A memory-mapped payload and its segment layout. All fields are read-only for the caller.
+ */
+typedef struct {
+    const char *data;                       ///< Start of the mapped payload (NULL for empty files).
+    size_t length;                          ///< Length of the payload in bytes.
+    char *unique_id;                        ///< Unique identifier of the JSON object.
+    size_t segment_length;                  ///< Payload bytes per segment (the last one may be shorter).
+    int total_segments;                     ///< Total number of segments of the payload.
+    JsonSegmentsEnvelope envelope;          ///< Precomputed frame header.
+} JsonSegmentsMapping;
+
+/**
+ * @brief Map a file and compute its segment layout.
+ *
+ * @param mapping Mapping to initialize.
+ * @param path Path of the file containing the payload.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each frame.
+ * @return 0 on success, -1 on error.
+ */
+int json_segments_mmap_open(JsonSegmentsMapping *mapping, const char *path, const char *uid, int max_length);
+
+/**
+ * @brief Map an open file descriptor and compute its segment layout.
+ *
+ * @param mapping Mapping to initialize.
+ * @param fd Descriptor of a regular file. It may be closed after this call returns.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each frame.
+ * @return 0 on success, -1 on error.
+ */
+int json_segments_mmap_open_fd(JsonSegmentsMapping *mapping, int fd, const char *uid, int max_length);
+
+/**
+ * @brief Locate a segment inside the mapping.
+ *
+ * @param mapping Open mapping.
+ * @param sequence_number Sequence number of the segment (1-based).
+ * @param offset Set to the offset of the segment's payload in the mapping.
+ * @param length Set to the number of payload bytes of the segment.
+ * @return 0 on success, -1 if the sequence number is out of range.
+ */
+int json_segments_mmap_segment(const JsonSegmentsMapping *mapping, int sequence_number, size_t *offset, size_t *length);
+
+/**
+ * @brief Serialize a segment straight from the mapping into a frame buffer.
+ *
+ * A buffer of json_segments_frame_capacity(uid, mapping->segment_length, mapping->total_segments)
+ * bytes is always large enough. Segments may be written in any order, e.g. for retransmits.
+ *
+ * @param mapping Open mapping.
+ * @param sequence_number Sequence number of the segment (1-based).
+ * @param frame Output buffer for the NUL-terminated frame.
+ * @param frame_size Size of the output buffer in bytes.
+ * @return Length of the frame, or -1 if the sequence number is out of range or the buffer is too small.
+ */
+int json_segments_mmap_write_frame(const JsonSegmentsMapping *mapping, int sequence_number, char *frame, size_t frame_size);
+
+/**
+ * @brief Drop the pages of already transmitted segments from the resident set.
+ *
+ * The pages are clean file pages, so they are simply re-read from disk if a segment in the
+ * range is written again later.
+ *
+ * @param mapping Open mapping.
+ * @param first_sequence_number First segment of the range (1-based).
+ * @param last_sequence_number Last segment of the range (inclusive).
+ */
+void json_segments_mmap_release(const JsonSegmentsMapping *mapping, int first_sequence_number, int last_sequence_number);
+
+/**
+ * @brief Unmap the payload and free the mapping's resources.
+ *
+ * @param mapping Mapping to close.
+ */
+void json_segments_mmap_close(JsonSegmentsMapping *mapping);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_MMAP_H
@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_segments_parallel.h"
+
+// A contiguous range of segments processed by one task. Tasks only read the
+// shared source and write their own output slots, so they need no locking.
+typedef struct {
+    const char *source;
+    size_t source_length;
+    const char *unique_id;
+    size_t segment_length;
+    int total_segments;
+    int first_segment;      // 0-based, inclusive
+    int last_segment;       // 0-based, exclusive
+    cJSON **segments;       // cJSON output, or NULL
+    char *frames;           // serialized output, or NULL
+    size_t frame_stride;
+    int *frame_lengths;
+    JsonSegmentsEnvelope envelope;
+    int failed;
+} JsonSegmentsRange;
+
+// Build the cJSON objects of one range. The segment content is copied into a
+// per-task scratch buffer instead of strndup'ing every chunk.
+static void json_segments_split_range(void *argument) {
+    JsonSegmentsRange *range = argument;
+    char *scratch = malloc(range->segment_length + 1);
+
+    if (scratch == NULL) {
+        range->failed = 1;
+        return;
+    }
+
+    for (int i = range->first_segment; i < range->last_segment; i++) {
+        size_t start = (size_t)i * range->segment_length;
+        size_t length = range->source_length - start;
+        if (length > range->segment_length) {
+            length = range->segment_length;
+        }
+
+        memcpy(scratch, range->source + start, length);
+        scratch[length] = '\0';
+        json_segments_create_single(&range->segments[i], (char *)range->unique_id, i + 1, range->total_segments, scratch);
+        if (range->segments[i] == NULL) {
+            range->failed = 1;
+        }
+    }
+
+    free(scratch);
+}
+
+// Serialize the frames of one range directly into their output slots.
+static void json_segments_write_range(void *argument) {
+    JsonSegmentsRange *range = argument;
+
+    for (int i = range->first_segment; i < range->last_segment; i++) {
+        size_t start = (size_t)i * range->segment_length;
+        size_t length = range->source_length - start;
+        if (length > range->segment_length) {
+            length = range->segment_length;
+        }
+
+        range->frame_lengths[i] = json_segments_envelope_write(&range->envelope, range->frames + (size_t)i * range->frame_stride,
+                                                               range->frame_stride, i + 1, range->source + start, length);
+        if (range->frame_lengths[i] < 0) {
+            range->failed = 1;
+        }
+    }
+}
+
+typedef struct {
+    JsonSegmentsTaskFunction task;
+    void *argument;
+} JsonSegmentsThreadStart;
+
+static void *json_segments_thread_main(void *argument) {
+    JsonSegmentsThreadStart *start = argument;
+    start->task(start->argument);
+    return NULL;
+}
+
+// Default executor: one POSIX thread per task, with the last task run on the
+// calling thread. Tasks whose thread cannot be created also run inline.
+static void json_segments_thread_executor(JsonSegmentsTaskFunction task, void **arguments, int count, void *executor_context) {
+    pthread_t *threads = malloc(sizeof(pthread_t) * (size_t)count);
+    JsonSegmentsThreadStart *starts = malloc(sizeof(JsonSegmentsThreadStart) * (size_t)count);
+    int *started = calloc((size_t)count, sizeof(int));
+    (void)executor_context;
+
+    if (threads == NULL || starts == NULL || started == NULL) {
+        for (int i = 0; i < count; i++) {
+            task(arguments[i]);
+        }
+    } else {
+        for (int i = 0; i < count - 1; i++) {
+            starts[i].task = task;
+            starts[i].argument = arguments[i];
+            started[i] = pthread_create(&threads[i], NULL, json_segments_thread_main, &starts[i]) == 0;
+            if (!started[i]) {
+                task(arguments[i]);
+            }
+        }
+        task(arguments[count - 1]);
+        for (int i = 0; i < count - 1; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+
+    free(started);
+    free(starts);
+    free(threads);
+}
+
+// Partition the segments into at most thread_count contiguous ranges of
+// nearly equal size and run them on the executor. Returns the number of
+// ranges that failed, or -1 if the ranges could not be set up.
+static int json_segments_run_ranges(const JsonSegmentsRange *prototype, int thread_count, JsonSegmentsTaskFunction task,
+                                    JsonSegmentsExecutor executor, void *executor_context) {
+    int total = prototype->total_segments;
+    int count = thread_count < 1 ? 1 : thread_count;
+    if (count > total) {
+        count = total;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    JsonSegmentsRange *ranges = malloc(sizeof(JsonSegmentsRange) * (size_t)count);
+    void **arguments = malloc(sizeof(void *) * (size_t)count);
+    if (ranges == NULL || arguments == NULL) {
+        free(ranges);
+        free(arguments);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ranges[i] = *prototype;
+        ranges[i].first_segment = (int)((long long)total * i / count);
+        ranges[i].last_segment = (int)((long long)total * (i + 1) / count);
+        arguments[i] = &ranges[i];
+    }
+
+    if (executor == NULL) {
+        executor = json_segments_thread_executor;
+    }
+    executor(task, arguments, count, executor_context);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        failed += ranges[i].failed;
+    }
+
+    free(arguments);
+    free(ranges);
+    return failed;
+}
+
+// Split a string into JSON segments on several threads. The result has the
+// same shape as json_segments_split_string's.
+cJSON **json_segments_split_string_parallel(const char *str, const char *uid, int max_length, int thread_count, JsonSegmentsExecutor executor, void *executor_context) {
+    JsonSegmentsRange prototype;
+
+    if (str == NULL || uid == NULL) {
+        return NULL;
+    }
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.source = str;
+    prototype.source_length = strlen(str);
+    prototype.unique_id = uid;
+    if (json_segments_layout(uid, prototype.source_length, max_length, &prototype.segment_length, &prototype.total_segments) != 0) {
+        return NULL;
+    }
+
+    cJSON **segments = calloc((size_t)prototype.total_segments + 1, sizeof(cJSON *));
+    if (segments == NULL) {
+        return NULL; // Memory allocation failure
+    }
+    prototype.segments = segments;
+
+    if (json_segments_run_ranges(&prototype, thread_count, json_segments_split_range, executor, executor_context) != 0) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", uid);
+        for (int i = 0; i < prototype.total_segments; i++) {
+            cJSON_Delete(segments[i]);
+        }
+        free(segments);
+        return NULL;
+    }
+
+    return segments;
+}
+
+// Serialize all frames of a payload into caller-provided slots on several
+// threads.
+int json_segments_write_frames_parallel(const char *str, size_t length, const char *uid, int max_length, char *frames, size_t frame_stride, int *frame_lengths, int thread_count, JsonSegmentsExecutor executor, void *executor_context) {
+    JsonSegmentsRange prototype;
+
+    if (str == NULL || uid == NULL || frames == NULL || frame_lengths == NULL) {
+        return -1;
+    }
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.source = str;
+    prototype.source_length = length;
+    prototype.unique_id = uid;
+    prototype.frames = frames;
+    prototype.frame_stride = frame_stride;
+    prototype.frame_lengths = frame_lengths;
+    if (json_segments_layout(uid, length, max_length, &prototype.segment_length, &prototype.total_segments) != 0) {
+        return -1;
+    }
+    json_segments_envelope_init(&prototype.envelope, uid, prototype.total_segments);
+
+    return json_segments_run_ranges(&prototype, thread_count, json_segments_write_range, executor, executor_context) == 0 ? 0 : -1;
+}
@@ -0,0 +1,75 @@
+// json_segments_parallel.h
+
+/**
+ * @file json_segments_parallel.h
+ * @brief Parallel splitting of very large payloads.
+ *
+ * Segment boundaries are known up front (see json_segments_layout()), so the payload is
+ * partitioned into contiguous ranges of segments that are escaped and serialized
+ * independently, each into its own preallocated slot of the output array.
+ */
+
+#ifndef JSON_SEGMENTS_PARALLEL_H
+#define JSON_SEGMENTS_PARALLEL_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Caller-provided executor, e.g. an existing thread pool.
+ *
+ * The executor must run task(arguments[i]) for every i in [0, count), in any order and on any
+ * threads, and may only return once all of them have finished.
+ *
+ * @param task Function to run for every argument.
+ * @param arguments Array of task arguments.
+ * @param count Number of tasks.
+ * @param executor_context User-defined context passed through from the split call.
+ */
+typedef void (*JsonSegmentsExecutor)(JsonSegmentsTaskFunction task, void **arguments, int count, void *executor_context);
+
+/**
+ * @brief Split a string into JSON segments using several threads.
+ *
+ * The result is identical to json_segments_split_string() and is freed with
+ * json_segments_free_segments_array().
+ *
+ * @param str String to be split into segments.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each segment.
+ * @param thread_count Number of ranges to split concurrently (values below 1 are treated as 1).
+ * @param executor Executor running the ranges, or NULL to use thread_count POSIX threads.
+ * @param executor_context Context passed to the executor.
+ * @return Array of cJSON objects representing the segments, or NULL on error.
+ */
+cJSON **json_segments_split_string_parallel(const char *str, const char *uid, int max_length, int thread_count, JsonSegmentsExecutor executor, void *executor_context);
+
+/**
+ * @brief Serialize all frames of a payload into a preallocated array using several threads.
+ *
+ * Frame i (0-based) is written NUL-terminated to frames + i * frame_stride and its length is stored
+ * in frame_lengths[i]. A stride of json_segments_frame_capacity(uid, segment_length, total_segments)
+ * is always sufficient.
+ *
+ * @param str Payload to be split (not necessarily NUL-terminated).
+ * @param length Length of the payload in bytes.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each segment.
+ * @param frames Output array of total_segments slots (see json_segments_layout()).
+ * @param frame_stride Size of each slot in bytes.
+ * @param frame_lengths Output array of total_segments frame lengths.
+ * @param thread_count Number of ranges to split concurrently (values below 1 are treated as 1).
+ * @param executor Executor running the ranges, or NULL to use thread_count POSIX threads.
+ * @param executor_context Context passed to the executor.
+ * @return 0 on success, -1 if arguments are invalid or a slot is too small.
+ */
+int json_segments_write_frames_parallel(const char *str, size_t length, const char *uid, int max_length, char *frames, size_t frame_stride, int *frame_lengths, int thread_count, JsonSegmentsExecutor executor, void *executor_context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_PARALLEL_H
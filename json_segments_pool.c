@@ -0,0 +1,264 @@
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_segments_pool.h"
+
+#define JSON_SEGMENTS_POOL_INITIAL_CAPACITY 64
+
+typedef struct {
+    JsonSegmentsTaskFunction task;
+    void *argument;
+} JsonSegmentsPoolTask;
+
+// A worker and its deque. The owner pushes and pops at the bottom, thieves
+// take from the top, both under the deque's lock.
+typedef struct {
+    alignas(64) pthread_mutex_t lock;
+    JsonSegmentsPoolTask *tasks;            // Ring of capacity slots, a power of two
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+    pthread_t thread;
+    struct JsonSegmentsPool *pool;
+    unsigned int random_state;              // Picks the first victim to steal from
+} JsonSegmentsPoolWorker;
+
+struct JsonSegmentsPool {
+    int worker_count;
+    JsonSegmentsPoolWorker *workers;
+    atomic_uint next_worker;                // Round-robin target for external submissions
+    atomic_size_t queued;                   // Tasks sitting in deques
+    atomic_size_t outstanding;              // Tasks submitted and not yet finished
+    atomic_int sleepers;                    // Workers waiting for work
+    atomic_int stopping;
+    pthread_mutex_t lock;                   // Orders the sleep, wake-up and wait hand-offs
+    pthread_cond_t work_available;
+    pthread_cond_t idle;
+};
+
+static _Thread_local JsonSegmentsPoolWorker *json_segments_pool_self;
+
+// Append a task at the bottom of a deque, growing it if it is full.
+static int json_segments_pool_push(JsonSegmentsPoolWorker *worker, JsonSegmentsTaskFunction task, void *argument) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom - worker->top == worker->capacity) {
+        size_t capacity = worker->capacity * 2;
+        JsonSegmentsPoolTask *tasks = malloc(sizeof(JsonSegmentsPoolTask) * capacity);
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&worker->lock);
+            return -1;
+        }
+        for (size_t i = worker->top; i != worker->bottom; i++) {
+            tasks[i - worker->top] = worker->tasks[i & (worker->capacity - 1)];
+        }
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->bottom -= worker->top;
+        worker->top = 0;
+        worker->capacity = capacity;
+    }
+    worker->tasks[worker->bottom++ & (worker->capacity - 1)] = (JsonSegmentsPoolTask){ task, argument };
+    pthread_mutex_unlock(&worker->lock);
+    return 0;
+}
+
+// Take the newest task of the own deque (still warm in cache) or the oldest
+// task of a victim's deque. Returns 1 if a task was taken.
+static int json_segments_pool_take(JsonSegmentsPoolWorker *worker, int own, JsonSegmentsPoolTask *task) {
+    int taken = 0;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom != worker->top) {
+        if (own) {
+            *task = worker->tasks[--worker->bottom & (worker->capacity - 1)];
+        } else {
+            *task = worker->tasks[worker->top++ & (worker->capacity - 1)];
+        }
+        taken = 1;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return taken;
+}
+
+// Find work: the own deque first, then every other deque starting at a random victim.
+static int json_segments_pool_find(JsonSegmentsPoolWorker *worker, JsonSegmentsPoolTask *task) {
+    JsonSegmentsPool *pool = worker->pool;
+    int self = (int)(worker - pool->workers);
+
+    if (json_segments_pool_take(worker, 1, task)) {
+        return 1;
+    }
+
+    worker->random_state ^= worker->random_state << 13;
+    worker->random_state ^= worker->random_state >> 17;
+    worker->random_state ^= worker->random_state << 5;
+    int start = (int)(worker->random_state % (unsigned int)pool->worker_count);
+    for (int i = 0; i < pool->worker_count; i++) {
+        int victim = (start + i) % pool->worker_count;
+        if (victim != self && json_segments_pool_take(&pool->workers[victim], 0, task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *json_segments_pool_main(void *argument) {
+    JsonSegmentsPoolWorker *worker = argument;
+    JsonSegmentsPool *pool = worker->pool;
+    JsonSegmentsPoolTask task;
+
+    json_segments_pool_self = worker;
+    for (;;) {
+        if (json_segments_pool_find(worker, &task)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.task(task.argument);
+            if (atomic_fetch_sub(&pool->outstanding, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->idle);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+
+        // Announce the sleep before rechecking queued; a submitter increments
+        // queued before checking sleepers, so one of the two sees the other
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stopping)) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        int stop = atomic_load(&pool->stopping) && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            return NULL;
+        }
+    }
+}
+
+// Stop and join the first started workers and release everything.
+static void json_segments_pool_destroy(JsonSegmentsPool *pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stopping, 1);
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].tasks);
+    }
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+// Start worker_count workers with empty deques.
+JsonSegmentsPool *json_segments_pool_create(int worker_count) {
+    int count = worker_count < 1 ? 1 : worker_count;
+    JsonSegmentsPool *pool = calloc(1, sizeof(*pool));
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = aligned_alloc(alignof(JsonSegmentsPoolWorker), sizeof(JsonSegmentsPoolWorker) * (size_t)count);
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->worker_count = count;
+    atomic_init(&pool->next_worker, 0);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->outstanding, 0);
+    atomic_init(&pool->sleepers, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    atomic_init(&pool->stopping, 0);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        JsonSegmentsPoolWorker *worker = &pool->workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->tasks = malloc(sizeof(JsonSegmentsPoolTask) * JSON_SEGMENTS_POOL_INITIAL_CAPACITY);
+        worker->capacity = JSON_SEGMENTS_POOL_INITIAL_CAPACITY;
+        worker->top = 0;
+        worker->bottom = 0;
+        worker->pool = pool;
+        worker->random_state = 2463534242u + (unsigned int)i * 2654435761u;
+        if (worker->tasks == NULL) {
+            failed = 1;
+        }
+    }
+
+    int started = 0;
+    while (!failed && started < count) {
+        if (pthread_create(&pool->workers[started].thread, NULL, json_segments_pool_main, &pool->workers[started]) != 0) {
+            failed = 1;
+            break;
+        }
+        started++;
+    }
+    if (failed) {
+        json_segments_pool_destroy(pool, started);
+        return NULL;
+    }
+    return pool;
+}
+
+void json_segments_pool_free(JsonSegmentsPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    json_segments_pool_wait(pool);
+    json_segments_pool_destroy(pool, pool->worker_count);
+}
+
+// Queue a task on the calling worker's own deque, or round-robin from outside the pool.
+int json_segments_pool_submit(JsonSegmentsTaskFunction task, void *argument, void *executor_context) {
+    JsonSegmentsPool *pool = executor_context;
+
+    if (pool == NULL || task == NULL || atomic_load(&pool->stopping)) {
+        return -1;
+    }
+
+    JsonSegmentsPoolWorker *worker = json_segments_pool_self;
+    if (worker == NULL || worker->pool != pool) {
+        worker = &pool->workers[atomic_fetch_add_explicit(&pool->next_worker, 1, memory_order_relaxed) % (unsigned int)pool->worker_count];
+    }
+
+    atomic_fetch_add(&pool->outstanding, 1);
+    if (json_segments_pool_push(worker, task, argument) != 0) {
+        atomic_fetch_sub(&pool->outstanding, 1);
+        return -1;
+    }
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_available);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+void json_segments_pool_wait(JsonSegmentsPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->outstanding) > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int json_segments_pool_worker_count(const JsonSegmentsPool *pool) {
+    return pool != NULL ? pool->worker_count : 0;
+}
@@ -0,0 +1,81 @@
+// json_segments_pool.h
+
+/**
+ * @file json_segments_pool.h
+ * @brief Work-stealing thread pool for completing reassembled messages off the ingest thread.
+ *
+ * Every worker owns a deque. Tasks submitted from outside the pool are spread over the deques
+ * round-robin; tasks submitted by a worker (e.g. from a processing function) go to its own
+ * deque. A worker takes its newest task first and, when its deque is empty, steals the oldest
+ * task of another worker, so a burst of large messages is spread over all workers even if it
+ * was queued unevenly. Idle workers sleep until work arrives.
+ *
+ * @code
+ * JsonSegmentsPool *pool = json_segments_pool_create(4);
+ * json_segments_context_set_executor(&context, json_segments_pool_submit, pool);
+ * // ... ingest ...
+ * json_segments_pool_wait(pool);
+ * json_segments_pool_free(pool);
+ * @endcode
+ */
+
+#ifndef JSON_SEGMENTS_POOL_H
+#define JSON_SEGMENTS_POOL_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Opaque work-stealing thread pool.
+ */
+typedef struct JsonSegmentsPool JsonSegmentsPool;
+
+/**
+ * @brief Start a pool.
+ *
+ * @param worker_count Number of worker threads (values below 1 are treated as 1).
+ * @return New pool, or NULL if memory or threads could not be allocated.
+ */
+JsonSegmentsPool *json_segments_pool_create(int worker_count);
+
+/**
+ * @brief Run all queued tasks, stop the workers and free the pool.
+ *
+ * Must not be called from a task.
+ *
+ * @param pool Pool to free.
+ */
+void json_segments_pool_free(JsonSegmentsPool *pool);
+
+/**
+ * @brief Queue a task; matches JsonSegmentsSubmitFunction.
+ *
+ * @param task Function to run on a worker.
+ * @param argument Argument for task.
+ * @param pool The JsonSegmentsPool, passed as the executor context.
+ * @return 0 if the task was queued, -1 if the pool is shutting down or out of memory.
+ */
+int json_segments_pool_submit(JsonSegmentsTaskFunction task, void *argument, void *pool);
+
+/**
+ * @brief Block until every task submitted so far, and every task those submitted, has finished.
+ *
+ * Must not be called from a task.
+ *
+ * @param pool Pool to wait for.
+ */
+void json_segments_pool_wait(JsonSegmentsPool *pool);
+
+/**
+ * @brief Number of worker threads of a pool.
+ */
+int json_segments_pool_worker_count(const JsonSegmentsPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_POOL_H
@@ -0,0 +1,240 @@
+// json_segments_segmenter.hpp
+
+/**
+ * @file json_segments_segmenter.hpp
+ * @brief Splitter specialized at compile time for a fixed MTU, uid width and segment limit.
+ *
+ * Segmenter<MTU, UidLen, MaxSegments> computes the envelope layout, the segment lengths for every
+ * possible digit count of the total and the worst-case frame size as constants. Frames are built
+ * in std::array buffers from a header template filled in once per payload, so producing a frame is
+ * a fixed-size memcpy of the header, the seq digits, a second fixed-size memcpy and the escape of
+ * the content. Nothing is allocated. The frames are byte-identical to json_segments_split_string()
+ * and JsonSegmentsIterator with max_length = MTU.
+ *
+ * @code
+ * using EspNowSegmenter = json_segments::Segmenter<250, 8, 64>;
+ * EspNowSegmenter segmenter(payload, uid);
+ * EspNowSegmenter::Frame frame;
+ * int length;
+ * while ((length = segmenter.next(frame)) > 0) {
+ *     esp_now_send(peer, reinterpret_cast<const uint8_t *>(frame.data()), length);
+ * }
+ * @endcode
+ */
+
+#ifndef JSON_SEGMENTS_SEGMENTER_HPP
+#define JSON_SEGMENTS_SEGMENTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#include "json_segments.h"
+
+namespace json_segments {
+
+namespace detail {
+
+// Number of decimal digits of a non-negative value.
+constexpr int digit_count(long long value) {
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// Copy a string literal (without its NUL) into a template at offset.
+template <std::size_t N, std::size_t L>
+constexpr void place(std::array<char, N> &target, std::size_t offset, const char (&literal)[L]) {
+    for (std::size_t i = 0; i + 1 < L; i++) {
+        target[offset + i] = literal[i];
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Compile-time specialized splitter.
+ *
+ * @tparam MTU Maximum frame length (the max_length of the C API).
+ * @tparam UidLen Exact uid length; the uid must not contain characters that need escaping.
+ * @tparam MaxSegments Largest number of segments a payload may be split into.
+ */
+template <std::size_t MTU, std::size_t UidLen, int MaxSegments>
+class Segmenter {
+    static_assert(MaxSegments > 0, "MaxSegments must be positive");
+
+    static constexpr char uid_key[] = "{\"uid\":\"";
+    static constexpr char seq_key[] = "\",\"seq\":";
+    static constexpr char abs_key[] = ",\"abs\":";
+    static constexpr char seg_key[] = ",\"seg\":\"";
+
+public:
+    /// Digits of the widest seq and abs value.
+    static constexpr int max_digits = detail::digit_count(MaxSegments);
+
+    /// Envelope bytes without the seq and abs digits: four keys, the uid, the closing quote and brace.
+    static constexpr std::size_t envelope_overhead = sizeof(uid_key) - 1 + UidLen + sizeof(seq_key) - 1 + sizeof(abs_key) - 1 + sizeof(seg_key) - 1 + 2;
+
+    static_assert(MTU > envelope_overhead + 2 * max_digits, "MTU is too small for the frame overhead");
+
+    /// Bytes of the header template up to and including "seq":.
+    static constexpr std::size_t prefix_length = sizeof(uid_key) - 1 + UidLen + sizeof(seq_key) - 1;
+
+    /// Bytes reserved for the template from ,"abs": to the opening quote of seg.
+    static constexpr std::size_t suffix_capacity = sizeof(abs_key) - 1 + max_digits + sizeof(seg_key) - 1;
+
+    /// Payload bytes per segment for a total with the given number of digits (index 0 unused).
+    static constexpr std::array<std::size_t, max_digits + 1> segment_lengths = [] {
+        std::array<std::size_t, max_digits + 1> lengths{};
+        for (int digits = 1; digits <= max_digits; digits++) {
+            lengths[digits] = MTU - envelope_overhead - 2 * static_cast<std::size_t>(digits);
+        }
+        return lengths;
+    }();
+
+    /// Largest payload that fits into MaxSegments segments.
+    static constexpr std::size_t max_payload_length = segment_lengths[max_digits] * static_cast<std::size_t>(MaxSegments);
+
+    /// Worst-case frame size including the NUL, with every content byte escaped to \u00XX.
+    static constexpr std::size_t frame_capacity = envelope_overhead + 2 * max_digits + 6 * segment_lengths[1] + 1;
+
+    /// Transmit buffer always large enough for one frame.
+    using Frame = std::array<char, frame_capacity>;
+
+    /**
+     * @brief Lay out a payload. Check valid() afterwards.
+     *
+     * The payload is borrowed and must outlive the segmenter; the uid is copied into the header template.
+     *
+     * @param payload Data to split.
+     * @param unique_id Exactly UidLen characters, none of which need escaping.
+     */
+    Segmenter(std::string_view payload, std::string_view unique_id) noexcept : payload_(payload) {
+        if (unique_id.size() != UidLen || json_segments_escaped_length(unique_id.data(), UidLen) != UidLen) {
+            return;
+        }
+
+        // Same rule as json_segments_layout(): the fewest digits for which the total still fits
+        for (int digits = 1; digits <= max_digits; digits++) {
+            std::size_t count = (payload.size() + segment_lengths[digits] - 1) / segment_lengths[digits];
+            if (count > static_cast<std::size_t>(MaxSegments)) {
+                return;
+            }
+            if (detail::digit_count(static_cast<long long>(count)) <= digits) {
+                segment_length_ = segment_lengths[digits];
+                total_segments_ = static_cast<int>(count);
+                break;
+            }
+        }
+
+        std::memcpy(prefix_.data() + sizeof(uid_key) - 1, unique_id.data(), UidLen);
+        suffix_length_ = sizeof(abs_key) - 1 + store_digits(suffix_.data() + sizeof(abs_key) - 1, total_segments_);
+        std::memcpy(suffix_.data() + suffix_length_, seg_key, sizeof(seg_key) - 1);
+        suffix_length_ += sizeof(seg_key) - 1;
+        valid_ = true;
+    }
+
+    /// Whether the uid was accepted and the payload fits into MaxSegments segments.
+    bool valid() const noexcept { return valid_; }
+
+    int total_segments() const noexcept { return total_segments_; }
+
+    std::size_t segment_length() const noexcept { return segment_length_; }
+
+    /// Sequence number of the frame produced by the next call to next().
+    int position() const noexcept { return next_sequence_number_; }
+
+    /**
+     * @brief Serialize any segment, e.g. for a retransmit, without moving the position.
+     *
+     * @return Length of the NUL-terminated frame, or -1 if sequence_number is out of range.
+     */
+    int write(int sequence_number, Frame &frame) const noexcept {
+        if (!valid_ || sequence_number < 1 || sequence_number > total_segments_) {
+            return -1;
+        }
+
+        std::size_t start = static_cast<std::size_t>(sequence_number - 1) * segment_length_;
+        std::size_t length = payload_.size() - start < segment_length_ ? payload_.size() - start : segment_length_;
+
+        char *out = frame.data();
+        std::memcpy(out, prefix_.data(), prefix_length);
+        out += prefix_length;
+        out += store_digits(out, sequence_number);
+        // Copy the whole reserved suffix; the unused tail is overwritten by the content
+        std::memcpy(out, suffix_.data(), suffix_capacity);
+        out += suffix_length_;
+        out += json_segments_escape(out, payload_.data() + start, length);
+        *out++ = '"';
+        *out++ = '}';
+        *out = '\0';
+        return static_cast<int>(out - frame.data());
+    }
+
+    /**
+     * @brief Serialize the next segment and advance.
+     *
+     * @return Length of the frame, 0 after the last frame, or -1 if the segmenter is invalid.
+     */
+    int next(Frame &frame) noexcept {
+        if (!valid_) {
+            return -1;
+        }
+        if (next_sequence_number_ > total_segments_) {
+            return 0;
+        }
+        return write(next_sequence_number_++, frame);
+    }
+
+    /// Reposition to a sequence number; 0 on success, -1 if out of range.
+    int seek(int sequence_number) noexcept {
+        if (!valid_ || sequence_number < 1 || sequence_number > total_segments_ + 1) {
+            return -1;
+        }
+        next_sequence_number_ = sequence_number;
+        return 0;
+    }
+
+private:
+    // Write value (at most max_digits digits) without a terminator and return the digit count.
+    static std::size_t store_digits(char *out, int value) noexcept {
+        std::size_t digits = 1;
+        for (long long bound = 10; digits < static_cast<std::size_t>(max_digits) && value >= bound; bound *= 10) {
+            digits++;
+        }
+        for (std::size_t i = digits; i-- > 0; value /= 10) {
+            out[i] = static_cast<char>('0' + value % 10);
+        }
+        return digits;
+    }
+
+    static constexpr std::array<char, prefix_length> prefix_template = [] {
+        std::array<char, prefix_length> header{};
+        detail::place(header, 0, uid_key);
+        detail::place(header, sizeof(uid_key) - 1 + UidLen, seq_key);
+        return header;
+    }();
+
+    static constexpr std::array<char, suffix_capacity> suffix_template = [] {
+        std::array<char, suffix_capacity> header{};
+        detail::place(header, 0, abs_key);
+        return header;
+    }();
+
+    std::string_view payload_;
+    std::array<char, prefix_length> prefix_ = prefix_template;
+    std::array<char, suffix_capacity> suffix_ = suffix_template;
+    std::size_t suffix_length_ = 0;
+    std::size_t segment_length_ = 0;
+    int total_segments_ = 0;
+    int next_sequence_number_ = 1;
+    bool valid_ = false;
+};
+
+} // namespace json_segments
+
+#endif // JSON_SEGMENTS_SEGMENTER_HPP
@@ -0,0 +1,243 @@
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_segments_shard.h"
+
+// Producer and consumer state live on separate cache lines, so the two
+// threads only share a line when one actually waits for the other.
+#define JSON_SEGMENTS_CACHE_LINE 64
+
+struct JsonSegmentsFrameRing {
+    alignas(JSON_SEGMENTS_CACHE_LINE) atomic_size_t head;  // Next slot to read, written by the consumer
+    size_t cached_tail;                                     // Consumer's last view of tail
+    alignas(JSON_SEGMENTS_CACHE_LINE) atomic_size_t tail;  // Next slot to write, written by the producer
+    size_t cached_head;                                     // Producer's last view of head
+    alignas(JSON_SEGMENTS_CACHE_LINE) size_t mask;
+    size_t slot_size;                                       // Bytes per slot: the length followed by the frame
+    size_t max_frame_length;
+    char *slots;
+};
+
+// A shard's context, padded to its own cache lines.
+typedef struct {
+    alignas(JSON_SEGMENTS_CACHE_LINE) JsonSegmentsContext context;
+    int next_producer;                                      // Ring the next poll starts with
+} JsonSegmentsShard;
+
+struct JsonSegmentsShardSet {
+    int shard_count;
+    int producer_count;
+    size_t max_frame_length;
+    JsonSegmentsShard *shards;
+    JsonSegmentsFrameRing **rings;                          // producer * shard_count + shard
+};
+
+// Round size up to a multiple of the cache line, as aligned_alloc requires.
+static size_t json_segments_cache_round(size_t size) {
+    return (size + JSON_SEGMENTS_CACHE_LINE - 1) / JSON_SEGMENTS_CACHE_LINE * JSON_SEGMENTS_CACHE_LINE;
+}
+
+// Create an empty ring with a power-of-two number of fixed-size slots.
+JsonSegmentsFrameRing *json_segments_ring_create(size_t capacity, size_t max_frame_length) {
+    size_t slots = 1;
+
+    if (capacity == 0 || max_frame_length == 0 || max_frame_length > SIZE_MAX / 2 - sizeof(size_t) - JSON_SEGMENTS_CACHE_LINE) {
+        return NULL;
+    }
+    while (slots < capacity) {
+        slots *= 2;
+    }
+
+    size_t slot_size = json_segments_cache_round(sizeof(size_t) + max_frame_length);
+    if (slots > SIZE_MAX / slot_size) {
+        return NULL;
+    }
+
+    JsonSegmentsFrameRing *ring = aligned_alloc(JSON_SEGMENTS_CACHE_LINE, json_segments_cache_round(sizeof(*ring)));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->slots = aligned_alloc(JSON_SEGMENTS_CACHE_LINE, slots * slot_size);
+    if (ring->slots == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->mask = slots - 1;
+    ring->slot_size = slot_size;
+    ring->max_frame_length = max_frame_length;
+    return ring;
+}
+
+void json_segments_ring_free(JsonSegmentsFrameRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->slots);
+    free(ring);
+}
+
+// Copy a frame into the next free slot. The consumer's head is only
+// reloaded when the cached copy says the ring is full.
+JsonSegmentsError json_segments_ring_push(JsonSegmentsFrameRing *ring, const char *frame, size_t length) {
+    if (length > ring->max_frame_length) {
+        return JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask) {
+            return JSON_SEGMENTS_ERROR_FULL;
+        }
+    }
+
+    char *slot = ring->slots + (tail & ring->mask) * ring->slot_size;
+    memcpy(slot, &length, sizeof(length));
+    memcpy(slot + sizeof(length), frame, length);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return JSON_SEGMENTS_OK;
+}
+
+// Return the oldest frame in place. The producer's tail is only reloaded
+// when the cached copy says the ring is empty.
+int json_segments_ring_peek(JsonSegmentsFrameRing *ring, const char **frame, size_t *length) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head == ring->cached_tail) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == ring->cached_tail) {
+            return 0;
+        }
+    }
+
+    const char *slot = ring->slots + (head & ring->mask) * ring->slot_size;
+    memcpy(length, slot, sizeof(*length));
+    *frame = slot + sizeof(*length);
+    return 1;
+}
+
+void json_segments_ring_pop(JsonSegmentsFrameRing *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Create the shards and one ring per (producer, shard) pair.
+JsonSegmentsShardSet *json_segments_shards_create(int shard_count, int producer_count, size_t ring_capacity, size_t max_frame_length,
+                                                  JsonSegmentsContextFunction processing_function, void *user_data) {
+    if (shard_count <= 0 || producer_count <= 0) {
+        return NULL;
+    }
+
+    JsonSegmentsShardSet *shards = calloc(1, sizeof(*shards));
+    if (shards == NULL) {
+        return NULL;
+    }
+    shards->shard_count = shard_count;
+    shards->producer_count = producer_count;
+    shards->max_frame_length = max_frame_length;
+    shards->shards = aligned_alloc(JSON_SEGMENTS_CACHE_LINE, json_segments_cache_round(sizeof(JsonSegmentsShard) * (size_t)shard_count));
+    shards->rings = calloc((size_t)shard_count * (size_t)producer_count, sizeof(JsonSegmentsFrameRing *));
+    if (shards->shards == NULL || shards->rings == NULL) {
+        free(shards->shards);
+        free(shards->rings);
+        free(shards);
+        return NULL;
+    }
+
+    for (int i = 0; i < shard_count; i++) {
+        json_segments_context_init(&shards->shards[i].context, processing_function, user_data);
+        shards->shards[i].next_producer = 0;
+    }
+    for (int i = 0; i < shard_count * producer_count; i++) {
+        shards->rings[i] = json_segments_ring_create(ring_capacity, max_frame_length);
+        if (shards->rings[i] == NULL) {
+            json_segments_shards_free(shards);
+            return NULL;
+        }
+    }
+    return shards;
+}
+
+void json_segments_shards_free(JsonSegmentsShardSet *shards) {
+    if (shards == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < shards->shard_count; i++) {
+        json_segments_context_free(&shards->shards[i].context);
+    }
+    for (int i = 0; i < shards->shard_count * shards->producer_count; i++) {
+        json_segments_ring_free(shards->rings[i]);
+    }
+    free(shards->shards);
+    free(shards->rings);
+    free(shards);
+}
+
+// Map a hash onto [0, shard_count) by multiplying its high half, which
+// avoids a division on every frame.
+int json_segments_shards_owner(const JsonSegmentsShardSet *shards, uint64_t hash) {
+    return (int)(((hash >> 32) * (uint64_t)shards->shard_count) >> 32);
+}
+
+// Steer a frame to the ring between this producer and the owning shard.
+JsonSegmentsError json_segments_shards_route(JsonSegmentsShardSet *shards, int producer, const char *frame, size_t length) {
+    uint64_t hash;
+
+    if (shards == NULL || frame == NULL || producer < 0 || producer >= shards->producer_count) {
+        return JSON_SEGMENTS_ERROR_INVALID_ARGUMENT;
+    }
+    if (length > shards->max_frame_length) {
+        return JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    int owner = json_segments_frame_unique_id_hash(frame, length, &hash) == JSON_SEGMENTS_OK ? json_segments_shards_owner(shards, hash) : 0;
+    return json_segments_ring_push(shards->rings[producer * shards->shard_count + owner], frame, length);
+}
+
+// Drain the rings of a shard one frame at a time in turn, parsing every
+// frame directly from its slot.
+size_t json_segments_shards_poll(JsonSegmentsShardSet *shards, int shard, size_t max_frames) {
+    if (shards == NULL || shard < 0 || shard >= shards->shard_count) {
+        return 0;
+    }
+
+    JsonSegmentsShard *owner = &shards->shards[shard];
+    size_t processed = 0;
+    int idle = 0;
+
+    // Stop after a full round over the producers found every ring empty
+    while (idle < shards->producer_count && (max_frames == 0 || processed < max_frames)) {
+        JsonSegmentsFrameRing *ring = shards->rings[owner->next_producer * shards->shard_count + shard];
+        const char *frame;
+        size_t length;
+
+        if (++owner->next_producer == shards->producer_count) {
+            owner->next_producer = 0;
+        }
+        if (!json_segments_ring_peek(ring, &frame, &length)) {
+            idle++;
+            continue;
+        }
+        json_segments_context_parse_raw(&owner->context, frame, length);
+        json_segments_ring_pop(ring);
+        processed++;
+        idle = 0;
+    }
+    return processed;
+}
+
+JsonSegmentsContext *json_segments_shards_context(JsonSegmentsShardSet *shards, int shard) {
+    if (shards == NULL || shard < 0 || shard >= shards->shard_count) {
+        return NULL;
+    }
+    return &shards->shards[shard].context;
+}
@@ -0,0 +1,161 @@
+// json_segments_shard.h
+
+/**
+ * @file json_segments_shard.h
+ * @brief Thread-per-core reassembly: frames are steered to the shard that owns their uid.
+ *
+ * Every shard owns a private JsonSegmentsContext that only its own thread touches. Receive
+ * threads hash the uid of each frame with json_segments_frame_unique_id_hash(), which scans the
+ * uid string alone, and push the frame into a single-producer/single-consumer ring towards the
+ * owning shard. There is one ring per (producer, shard) pair, so no ring has more than one writer
+ * or reader and no lock is taken on the path. The shard thread drains its rings with
+ * json_segments_shards_poll(), which feeds the frames straight from the ring slots to
+ * json_segments_context_parse_raw().
+ *
+ * The runtime statistics are shared atomic counters; build with JSON_SEGMENTS_NO_STATS for a
+ * strictly shared-nothing ingest path.
+ *
+ * @code
+ * JsonSegmentsShardSet *shards = json_segments_shards_create(cores, 1, 1024, 1500, on_message, NULL);
+ * // receive thread:
+ * while (json_segments_shards_route(shards, 0, frame, frame_length) == JSON_SEGMENTS_ERROR_FULL) {
+ * }
+ * // thread of shard i:
+ * json_segments_shards_poll(shards, i, 64);
+ * @endcode
+ */
+
+#ifndef JSON_SEGMENTS_SHARD_H
+#define JSON_SEGMENTS_SHARD_H
+
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Bounded single-producer/single-consumer queue of frames in fixed-size slots.
+ */
+typedef struct JsonSegmentsFrameRing JsonSegmentsFrameRing;
+
+/**
+ * @brief Create an empty ring.
+ *
+ * @param capacity Number of slots (rounded up to a power of two).
+ * @param max_frame_length Largest frame a slot holds.
+ * @return New ring, or NULL on allocation failure or a zero argument.
+ */
+JsonSegmentsFrameRing *json_segments_ring_create(size_t capacity, size_t max_frame_length);
+
+/**
+ * @brief Free a ring. Frames still queued are dropped.
+ *
+ * @param ring Ring to free.
+ */
+void json_segments_ring_free(JsonSegmentsFrameRing *ring);
+
+/**
+ * @brief Copy a frame into the next slot. Only the producer thread may call this.
+ *
+ * @param ring Ring receiving the frame.
+ * @param frame Frame to queue.
+ * @param length Number of bytes in frame.
+ * @return JSON_SEGMENTS_OK, JSON_SEGMENTS_ERROR_FULL, or JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL if the frame exceeds max_frame_length.
+ */
+JsonSegmentsError json_segments_ring_push(JsonSegmentsFrameRing *ring, const char *frame, size_t length);
+
+/**
+ * @brief Look at the oldest queued frame without removing it. Only the consumer thread may call this.
+ *
+ * The frame stays valid and unchanged until json_segments_ring_pop().
+ *
+ * @param ring Ring to read.
+ * @param frame Receives a pointer to the frame in its slot.
+ * @param length Receives the length of the frame.
+ * @return 1 if a frame was returned, 0 if the ring is empty.
+ */
+int json_segments_ring_peek(JsonSegmentsFrameRing *ring, const char **frame, size_t *length);
+
+/**
+ * @brief Release the frame returned by json_segments_ring_peek() so the producer can reuse its slot.
+ *
+ * @param ring Ring to advance.
+ */
+void json_segments_ring_pop(JsonSegmentsFrameRing *ring);
+
+/**
+ * @brief Shards with their private contexts and the rings connecting them to the producers.
+ */
+typedef struct JsonSegmentsShardSet JsonSegmentsShardSet;
+
+/**
+ * @brief Create shard_count shards fed by producer_count receive threads.
+ *
+ * @param shard_count Number of shards, usually one per core.
+ * @param producer_count Number of threads calling json_segments_shards_route().
+ * @param ring_capacity Slots of each (producer, shard) ring.
+ * @param max_frame_length Largest frame routed.
+ * @param processing_function Processing function of every shard's context.
+ * @param user_data User data of every shard's context; change it per shard through json_segments_shards_context().
+ * @return New shard set, or NULL on allocation failure or a zero argument.
+ */
+JsonSegmentsShardSet *json_segments_shards_create(int shard_count, int producer_count, size_t ring_capacity, size_t max_frame_length,
+                                                  JsonSegmentsContextFunction processing_function, void *user_data);
+
+/**
+ * @brief Free the shards, their contexts and their rings. No thread may use the set any more.
+ *
+ * @param shards Shard set to free.
+ */
+void json_segments_shards_free(JsonSegmentsShardSet *shards);
+
+/**
+ * @brief Shard that owns a uid hash.
+ *
+ * @param shards Shard set.
+ * @param hash Result of json_segments_unique_id_hash() or json_segments_frame_unique_id_hash().
+ * @return Shard index in [0, shard_count).
+ */
+int json_segments_shards_owner(const JsonSegmentsShardSet *shards, uint64_t hash);
+
+/**
+ * @brief Queue a frame for the shard owning its uid.
+ *
+ * Frames without a readable uid go to shard 0, whose context reports them. Each producer index
+ * must be used by one thread at a time.
+ *
+ * @param shards Shard set.
+ * @param producer Index of the calling producer, in [0, producer_count).
+ * @param frame Received frame; it is copied, so the buffer can be reused at once.
+ * @param length Number of bytes in frame.
+ * @return Result of json_segments_ring_push(), or JSON_SEGMENTS_ERROR_INVALID_ARGUMENT.
+ */
+JsonSegmentsError json_segments_shards_route(JsonSegmentsShardSet *shards, int producer, const char *frame, size_t length);
+
+/**
+ * @brief Process queued frames of one shard. Only the thread owning the shard may call this.
+ *
+ * The rings of the shard are drained round-robin, so one busy producer cannot starve the others.
+ *
+ * @param shards Shard set.
+ * @param shard Index of the shard.
+ * @param max_frames Upper bound on the frames processed, or 0 for no bound.
+ * @return Number of frames processed.
+ */
+size_t json_segments_shards_poll(JsonSegmentsShardSet *shards, int shard, size_t max_frames);
+
+/**
+ * @brief The private context of a shard, e.g. to set its user data or check timeouts from the shard's thread.
+ *
+ * @param shards Shard set.
+ * @param shard Index of the shard.
+ * @return The context, or NULL if shard is out of range.
+ */
+JsonSegmentsContext *json_segments_shards_context(JsonSegmentsShardSet *shards, int shard);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_SHARD_H
@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_segments_stream.h"
+
+// Initialize a stream over an arbitrary read function. Only one segment of
+// payload is buffered at a time, so memory use does not depend on the size
+// of the payload.
+int json_segments_stream_init(JsonSegmentsStream *stream, JsonSegmentsReadFunction read, void *read_context, const char *uid, int max_length, size_t payload_length) {
+    if (stream == NULL || read == NULL || uid == NULL) {
+        return -1;
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    stream->file_descriptor = -1;
+
+    if (json_segments_layout(uid, payload_length, max_length, &stream->segment_length, &stream->total_segments) != 0) {
+        return -1;
+    }
+
+    stream->read = read;
+    stream->read_context = read_context;
+    stream->remaining_length = payload_length;
+    stream->next_sequence_number = 1;
+    stream->unique_id = strdup(uid);
+    stream->chunk = malloc(stream->segment_length);
+
+    if (stream->unique_id == NULL || stream->chunk == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", uid);
+        json_segments_stream_free(stream);
+        return -1;
+    }
+
+    return json_segments_envelope_init(&stream->envelope, stream->unique_id, stream->total_segments);
+}
+
+// Read function for file descriptors, retrying on EINTR.
+static size_t json_segments_read_fd(void *context, char *buffer, size_t size) {
+    const JsonSegmentsStream *stream = context;
+    ssize_t result;
+
+    do {
+        result = read(stream->file_descriptor, buffer, size);
+    } while (result < 0 && errno == EINTR);
+
+    return result < 0 ? (size_t)-1 : (size_t)result;
+}
+
+// Read function for stdio files.
+static size_t json_segments_read_file(void *context, char *buffer, size_t size) {
+    FILE *file = context;
+    size_t result = fread(buffer, 1, size, file);
+
+    return result == 0 && ferror(file) ? (size_t)-1 : result;
+}
+
+// Determine how many bytes are left in a regular file from its size and the
+// current offset.
+static int json_segments_remaining_file_length(int fd, off_t offset, size_t *length) {
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset < 0 || offset > st.st_size) {
+        return -1;
+    }
+
+    *length = (size_t)(st.st_size - offset);
+    return 0;
+}
+
+// Initialize a stream over a file descriptor of a regular file. The payload
+// length is stat'd so the total number of segments is known up front.
+int json_segments_stream_init_fd(JsonSegmentsStream *stream, int fd, const char *uid, int max_length) {
+    size_t length;
+
+    if (stream == NULL || json_segments_remaining_file_length(fd, lseek(fd, 0, SEEK_CUR), &length) != 0) {
+        return -1;
+    }
+
+    if (json_segments_stream_init(stream, json_segments_read_fd, stream, uid, max_length, length) != 0) {
+        return -1;
+    }
+
+    stream->file_descriptor = fd;
+    return 0;
+}
+
+// Initialize a stream over a stdio file. The payload length is stat'd from
+// the underlying descriptor, minus what has already been consumed.
+int json_segments_stream_init_file(JsonSegmentsStream *stream, FILE *file, const char *uid, int max_length) {
+    size_t length;
+
+    if (stream == NULL || file == NULL || json_segments_remaining_file_length(fileno(file), ftello(file), &length) != 0) {
+        return -1;
+    }
+
+    return json_segments_stream_init(stream, json_segments_read_file, file, uid, max_length, length);
+}
+
+// Read exactly one segment of payload (looping over short reads) and
+// serialize it into the caller's frame buffer.
+int json_segments_stream_next(JsonSegmentsStream *stream, char *frame, size_t frame_size) {
+    if (stream == NULL || stream->chunk == NULL) {
+        return -1;
+    }
+    if (stream->next_sequence_number > stream->total_segments) {
+        return 0;
+    }
+
+    size_t wanted = stream->remaining_length < stream->segment_length ? stream->remaining_length : stream->segment_length;
+    size_t filled = 0;
+
+    while (filled < wanted) {
+        size_t result = stream->read(stream->read_context, stream->chunk + filled, wanted - filled);
+        if (result == (size_t)-1) {
+            json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Error reading segment", stream->unique_id);
+            return -1;
+        }
+        if (result == 0) {
+            json_segments_report_error(JSON_SEGMENTS_ERROR_IO, "Source ended before the segment was complete", stream->unique_id);
+            return -1;
+        }
+        filled += result;
+    }
+
+    int length = json_segments_envelope_write(&stream->envelope, frame, frame_size, stream->next_sequence_number, stream->chunk, wanted);
+    if (length < 0) {
+        // The payload has been consumed, so the stream cannot be resumed
+        json_segments_report_error(JSON_SEGMENTS_ERROR_BUFFER_TOO_SMALL, "Frame buffer too small for segment", stream->unique_id);
+        stream->next_sequence_number = stream->total_segments + 1;
+        return -1;
+    }
+
+    stream->remaining_length -= wanted;
+    stream->next_sequence_number++;
+    return length;
+}
+
+// Free the chunk buffer and uid copy. The source is owned by the caller.
+void json_segments_stream_free(JsonSegmentsStream *stream) {
+    if (stream == NULL) {
+        return;
+    }
+
+    free(stream->unique_id);
+    free(stream->chunk);
+    stream->unique_id = NULL;
+    stream->chunk = NULL;
+}
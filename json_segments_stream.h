@@ -0,0 +1,114 @@
+// json_segments_stream.h
+
+/**
+ * @file json_segments_stream.h
+ * @brief Streaming splitter that reads a payload in bounded chunks.
+ *
+ * Instead of loading the whole payload and building all segment objects up front (as
+ * json_segments_split_string() does), a stream reads exactly one segment's worth of payload
+ * from a file descriptor, FILE* or user-defined read function per call and serializes it
+ * into a caller-provided frame buffer. Memory use is constant regardless of payload size.
+ */
+
+#ifndef JSON_SEGMENTS_STREAM_H
+#define JSON_SEGMENTS_STREAM_H
+
+#include <stdio.h>
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Read function used by a stream to pull payload bytes.
+ *
+ * @param context User-defined context passed to json_segments_stream_init().
+ * @param buffer Destination buffer.
+ * @param size Maximum number of bytes to read.
+ * @return Number of bytes read, 0 at the end of the source, or (size_t)-1 on error.
+ */
+typedef size_t (*JsonSegmentsReadFunction)(void *context, char *buffer, size_t size);
+
+/**
+ * @brief State of a streaming split. All fields are read-only for the caller.
+ */
+typedef struct {
+    JsonSegmentsReadFunction read;          ///< Function pulling payload bytes from the source.
+    void *read_context;                     ///< Context passed to the read function.
+    char *unique_id;                        ///< Unique identifier of the streamed JSON object.
+    size_t segment_length;                  ///< Payload bytes per segment (the last one may be shorter).
+    size_t remaining_length;                ///< Payload bytes not yet read from the source.
+    int total_segments;                     ///< Total number of segments of the payload.
+    int next_sequence_number;               ///< Sequence number of the next frame.
+    char *chunk;                            ///< Buffer holding the payload of the current segment.
+    int file_descriptor;                    ///< Source descriptor for json_segments_stream_init_fd().
+    JsonSegmentsEnvelope envelope;          ///< Precomputed frame header.
+} JsonSegmentsStream;
+
+/**
+ * @brief Initialize a stream reading from a user-defined read function.
+ *
+ * @param stream Stream to initialize.
+ * @param read Function pulling payload bytes from the source.
+ * @param read_context Context passed to the read function.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each frame.
+ * @param payload_length Total number of payload bytes the source will deliver.
+ * @return 0 on success, -1 on invalid arguments or allocation failure.
+ */
+int json_segments_stream_init(JsonSegmentsStream *stream, JsonSegmentsReadFunction read, void *read_context, const char *uid, int max_length, size_t payload_length);
+
+/**
+ * @brief Initialize a stream reading from a file descriptor.
+ *
+ * The payload length is taken from fstat() minus the current file offset, so fd must refer to
+ * a regular file. For pipes and sockets use json_segments_stream_init() with a known length.
+ *
+ * @param stream Stream to initialize.
+ * @param fd File descriptor to read from. It is not closed by the stream.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each frame.
+ * @return 0 on success, -1 on error.
+ */
+int json_segments_stream_init_fd(JsonSegmentsStream *stream, int fd, const char *uid, int max_length);
+
+/**
+ * @brief Initialize a stream reading from a stdio file.
+ *
+ * The payload length is taken from the file size minus the current position.
+ *
+ * @param stream Stream to initialize.
+ * @param file File to read from. It is not closed by the stream.
+ * @param uid Unique identifier for the JSON object.
+ * @param max_length Maximum length of each frame.
+ * @return 0 on success, -1 on error.
+ */
+int json_segments_stream_init_file(JsonSegmentsStream *stream, FILE *file, const char *uid, int max_length);
+
+/**
+ * @brief Read the next segment from the source and serialize it as a frame.
+ *
+ * A buffer of json_segments_frame_capacity(uid, stream->segment_length, stream->total_segments)
+ * bytes is always large enough.
+ *
+ * @param stream Initialized stream.
+ * @param frame Output buffer for the NUL-terminated frame.
+ * @param frame_size Size of the output buffer in bytes.
+ * @return Length of the frame, 0 after the last frame, or -1 on read errors, a source shorter
+ *         than announced, or a too small buffer.
+ */
+int json_segments_stream_next(JsonSegmentsStream *stream, char *frame, size_t frame_size);
+
+/**
+ * @brief Free the resources held by a stream. The source itself is not closed.
+ *
+ * @param stream Stream to free.
+ */
+void json_segments_stream_free(JsonSegmentsStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_STREAM_H
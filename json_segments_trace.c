@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "json_segments_trace.h"
+
+static JsonSegmentsTraceRecord *json_segments_trace_buffer = NULL;
+static size_t json_segments_trace_capacity = 0;
+static atomic_size_t json_segments_trace_next;
+static atomic_size_t json_segments_trace_overflow;
+
+// Allocate the event buffer and install the recorder as trace function.
+int json_segments_trace_start(size_t capacity) {
+    if (capacity == 0) {
+        return -1;
+    }
+
+    json_segments_trace_free();
+    json_segments_trace_buffer = malloc(capacity * sizeof(JsonSegmentsTraceRecord));
+    if (json_segments_trace_buffer == NULL) {
+        json_segments_report_error(JSON_SEGMENTS_ERROR_OUT_OF_MEMORY, "Memory allocation error", NULL);
+        return -1;
+    }
+    json_segments_trace_capacity = capacity;
+    atomic_store(&json_segments_trace_next, 0);
+    atomic_store(&json_segments_trace_overflow, 0);
+
+    current_json_segments_trace_function = json_segments_trace_record;
+    return 0;
+}
+
+// Uninstall the recorder, keeping the events.
+void json_segments_trace_stop(void) {
+    if (current_json_segments_trace_function == json_segments_trace_record) {
+        current_json_segments_trace_function = NULL;
+    }
+}
+
+// Claim a slot with a single atomic increment and fill it in. Once the
+// buffer is full, events are only counted.
+void json_segments_trace_record(JsonSegmentsTraceEvent event, const char *unique_id, int sequence_number, unsigned long long timestamp_ns) {
+    size_t slot = atomic_fetch_add_explicit(&json_segments_trace_next, 1, memory_order_relaxed);
+
+    if (slot >= json_segments_trace_capacity) {
+        atomic_fetch_add_explicit(&json_segments_trace_overflow, 1, memory_order_relaxed);
+        return;
+    }
+
+    JsonSegmentsTraceRecord *record = &json_segments_trace_buffer[slot];
+    record->timestamp_ns = timestamp_ns;
+    record->event = event;
+    record->sequence_number = sequence_number;
+    if (unique_id != NULL) {
+        strncpy(record->unique_id, unique_id, JSON_SEGMENTS_TRACE_UID_CAPACITY - 1);
+        record->unique_id[JSON_SEGMENTS_TRACE_UID_CAPACITY - 1] = '\0';
+    } else {
+        record->unique_id[0] = '\0';
+    }
+}
+
+// Recorded events in recording order.
+const JsonSegmentsTraceRecord *json_segments_trace_records(size_t *count) {
+    size_t next = atomic_load(&json_segments_trace_next);
+
+    if (count != NULL) {
+        *count = next < json_segments_trace_capacity ? next : json_segments_trace_capacity;
+    }
+    return json_segments_trace_buffer;
+}
+
+size_t json_segments_trace_dropped(void) {
+    return atomic_load(&json_segments_trace_overflow);
+}
+
+// Write one trace-event object. Async events of the same message share the
+// uid as id, so the viewer groups them into one track per message.
+static int json_segments_trace_write_event(FILE *out, int *first, const char *name, char phase, const JsonSegmentsTraceRecord *record, unsigned long long base_ns) {
+    char id[JSON_SEGMENTS_TRACE_UID_CAPACITY * 6];
+    size_t id_length = json_segments_escape(id, record->unique_id, strlen(record->unique_id));
+
+    int written = fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"json_segments\",\"ph\":\"%c\",\"id\":\"%.*s\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+                          *first ? "" : ",", name, phase, (int)id_length, id, (double)(record->timestamp_ns - base_ns) / 1000.0);
+    if (written >= 0 && record->event == JSON_SEGMENTS_TRACE_SEGMENT) {
+        written = fprintf(out, ",\"args\":{\"seq\":%d}", record->sequence_number);
+    }
+    if (written >= 0) {
+        written = fprintf(out, "}");
+    }
+    *first = 0;
+    return written < 0 ? -1 : 0;
+}
+
+// The callback phase only exists if parsing succeeded, which is known from
+// the next event of the same message.
+static int json_segments_trace_callback_follows(const JsonSegmentsTraceRecord *records, size_t count, size_t index) {
+    for (size_t i = index + 1; i < count; i++) {
+        if (strcmp(records[i].unique_id, records[index].unique_id) == 0) {
+            return records[i].event == JSON_SEGMENTS_TRACE_CALLBACK_END;
+        }
+    }
+    return 0;
+}
+
+// Export the recorded events in the Chrome trace-event format. Timestamps are
+// microseconds relative to the first event.
+int json_segments_trace_write_chrome(FILE *out) {
+    size_t count;
+    const JsonSegmentsTraceRecord *records = json_segments_trace_records(&count);
+    unsigned long long base_ns = count > 0 ? records[0].timestamp_ns : 0;
+    int first = 1;
+    int result = 0;
+
+    if (out == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        if (records[i].timestamp_ns < base_ns) {
+            base_ns = records[i].timestamp_ns;
+        }
+    }
+
+    fprintf(out, "{\"traceEvents\":[");
+    for (size_t i = 0; i < count && result == 0; i++) {
+        const JsonSegmentsTraceRecord *record = &records[i];
+        switch (record->event) {
+            case JSON_SEGMENTS_TRACE_FIRST_SEEN:
+                result = json_segments_trace_write_event(out, &first, "message", 'b', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_SEGMENT:
+                result = json_segments_trace_write_event(out, &first, "segment", 'n', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_COMPLETE:
+                result = json_segments_trace_write_event(out, &first, "complete", 'n', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_MERGE_START:
+                result = json_segments_trace_write_event(out, &first, "merge", 'b', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_MERGE_END:
+                result = json_segments_trace_write_event(out, &first, "merge", 'e', record, base_ns);
+                if (result == 0) {
+                    result = json_segments_trace_write_event(out, &first, "parse", 'b', record, base_ns);
+                }
+                break;
+            case JSON_SEGMENTS_TRACE_PARSE_END:
+                result = json_segments_trace_write_event(out, &first, "parse", 'e', record, base_ns);
+                if (result == 0 && json_segments_trace_callback_follows(records, count, i)) {
+                    result = json_segments_trace_write_event(out, &first, "callback", 'b', record, base_ns);
+                }
+                break;
+            case JSON_SEGMENTS_TRACE_CALLBACK_END:
+                result = json_segments_trace_write_event(out, &first, "callback", 'e', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_TIMEOUT:
+                result = json_segments_trace_write_event(out, &first, "timeout", 'n', record, base_ns);
+                break;
+            case JSON_SEGMENTS_TRACE_EVICT:
+                result = json_segments_trace_write_event(out, &first, "message", 'e', record, base_ns);
+                break;
+        }
+    }
+    if (fprintf(out, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":%zu}}\n", json_segments_trace_dropped()) < 0) {
+        result = -1;
+    }
+
+    return result;
+}
+
+// Release the event buffer.
+void json_segments_trace_free(void) {
+    json_segments_trace_stop();
+    free(json_segments_trace_buffer);
+    json_segments_trace_buffer = NULL;
+    json_segments_trace_capacity = 0;
+    atomic_store(&json_segments_trace_next, 0);
+}
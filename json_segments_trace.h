@@ -0,0 +1,94 @@
+// json_segments_trace.h
+
+/**
+ * @file json_segments_trace.h
+ * @brief In-memory recorder for lifecycle trace events and Chrome trace-event export.
+ *
+ * The recorder installs itself as current_json_segments_trace_function and stores events in a
+ * preallocated buffer; recording never allocates or blocks. The library must be compiled with
+ * -DJSON_SEGMENTS_TRACE for events to be produced. The exported file can be opened in
+ * chrome://tracing or https://ui.perfetto.dev: every message is an async span from its first
+ * segment to its removal from the table, with nested merge, parse and callback phases.
+ */
+
+#ifndef JSON_SEGMENTS_TRACE_H
+#define JSON_SEGMENTS_TRACE_H
+
+#include <stdio.h>
+#include "json_segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSON_SEGMENTS_TRACE_UID_CAPACITY
+/// Bytes of the uid stored per event, including the terminating NUL; longer uids are truncated.
+#define JSON_SEGMENTS_TRACE_UID_CAPACITY 48
+#endif
+
+/**
+ * @brief A single recorded trace event.
+ */
+typedef struct {
+    unsigned long long timestamp_ns;        ///< CLOCK_MONOTONIC timestamp in nanoseconds.
+    JsonSegmentsTraceEvent event;           ///< Lifecycle point.
+    int sequence_number;                    ///< Sequence number for JSON_SEGMENTS_TRACE_SEGMENT, 0 otherwise.
+    char unique_id[JSON_SEGMENTS_TRACE_UID_CAPACITY]; ///< Unique identifier (possibly truncated).
+} JsonSegmentsTraceRecord;
+
+/**
+ * @brief Allocate a buffer for capacity events and start recording.
+ *
+ * Events arriving after the buffer is full are counted and dropped. Calling it again discards
+ * the events recorded so far.
+ *
+ * @param capacity Maximum number of events to keep.
+ * @return 0 on success, -1 on invalid arguments or allocation failure.
+ */
+int json_segments_trace_start(size_t capacity);
+
+/**
+ * @brief Stop recording. The recorded events are kept until json_segments_trace_free().
+ */
+void json_segments_trace_stop(void);
+
+/**
+ * @brief Trace function storing an event in the recorder; installed by json_segments_trace_start().
+ *
+ * Safe to call from several threads at once.
+ */
+void json_segments_trace_record(JsonSegmentsTraceEvent event, const char *unique_id, int sequence_number, unsigned long long timestamp_ns);
+
+/**
+ * @brief Access the recorded events.
+ *
+ * @param count Set to the number of recorded events.
+ * @return Pointer to the events in recording order, or NULL if none were recorded.
+ */
+const JsonSegmentsTraceRecord *json_segments_trace_records(size_t *count);
+
+/**
+ * @brief Number of events dropped because the buffer was full.
+ */
+size_t json_segments_trace_dropped(void);
+
+/**
+ * @brief Write the recorded events as Chrome trace-event JSON.
+ *
+ * Stop recording first; events recorded concurrently with the export may be missing.
+ *
+ * @param out Destination file.
+ * @return 0 on success, -1 on invalid arguments or write error.
+ */
+int json_segments_trace_write_chrome(FILE *out);
+
+/**
+ * @brief Stop recording and release the event buffer.
+ */
+void json_segments_trace_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SEGMENTS_TRACE_H
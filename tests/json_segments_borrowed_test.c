@@ -0,0 +1,179 @@
+// json_segments_borrowed_test.c
+//
+// Checks that json_segments_context_add_borrowed() calls the release function
+// exactly once per buffer: right away for duplicate, invalid and inconsistent
+// segments and for single-frame messages, otherwise when the message is
+// merged (inline or on an executor), deleted, timed out or the context is
+// freed. Released buffers are overwritten, so a view used after its release
+// shows up as corrupted output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+typedef struct {
+    char data[64];
+    size_t length;
+    int released;
+} Packet;
+
+static int delivered;
+static char last[256];
+static time_t virtual_now;
+
+static void receive(cJSON *json, void *user_data) {
+    char *printed = cJSON_PrintUnformatted(json);
+
+    (void)user_data;
+    delivered++;
+    snprintf(last, sizeof(last), "%s", printed);
+    free(printed);
+}
+
+static time_t virtual_clock(void) {
+    return virtual_now;
+}
+
+static void release(void *release_context) {
+    Packet *packet = release_context;
+
+    packet->released++;
+    memset(packet->data, 'X', sizeof(packet->data));
+}
+
+// Lend a packet holding content to the context.
+static JsonSegmentsError add(JsonSegmentsContext *context, Packet *packet, const char *unique_id, int sequence_number, int total_segments,
+                             const char *content) {
+    packet->length = strlen(content);
+    packet->released = 0;
+    memcpy(packet->data, content, packet->length);
+    return json_segments_context_add_borrowed(context, unique_id, strlen(unique_id), sequence_number, total_segments, packet->data,
+                                              packet->length, release, packet);
+}
+
+static void test_dropped(JsonSegmentsContext *context) {
+    Packet packets[5];
+
+    // Segments the context does not keep are released before the call returns
+    CHECK(add(context, &packets[0], "d", 0, 2, "[") == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(add(context, &packets[1], "d", 3, 2, "[") == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(packets[0].released == 1 && packets[1].released == 1);
+
+    CHECK(add(context, &packets[2], "d", 1, 2, "[1,") == JSON_SEGMENTS_OK);
+    CHECK(add(context, &packets[3], "d", 1, 2, "[1,") == JSON_SEGMENTS_ERROR_DUPLICATE);
+    CHECK(add(context, &packets[4], "d", 2, 3, "2]") == JSON_SEGMENTS_ERROR_INCONSISTENT);
+    CHECK(packets[2].released == 0 && packets[3].released == 1 && packets[4].released == 1);
+
+    // The stored segment is released when the message completes
+    CHECK(add(context, &packets[3], "d", 2, 2, "2]") == JSON_SEGMENTS_OK);
+    CHECK(delivered == 1 && strcmp(last, "[1,2]") == 0);
+    CHECK(packets[2].released == 1 && packets[3].released == 1);
+}
+
+static void test_single_frame(JsonSegmentsContext *context) {
+    Packet packet;
+
+    CHECK(add(context, &packet, "s", 1, 1, "{\"single\":true}") == JSON_SEGMENTS_OK);
+    CHECK(delivered == 2 && strcmp(last, "{\"single\":true}") == 0);
+    CHECK(packet.released == 1);
+}
+
+static void test_merged(JsonSegmentsContext *context) {
+    static const char *const parts[] = { "{\"text\":\"a segment long enough ", "to be stored on the heap if it ",
+                                         "were copied, which it is not\"}" };
+    Packet packets[3];
+
+    // Out of order, so the views are concatenated in sequence order at merge time
+    CHECK(add(context, &packets[2], "m", 3, 3, parts[2]) == JSON_SEGMENTS_OK);
+    CHECK(add(context, &packets[0], "m", 1, 3, parts[0]) == JSON_SEGMENTS_OK);
+    CHECK(packets[0].released == 0 && packets[2].released == 0);
+    CHECK(add(context, &packets[1], "m", 2, 3, parts[1]) == JSON_SEGMENTS_OK);
+    CHECK(delivered == 3 && strcmp(last, "{\"text\":\"a segment long enough to be stored on the heap if it were copied, which it is not\"}") == 0);
+    for (int i = 0; i < 3; i++) {
+        CHECK(packets[i].released == 1);
+    }
+}
+
+static void test_removed(JsonSegmentsContext *context) {
+    Packet deleted[2];
+    Packet timed_out;
+    Packet freed[2];
+
+    CHECK(add(context, &deleted[0], "del", 1, 3, "[1,") == JSON_SEGMENTS_OK);
+    CHECK(add(context, &deleted[1], "del", 2, 3, "2,") == JSON_SEGMENTS_OK);
+    CHECK(json_segments_context_delete_segments(context, "del", 3) == JSON_SEGMENTS_OK);
+    CHECK(deleted[0].released == 1 && deleted[1].released == 1);
+
+    virtual_now = 1000;
+    CHECK(add(context, &timed_out, "old", 1, 2, "[") == JSON_SEGMENTS_OK);
+    virtual_now = 1100;
+    CHECK(add(context, &freed[0], "kept", 1, 3, "[7,") == JSON_SEGMENTS_OK);
+    CHECK(add(context, &freed[1], "kept", 3, 3, "9]") == JSON_SEGMENTS_OK);
+    json_segments_context_check_timeout(context, 30);
+    CHECK(timed_out.released == 1);
+    CHECK(freed[0].released == 0 && freed[1].released == 0);
+
+    json_segments_context_free(context);
+    CHECK(freed[0].released == 1 && freed[1].released == 1);
+    CHECK(timed_out.released == 1 && deleted[0].released == 1);
+}
+
+typedef struct {
+    JsonSegmentsTaskFunction tasks[8];
+    void *arguments[8];
+    int count;
+} DeferredExecutor;
+
+static int defer(JsonSegmentsTaskFunction task, void *argument, void *executor_context) {
+    DeferredExecutor *executor = executor_context;
+
+    CHECK(executor->count < 8);
+    executor->tasks[executor->count] = task;
+    executor->arguments[executor->count++] = argument;
+    return 0;
+}
+
+static void test_executor(JsonSegmentsContext *context) {
+    DeferredExecutor executor = { .count = 0 };
+    Packet packets[2];
+
+    // The views must stay valid until the task has merged the message
+    json_segments_context_set_executor(context, defer, &executor);
+    CHECK(add(context, &packets[0], "e", 1, 2, "[\"deferred\",") == JSON_SEGMENTS_OK);
+    CHECK(add(context, &packets[1], "e", 2, 2, "\"merge\"]") == JSON_SEGMENTS_OK);
+    CHECK(executor.count == 1 && context->segments_count == 0);
+    for (int i = 0; i < executor.count; i++) {
+        executor.tasks[i](executor.arguments[i]);
+    }
+    CHECK(strcmp(last, "[\"deferred\",\"merge\"]") == 0);
+    CHECK(packets[0].released == 1 && packets[1].released == 1);
+    json_segments_context_set_executor(context, NULL, NULL);
+}
+
+int main(void) {
+    JsonSegmentsContext context;
+
+    current_json_segments_clock_function = virtual_clock;
+    json_segments_context_init(&context, receive, NULL);
+
+    test_dropped(&context);
+    test_single_frame(&context);
+    test_merged(&context);
+    test_removed(&context);
+    test_executor(&context);
+
+    json_segments_context_free(&context);
+    printf("borrowed tests passed\n");
+    return 0;
+}
@@ -0,0 +1,241 @@
+// json_segments_concurrent_test.c
+//
+// Feeds the segments of the same messages from several threads at once, each
+// in its own order, once with every segment sent by one thread and once with
+// every segment sent by all of them, while another thread walks the table with
+// json_segments_concurrent_for_each and json_segments_concurrent_check_timeout.
+// Every message must reach the processing function exactly once. Then checks
+// timeouts, deletes and the for_each snapshot on a virtual clock.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+#include "json_segments_concurrent.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+#define THREADS 4
+#define MESSAGES 400
+#define SEGMENTS 5
+
+typedef struct {
+    char unique_id[16];
+    char text[SEGMENTS * 16 + 1];
+    size_t segment_length;
+} Message;
+
+static Message messages[MESSAGES];
+static atomic_int delivered[MESSAGES];
+static atomic_int corrupted;
+static atomic_int feeding;
+
+static void receive(cJSON *json, void *user_data) {
+    cJSON *id = cJSON_GetObjectItem(json, "id");
+    cJSON *pad = cJSON_GetObjectItem(json, "pad");
+
+    (void)user_data;
+    if (id == NULL || pad == NULL || id->valueint < 0 || id->valueint >= MESSAGES) {
+        atomic_fetch_add(&corrupted, 1);
+        return;
+    }
+    atomic_fetch_add(&delivered[id->valueint], 1);
+}
+
+// Every message is padded to SEGMENTS segments of equal length.
+static void make_messages(void) {
+    for (int i = 0; i < MESSAGES; i++) {
+        Message *message = &messages[i];
+        int length = snprintf(message->text, sizeof(message->text), "{\"id\":%d,\"pad\":\"", i);
+        size_t total = sizeof(message->text) - 1;
+
+        snprintf(message->unique_id, sizeof(message->unique_id), "msg-%d", i);
+        memset(message->text + length, 'a' + i % 26, total - (size_t)length - 2);
+        memcpy(message->text + total - 2, "\"}", 3);
+        message->segment_length = total / SEGMENTS;
+    }
+}
+
+typedef struct {
+    JsonSegmentsConcurrentTable *table;
+    unsigned int seed;
+    int duplicates;
+} Feeder;
+
+// Add segments in an order of the thread's own: without duplicates each segment
+// goes to exactly one thread, with duplicates every thread adds all segments
+// except the first.
+static void *feed(void *argument) {
+    Feeder *feeder = argument;
+    static int order[THREADS][MESSAGES * SEGMENTS];
+    int *mine = order[feeder->seed];
+    unsigned int state = feeder->seed * 2654435761u + 1;
+    int count = 0;
+
+    for (int i = 0; i < MESSAGES * SEGMENTS; i++) {
+        if (feeder->duplicates ? i % SEGMENTS != 0 : (i / SEGMENTS + i % SEGMENTS) % THREADS == (int)feeder->seed) {
+            mine[count++] = i;
+        }
+    }
+    for (int i = count - 1; i > 0; i--) {
+        state = state * 1103515245u + 12345u;
+        int j = (int)((state >> 8) % (unsigned int)(i + 1));
+        int swap = mine[i];
+        mine[i] = mine[j];
+        mine[j] = swap;
+    }
+    for (int i = 0; i < count; i++) {
+        const Message *message = &messages[mine[i] / SEGMENTS];
+        int sequence_number = mine[i] % SEGMENTS + 1;
+        JsonSegmentsError result =
+            json_segments_concurrent_add(feeder->table, message->unique_id, strlen(message->unique_id), sequence_number, SEGMENTS,
+                                         message->text + (size_t)(sequence_number - 1) * message->segment_length, message->segment_length);
+        CHECK(result == JSON_SEGMENTS_OK || (feeder->duplicates && result == JSON_SEGMENTS_ERROR_DUPLICATE));
+    }
+    return NULL;
+}
+
+static void count_entry(const JsonSegmentsConcurrentEntry *entry, void *user_data) {
+    int *visited = user_data;
+
+    // An entry is visible before its first segment is counted
+    CHECK(entry->received_segments >= 0 && entry->received_segments <= entry->total_segments);
+    CHECK(entry->total_segments == SEGMENTS || entry->total_segments == 3);
+    CHECK(entry->unique_id_length > 0);
+    (*visited)++;
+}
+
+// Walk the table while the feeders run; the timeout is long enough to evict nothing.
+static void *monitor(void *argument) {
+    JsonSegmentsConcurrentTable *table = argument;
+
+    while (atomic_load(&feeding)) {
+        int visited = 0;
+        json_segments_concurrent_for_each(table, count_entry, &visited);
+        json_segments_concurrent_check_timeout(table, 3600);
+    }
+    return NULL;
+}
+
+// Run the feeders and the walker to completion.
+static void run_feeders(JsonSegmentsConcurrentTable *table, int duplicates) {
+    pthread_t feeders[THREADS];
+    Feeder arguments[THREADS];
+    pthread_t walker;
+
+    atomic_store(&feeding, 1);
+    CHECK(pthread_create(&walker, NULL, monitor, table) == 0);
+    for (int i = 0; i < THREADS; i++) {
+        arguments[i] = (Feeder){ .table = table, .seed = (unsigned int)i, .duplicates = duplicates };
+        CHECK(pthread_create(&feeders[i], NULL, feed, &arguments[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        CHECK(pthread_join(feeders[i], NULL) == 0);
+    }
+    atomic_store(&feeding, 0);
+    CHECK(pthread_join(walker, NULL) == 0);
+}
+
+static void check_delivered(int expected) {
+    CHECK(atomic_load(&corrupted) == 0);
+    for (int i = 0; i < MESSAGES; i++) {
+        CHECK(atomic_load(&delivered[i]) == expected);
+    }
+}
+
+static void test_exactly_once(void) {
+    JsonSegmentsConcurrentTable *table = json_segments_concurrent_create(64, receive, NULL);
+
+    // The threads race to add the last segment of each message
+    CHECK(table != NULL);
+    run_feeders(table, 0);
+    check_delivered(1);
+    CHECK(json_segments_concurrent_count(table) == 0);
+
+    // Each segment arrives from every thread; all but one copy are duplicates
+    run_feeders(table, 1);
+    check_delivered(1);
+    CHECK(json_segments_concurrent_count(table) == MESSAGES);
+    for (int i = 0; i < MESSAGES; i++) {
+        const Message *message = &messages[i];
+        CHECK(json_segments_concurrent_add(table, message->unique_id, strlen(message->unique_id), 1, SEGMENTS, message->text,
+                                           message->segment_length) == JSON_SEGMENTS_OK);
+    }
+    check_delivered(2);
+    CHECK(json_segments_concurrent_count(table) == 0);
+
+    json_segments_concurrent_free(table);
+    json_segments_concurrent_reclaim();
+}
+
+static time_t virtual_now;
+
+static time_t virtual_clock(void) {
+    return virtual_now;
+}
+
+static void test_timeout_and_delete(void) {
+    JsonSegmentsConcurrentTable *table = json_segments_concurrent_create(4, receive, NULL);
+    int visited = 0;
+
+    CHECK(table != NULL);
+    current_json_segments_clock_function = virtual_clock;
+    virtual_now = 1000;
+
+    // Out-of-range sequence numbers never enter the table
+    CHECK(json_segments_concurrent_add(table, "x", 1, 0, 3, "[", 1) == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(json_segments_concurrent_add(table, "x", 1, 4, 3, "[", 1) == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+
+    // More uids than buckets, so the walks cross list links
+    for (int i = 0; i < 12; i++) {
+        char unique_id[8];
+        int length = snprintf(unique_id, sizeof(unique_id), "p%d", i);
+        CHECK(json_segments_concurrent_add(table, unique_id, (size_t)length, 1, 3, "[1,", 3) == JSON_SEGMENTS_OK);
+    }
+    CHECK(json_segments_concurrent_add(table, "p0", 2, 1, 3, "[1,", 3) == JSON_SEGMENTS_ERROR_DUPLICATE);
+    json_segments_concurrent_for_each(table, count_entry, &visited);
+    CHECK(visited == 12 && json_segments_concurrent_count(table) == 12);
+
+    CHECK(json_segments_concurrent_delete_segments(table, "p3", 2) == JSON_SEGMENTS_OK);
+    CHECK(json_segments_concurrent_delete_segments(table, "p3", 2) == JSON_SEGMENTS_ERROR_NOT_FOUND);
+    CHECK(json_segments_concurrent_count(table) == 11);
+
+    // Only the messages idle for longer than the timeout are evicted
+    virtual_now = 1030;
+    CHECK(json_segments_concurrent_add(table, "p5", 2, 2, 3, "2,", 2) == JSON_SEGMENTS_OK);
+    CHECK(json_segments_concurrent_add(table, "p7", 2, 2, 3, "2,", 2) == JSON_SEGMENTS_OK);
+    virtual_now = 1050;
+    json_segments_concurrent_check_timeout(table, 30);
+    CHECK(json_segments_concurrent_count(table) == 2);
+    visited = 0;
+    json_segments_concurrent_for_each(table, count_entry, &visited);
+    CHECK(visited == 2);
+
+    CHECK(json_segments_concurrent_add(table, "p5", 2, 3, 3, "3]", 2) == JSON_SEGMENTS_OK);
+    virtual_now = 1100;
+    json_segments_concurrent_check_timeout(table, 30);
+    CHECK(json_segments_concurrent_count(table) == 0);
+
+    current_json_segments_clock_function = NULL;
+    json_segments_concurrent_free(table);
+    json_segments_concurrent_reclaim();
+}
+
+int main(void) {
+    make_messages();
+    test_exactly_once();
+    test_timeout_and_delete();
+
+    printf("concurrent tests passed\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+// json_segments_handle_test.c
+//
+// Checks the slot map behind JsonSegmentsHandle: a handle resolves while its
+// message is buffered, however the table is rearranged, and goes stale once
+// the message is merged, deleted by handle or uid, or timed out. A slot reused
+// for a new message has a new generation, so the old handle does not resolve
+// to the new message, and json_segments_context_add_by_handle() returns
+// JSON_SEGMENTS_ERROR_NOT_FOUND for a stale handle.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+static int delivered;
+static char last[64];
+static time_t virtual_now;
+
+static void receive(cJSON *json, void *user_data) {
+    char *printed = cJSON_PrintUnformatted(json);
+
+    (void)user_data;
+    delivered++;
+    snprintf(last, sizeof(last), "%s", printed);
+    free(printed);
+}
+
+static time_t virtual_clock(void) {
+    return virtual_now;
+}
+
+static JsonSegmentsHandle add_handle(JsonSegmentsContext *context, const char *unique_id, int sequence_number, int total_segments,
+                                     const char *json_segment) {
+    JsonSegmentsHandle handle = JSON_SEGMENTS_HANDLE_INVALID;
+
+    CHECK(json_segments_context_add_handle(context, unique_id, strlen(unique_id), sequence_number, total_segments, json_segment,
+                                           strlen(json_segment), &handle) == JSON_SEGMENTS_OK);
+    return handle;
+}
+
+// A stale handle resolves to nothing and every operation on it reports NOT_FOUND.
+static void check_stale(JsonSegmentsContext *context, JsonSegmentsHandle handle) {
+    int count = context->segments_count;
+
+    CHECK(json_segments_context_entry(context, handle) == NULL);
+    CHECK(json_segments_context_add_by_handle(context, handle, 1, 2, "[", 1) == JSON_SEGMENTS_ERROR_NOT_FOUND);
+    CHECK(json_segments_context_delete_handle(context, handle) == JSON_SEGMENTS_ERROR_NOT_FOUND);
+    CHECK(context->segments_count == count);
+}
+
+static void test_stale_after_merge(JsonSegmentsContext *context) {
+    JsonSegmentsHandle handle = add_handle(context, "merged", 1, 3, "[1,");
+
+    CHECK(handle != JSON_SEGMENTS_HANDLE_INVALID);
+    CHECK(json_segments_context_find_handle(context, "merged", 6) == handle);
+    CHECK(json_segments_context_add_by_handle(context, handle, 2, 3, "2,", 2) == JSON_SEGMENTS_OK);
+
+    // Out-of-range sequence numbers are rejected before the handle is used
+    CHECK(json_segments_context_add_by_handle(context, handle, 0, 3, "0", 1) == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(json_segments_context_add_by_handle(context, handle, 4, 3, "4", 1) == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(json_segments_context_entry(context, handle)->received_segments == 2);
+
+    CHECK(json_segments_context_add_by_handle(context, handle, 3, 3, "3]", 2) == JSON_SEGMENTS_OK);
+    CHECK(delivered == 1 && strcmp(last, "[1,2,3]") == 0);
+    CHECK(json_segments_context_find_handle(context, "merged", 6) == JSON_SEGMENTS_HANDLE_INVALID);
+    check_stale(context, handle);
+}
+
+static void test_stale_after_delete(JsonSegmentsContext *context) {
+    JsonSegmentsHandle by_handle = add_handle(context, "by-handle", 1, 2, "[");
+    JsonSegmentsHandle by_uid = add_handle(context, "by-uid", 1, 2, "[");
+
+    CHECK(json_segments_context_delete_handle(context, by_handle) == JSON_SEGMENTS_OK);
+    check_stale(context, by_handle);
+    CHECK(json_segments_context_entry(context, by_uid) != NULL);
+
+    CHECK(json_segments_context_delete_segments(context, "by-uid", 6) == JSON_SEGMENTS_OK);
+    check_stale(context, by_uid);
+    CHECK(context->segments_count == 0);
+}
+
+static void test_stale_after_timeout(JsonSegmentsContext *context) {
+    virtual_now = 1000;
+    JsonSegmentsHandle idle = add_handle(context, "idle", 1, 2, "[");
+    JsonSegmentsHandle active = add_handle(context, "active", 1, 3, "[5,");
+
+    virtual_now = 1050;
+    CHECK(json_segments_context_add_by_handle(context, active, 2, 3, "6,", 2) == JSON_SEGMENTS_OK);
+    virtual_now = 1070;
+    json_segments_context_check_timeout(context, 30);
+    check_stale(context, idle);
+
+    // The surviving entry may have moved; its handle follows it
+    JsonSegmentInfo *entry = json_segments_context_entry(context, active);
+    CHECK(entry != NULL && entry->received_segments == 2 && entry->total_segments == 3);
+    CHECK(json_segments_context_add_by_handle(context, active, 3, 3, "7]", 2) == JSON_SEGMENTS_OK);
+    CHECK(strcmp(last, "[5,6,7]") == 0);
+    check_stale(context, active);
+}
+
+static void test_reused_slot(JsonSegmentsContext *context) {
+    JsonSegmentsHandle old = add_handle(context, "old", 1, 2, "[");
+
+    CHECK(json_segments_context_delete_handle(context, old) == JSON_SEGMENTS_OK);
+    JsonSegmentsHandle reused = add_handle(context, "new", 1, 2, "[8,");
+
+    // Same slot, newer generation
+    CHECK((uint32_t)reused == (uint32_t)old && reused != old);
+    check_stale(context, old);
+    CHECK(json_segments_context_entry(context, reused)->received_segments == 1);
+    CHECK(json_segments_context_add_by_handle(context, reused, 2, 2, "9]", 2) == JSON_SEGMENTS_OK);
+    CHECK(strcmp(last, "[8,9]") == 0);
+    check_stale(context, reused);
+}
+
+// Deleting every other message moves entries around; the remaining handles must follow.
+static void test_many_handles(JsonSegmentsContext *context) {
+    enum { COUNT = 200 };
+    JsonSegmentsHandle handles[COUNT];
+
+    for (int i = 0; i < COUNT; i++) {
+        char unique_id[16];
+        snprintf(unique_id, sizeof(unique_id), "many-%d", i);
+        handles[i] = add_handle(context, unique_id, 1, i % 5 + 2, "[");
+    }
+    for (int i = 0; i < COUNT; i += 2) {
+        CHECK(json_segments_context_delete_handle(context, handles[i]) == JSON_SEGMENTS_OK);
+    }
+    for (int i = 0; i < COUNT; i++) {
+        JsonSegmentInfo *entry = json_segments_context_entry(context, handles[i]);
+        if (i % 2 == 0) {
+            CHECK(entry == NULL);
+        } else {
+            CHECK(entry != NULL && entry->total_segments == i % 5 + 2);
+        }
+    }
+    CHECK(context->segments_count == COUNT / 2);
+    CHECK(json_segments_context_entry(context, JSON_SEGMENTS_HANDLE_INVALID) == NULL);
+}
+
+int main(void) {
+    JsonSegmentsContext context;
+
+    current_json_segments_clock_function = virtual_clock;
+    json_segments_context_init(&context, receive, NULL);
+
+    test_stale_after_merge(&context);
+    test_stale_after_delete(&context);
+    test_stale_after_timeout(&context);
+    test_reused_slot(&context);
+    test_many_handles(&context);
+
+    json_segments_context_free(&context);
+    printf("handle tests passed\n");
+    return 0;
+}
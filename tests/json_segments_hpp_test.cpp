@@ -0,0 +1,181 @@
+// json_segments_hpp_test.cpp
+//
+// Exercises the C++ wrapper: a Reassembler keeps its partial messages when
+// moved or move-assigned and rethrows an exception thrown by its callback from
+// the ingest() that completed the message; a copied or moved Splitter continues
+// with the same frames as the original, also after the original is gone.
+
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cJSON.h>
+
+#include "json_segments.hpp"
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1);                                                                    \
+        }                                                                                    \
+    } while (0)
+
+static const int max_length = 80;
+
+static std::string make_payload() {
+    std::string payload = "{\"name\":\"hpp \\\"test\\\"\",\"values\":[";
+    for (int i = 0; i < 60; i++) {
+        payload += std::to_string(i * 37) + (i < 59 ? "," : "]}");
+    }
+    return payload;
+}
+
+// All remaining frames of a splitter.
+static std::vector<std::string> drain(json_segments::Splitter &splitter) {
+    std::vector<std::byte> buffer(splitter.frame_capacity());
+    std::vector<std::string> frames;
+    CHECK(splitter.for_each_frame(buffer, [&](std::string_view frame) { frames.emplace_back(frame); }) == 0);
+    return frames;
+}
+
+static std::vector<std::string> split(const std::string &payload, const char *uid) {
+    json_segments::Splitter splitter(payload, uid, max_length);
+    CHECK(splitter.valid());
+    return drain(splitter);
+}
+
+static std::string print(cJSON *json) {
+    char *printed = cJSON_PrintUnformatted(json);
+    std::string result(printed);
+    cJSON_free(printed);
+    return result;
+}
+
+static void test_reassembler_move(const std::string &payload, const std::string &expected) {
+    std::vector<std::string> received;
+    auto callback = [&received](cJSON *json) { received.push_back(print(json)); };
+    std::vector<std::string> first = split(payload, "first");
+    std::vector<std::string> second = split(payload, "second");
+    CHECK(first.size() > 2 && second.size() == first.size());
+
+    json_segments::Reassembler receiver(callback);
+    for (std::size_t i = 1; i < first.size(); i++) {
+        CHECK(receiver.ingest(first[i]) == JSON_SEGMENTS_OK);
+    }
+    CHECK(receiver.size() == 1 && received.empty());
+
+    // The partial message moves with the table, and the moved-from object is empty but usable
+    json_segments::Reassembler moved(std::move(receiver));
+    CHECK(moved.size() == 1 && receiver.size() == 0);
+    CHECK(moved.ingest(first[0]) == JSON_SEGMENTS_OK);
+    CHECK(received.size() == 1 && received[0] == expected);
+    CHECK(receiver.ingest(second[0]) == JSON_SEGMENTS_OK && receiver.size() == 1);
+
+    for (std::size_t i = 1; i < second.size(); i++) {
+        CHECK(receiver.ingest(second[i]) == JSON_SEGMENTS_OK);
+    }
+    CHECK(received.size() == 2 && received[1] == expected && receiver.size() == 0);
+}
+
+// Lambdas cannot be assigned, so move assignment is checked with a function object.
+struct Collector {
+    std::vector<std::string> *received;
+    void operator()(cJSON *json) const { received->push_back(print(json)); }
+};
+
+static void test_reassembler_move_assignment(const std::string &payload, const std::string &expected) {
+    std::vector<std::string> received;
+    std::vector<std::string> first = split(payload, "first");
+    std::vector<std::string> second = split(payload, "second");
+
+    json_segments::Reassembler<Collector> receiver(Collector{ &received });
+    json_segments::Reassembler<Collector> assigned(Collector{ &received });
+    CHECK(receiver.ingest(second[0]) == JSON_SEGMENTS_OK);
+    CHECK(assigned.ingest(first[0]) == JSON_SEGMENTS_OK);
+
+    // The target's own table is dropped and replaced by the source's
+    assigned = std::move(receiver);
+    CHECK(assigned.size() == 1 && receiver.size() == 0);
+    for (std::size_t i = 1; i < first.size(); i++) {
+        CHECK(assigned.ingest(first[i]) == JSON_SEGMENTS_OK);
+    }
+    CHECK(received.empty() && assigned.size() == 2);
+    for (std::size_t i = 1; i < second.size(); i++) {
+        CHECK(assigned.ingest(second[i]) == JSON_SEGMENTS_OK);
+    }
+    CHECK(received.size() == 1 && received[0] == expected);
+}
+
+static void test_reassembler_exception(const std::string &payload) {
+    int calls = 0;
+    json_segments::Reassembler receiver([&calls](cJSON *) {
+        if (++calls == 1) {
+            throw std::runtime_error("callback failed");
+        }
+    });
+    std::vector<std::string> frames = split(payload, "throws");
+
+    for (std::size_t i = 0; i + 1 < frames.size(); i++) {
+        CHECK(receiver.ingest(frames[i]) == JSON_SEGMENTS_OK);
+    }
+    bool thrown = false;
+    try {
+        receiver.ingest(frames.back());
+    } catch (const std::runtime_error &error) {
+        thrown = std::string(error.what()) == "callback failed";
+    }
+    CHECK(thrown && calls == 1 && receiver.size() == 0);
+
+    // The exception is not rethrown again, and the next message is delivered normally
+    for (const std::string &frame : frames) {
+        CHECK(receiver.ingest(frame) == JSON_SEGMENTS_OK);
+    }
+    CHECK(calls == 2);
+}
+
+static void test_splitter_copy_and_move(const std::string &payload) {
+    const std::vector<std::string> expected = split(payload, "splitter-uid");
+    std::optional<json_segments::Splitter> original(std::in_place, payload, std::string("splitter-uid"), max_length);
+    std::vector<std::byte> buffer(original->frame_capacity());
+
+    // Take two frames, then continue from copies and moves of the original
+    for (int i = 0; i < 2; i++) {
+        int length = original->next(buffer);
+        CHECK(length > 0 && std::string(reinterpret_cast<const char *>(buffer.data()), static_cast<std::size_t>(length)) == expected[i]);
+    }
+    json_segments::Splitter copied(*original);
+    json_segments::Splitter assigned(payload, "other", max_length);
+    assigned = *original;
+    json_segments::Splitter moved(std::move(*original));
+    original.reset();
+
+    std::vector<std::string> rest(expected.begin() + 2, expected.end());
+    CHECK(copied.position() == 3 && drain(copied) == rest);
+    CHECK(drain(assigned) == rest);
+    json_segments::Splitter move_assigned(payload, "other", max_length);
+    move_assigned = std::move(moved);
+    CHECK(drain(move_assigned) == rest);
+
+    // A copy repositioned with seek() produces the same frames from there
+    json_segments::Splitter rewound(move_assigned);
+    CHECK(rewound.seek(1) == 0 && drain(rewound) == expected);
+}
+
+int main() {
+    const std::string payload = make_payload();
+    cJSON *parsed = cJSON_Parse(payload.c_str());
+    CHECK(parsed != nullptr);
+    const std::string expected = print(parsed);
+    cJSON_Delete(parsed);
+
+    test_reassembler_move(payload, expected);
+    test_reassembler_move_assignment(payload, expected);
+    test_reassembler_exception(payload);
+    test_splitter_copy_and_move(payload);
+
+    std::printf("hpp tests passed\n");
+    return 0;
+}
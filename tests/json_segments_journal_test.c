@@ -0,0 +1,166 @@
+// json_segments_journal_test.c
+//
+// Records partial messages in a journal, drops the context as a crash would,
+// and checks that json_segments_journal_recover rebuilds the table: completed
+// and deleted messages stay gone, a torn or corrupt record ends the replay and
+// is cut off, compaction keeps the partial messages, and a recovered message
+// completes with the original content once its missing segments arrive.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+#include "json_segments_journal.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+static int delivered;
+static char last[256];
+
+static void receive(cJSON *json, void *user_data) {
+    char *printed = cJSON_PrintUnformatted(json);
+
+    (void)user_data;
+    delivered++;
+    snprintf(last, sizeof(last), "%s", printed);
+    free(printed);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+// Start a context that records to the journal at path and replay it.
+static JsonSegmentsJournal *restart(const char *path, JsonSegmentsContext *context, int expected_messages) {
+    JsonSegmentsJournal *journal = json_segments_journal_open(path, 0);
+
+    CHECK(journal != NULL);
+    json_segments_context_init(context, receive, NULL);
+    json_segments_context_set_persist(context, json_segments_journal_persist, journal);
+    CHECK(json_segments_journal_recover(journal, context) == expected_messages);
+    return journal;
+}
+
+// Drop the context without recording removals, as a crash would.
+static void crash(JsonSegmentsJournal *journal, JsonSegmentsContext *context) {
+    json_segments_context_free(context);
+    json_segments_journal_close(journal);
+}
+
+static void test_recover_and_compact(const char *path) {
+    JsonSegmentsContext context;
+    JsonSegmentsJournal *journal = restart(path, &context, 0);
+    int missing[4];
+
+    // "a" stays partial, "b" completes and "cc" is deleted
+    json_segments_context_add(&context, "a", 1, 1, 4, "{\"x\":", 5);
+    json_segments_context_add(&context, "a", 1, 3, 4, "3", 1);
+    json_segments_context_add(&context, "b", 1, 1, 2, "[1,", 3);
+    json_segments_context_add(&context, "b", 1, 2, 2, "2]", 2);
+    CHECK(delivered == 1 && strcmp(last, "[1,2]") == 0);
+    json_segments_context_add(&context, "cc", 2, 1, 2, "[", 1);
+    json_segments_context_delete_segments(&context, "cc", 2);
+    CHECK(json_segments_context_missing(&context, "a", 1, missing, 4) == 2 && missing[0] == 2 && missing[1] == 4);
+    crash(journal, &context);
+
+    // A record torn by the crash is cut off
+    off_t intact = file_size(path);
+    int fd = open(path, O_WRONLY | O_APPEND);
+    CHECK(fd >= 0 && write(fd, "\x01\x02\x03\x04\x50\x00\x00\x00" "abc", 11) == 11);
+    close(fd);
+    journal = restart(path, &context, 1);
+    CHECK(file_size(path) == intact);
+    CHECK(json_segments_context_missing(&context, "a", 1, missing, 1) == 2 && missing[0] == 2);
+
+    // Compaction drops the records of "b" and "cc"
+    CHECK(json_segments_journal_compact(journal, &context) == 0);
+    CHECK(file_size(path) < intact);
+    json_segments_context_add(&context, "a", 1, 2, 4, "{\"y\":", 5);
+    crash(journal, &context);
+
+    journal = restart(path, &context, 1);
+    CHECK(json_segments_context_missing(&context, "a", 1, missing, 4) == 1 && missing[0] == 4);
+    json_segments_context_add(&context, "a", 1, 4, 4, "}}", 2);
+    CHECK(delivered == 2 && strcmp(last, "{\"x\":{\"y\":3}}") == 0);
+    crash(journal, &context);
+
+    journal = restart(path, &context, 0);
+    crash(journal, &context);
+    unlink(path);
+}
+
+static void test_corrupt_record(const char *path) {
+    JsonSegmentsContext context;
+    JsonSegmentsJournal *journal = restart(path, &context, 0);
+
+    json_segments_context_add(&context, "p", 1, 1, 3, "[1,", 3);
+    off_t first = file_size(path);
+    json_segments_context_add(&context, "q", 1, 1, 3, "[2,", 3);
+    crash(journal, &context);
+
+    // Flip a byte of the second record's segment: its checksum no longer matches
+    int fd = open(path, O_RDWR);
+    CHECK(fd >= 0 && pwrite(fd, "Z", 1, file_size(path) - 1) == 1);
+    close(fd);
+    journal = restart(path, &context, 1);
+    CHECK(file_size(path) == first);
+    CHECK(json_segments_context_missing(&context, "q", 1, NULL, 0) == -1);
+    crash(journal, &context);
+
+    // A file that is not a journal is refused
+    fd = open(path, O_WRONLY | O_TRUNC);
+    CHECK(fd >= 0 && write(fd, "not a journal", 13) == 13);
+    close(fd);
+    CHECK(json_segments_journal_open(path, 0) == NULL);
+    unlink(path);
+}
+
+static void test_spilled_message(const char *path, const char *directory) {
+    JsonSegmentsContext context;
+    JsonSegmentsJournal *journal = restart(path, &context, 0);
+    int missing[4];
+
+    // Above the threshold the message is kept in a file; compaction reads it back
+    json_segments_context_set_spill(&context, directory, 8, NULL, NULL);
+    json_segments_context_add(&context, "s", 1, 5, 5, "9]", 2);
+    json_segments_context_add(&context, "s", 1, 1, 5, "[1,", 3);
+    json_segments_context_add(&context, "s", 1, 3, 5, "5,7", 3);
+    CHECK(json_segments_context_missing(&context, "s", 1, missing, 4) == 2 && missing[0] == 2 && missing[1] == 4);
+    CHECK(json_segments_journal_compact(journal, &context) == 0);
+    crash(journal, &context);
+
+    journal = restart(path, &context, 1);
+    json_segments_context_add(&context, "s", 1, 2, 5, "3,4", 3);
+    json_segments_context_add(&context, "s", 1, 4, 5, ",8,", 3);
+    CHECK(strcmp(last, "[1,3,45,7,8,9]") == 0);
+    crash(journal, &context);
+    unlink(path);
+}
+
+int main(void) {
+    char directory[] = "/tmp/json_segments_journal_test-XXXXXX";
+    char path[sizeof(directory) + 16];
+
+    CHECK(mkdtemp(directory) != NULL);
+    snprintf(path, sizeof(path), "%s/journal", directory);
+
+    test_recover_and_compact(path);
+    test_corrupt_record(path);
+    test_spilled_message(path, directory);
+
+    CHECK(rmdir(directory) == 0);
+    printf("journal tests passed\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+// json_segments_roundtrip_test.c
+//
+// Splits JSON payloads with json_segments_split_string and with a
+// JsonSegmentsIterator, checks that both produce the same frames, and feeds
+// the frames to json_segments_context_parse_raw in order, reversed and with
+// every frame sent twice. Each run must deliver the original JSON exactly once,
+// except that both copies of a single-frame message are delivered.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+typedef struct {
+    int delivered;
+    char *printed;
+} Received;
+
+static void receive(cJSON *json, void *user_data) {
+    Received *received = user_data;
+
+    received->delivered++;
+    free(received->printed);
+    received->printed = cJSON_PrintUnformatted(json);
+}
+
+// A JSON object whose string content needs escaping: quotes, backslashes,
+// control characters and multi-byte UTF-8.
+static char *make_payload(size_t length) {
+    static const char *const pieces[] = { "plain text ", "\\\"quoted\\\" ", "back\\\\slash ", "tab\\t newline\\n ", "\xc3\xa9t\xc3\xa9 " };
+    char *payload = malloc(length + 64);
+    size_t used = (size_t)sprintf(payload, "{\"id\":7,\"text\":\"");
+
+    for (size_t i = 0; used + 16 < length; i++) {
+        const char *piece = pieces[i % (sizeof(pieces) / sizeof(pieces[0]))];
+        memcpy(payload + used, piece, strlen(piece));
+        used += strlen(piece);
+    }
+    strcpy(payload + used, "\",\"n\":[1,2,3]}");
+    return payload;
+}
+
+// Feed frames in the given order and check that the payload arrives as often as expected.
+static void check_reassembly(char **frames, const int *order, int order_count, const char *expected, int deliveries) {
+    JsonSegmentsContext context;
+    Received received = { 0, NULL };
+
+    json_segments_context_init(&context, receive, &received);
+    for (int i = 0; i < order_count; i++) {
+        JsonSegmentsError result = json_segments_context_parse_raw(&context, frames[order[i]], strlen(frames[order[i]]));
+        CHECK(result == JSON_SEGMENTS_OK || result == JSON_SEGMENTS_ERROR_DUPLICATE);
+    }
+    CHECK(received.delivered == deliveries);
+    CHECK(received.printed != NULL && strcmp(received.printed, expected) == 0);
+
+    free(received.printed);
+    json_segments_context_free(&context);
+}
+
+static void check_payload(size_t length, int max_length) {
+    const char *uid = "roundtrip-uid";
+    char *payload = make_payload(length);
+    cJSON *parsed = cJSON_Parse(payload);
+    CHECK(parsed != NULL);
+    char *expected = cJSON_PrintUnformatted(parsed);
+    cJSON_Delete(parsed);
+
+    cJSON **segments = json_segments_split_string(payload, uid, max_length);
+    CHECK(segments != NULL && segments[0] != NULL);
+    int count = cJSON_GetObjectItem(segments[0], "abs")->valueint;
+
+    JsonSegmentsIterator iterator;
+    CHECK(json_segments_iterator_init(&iterator, payload, strlen(payload), uid, max_length) == 0);
+    CHECK(iterator.total_segments == count);
+    size_t capacity = json_segments_frame_capacity(uid, iterator.segment_length, iterator.total_segments);
+
+    char **frames = calloc((size_t)count, sizeof(char *));
+    for (int i = 0; i < count; i++) {
+        frames[i] = malloc(capacity);
+        int frame_length = json_segments_iterator_next(&iterator, frames[i], capacity);
+        CHECK(frame_length > 0);
+
+        char *printed = cJSON_PrintUnformatted(segments[i]);
+        CHECK(printed != NULL && strcmp(printed, frames[i]) == 0);
+        free(printed);
+    }
+    CHECK(json_segments_iterator_next(&iterator, frames[0], capacity) == 0);
+
+    int *order = malloc(sizeof(int) * (size_t)count * 2);
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    check_reassembly(frames, order, count, expected, 1);
+    for (int i = 0; i < count; i++) {
+        order[i] = count - 1 - i;
+    }
+    check_reassembly(frames, order, count, expected, 1);
+    for (int i = 0; i < count; i++) {
+        order[2 * i] = i;
+        order[2 * i + 1] = i;
+    }
+    // A single-frame message keeps no state to recognize its copy by
+    check_reassembly(frames, order, count * 2, expected, count == 1 ? 2 : 1);
+
+    for (int i = 0; i < count; i++) {
+        free(frames[i]);
+    }
+    free(frames);
+    free(order);
+    json_segments_free_segments_array(segments);
+    free(expected);
+    free(payload);
+}
+
+int main(void) {
+    static const size_t lengths[] = { 40, 200, 1000, 20000 };
+    static const int max_lengths[] = { 80, 250, 1400 };
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (size_t m = 0; m < sizeof(max_lengths) / sizeof(max_lengths[0]); m++) {
+            check_payload(lengths[l], max_lengths[m]);
+        }
+    }
+    printf("round trips passed\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+// json_segments_segmenter_test.cpp
+//
+// Checks that the compile-time Segmenter produces byte-identical frames to
+// JsonSegmentsIterator and json_segments_split_string() for several MTUs and
+// payload sizes, including payloads that need escaping.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cJSON.h>
+
+#include "json_segments_segmenter.hpp"
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1);                                                                    \
+        }                                                                                    \
+    } while (0)
+
+// Text with a quote every 29 bytes and a backslash every 31, so frames contain escapes.
+static std::string make_payload(std::size_t length) {
+    std::string payload(length, ' ');
+    for (std::size_t i = 0; i < length; i++) {
+        payload[i] = i % 29 == 0 ? '"' : i % 31 == 0 ? '\\' : static_cast<char>('a' + i % 26);
+    }
+    return payload;
+}
+
+template <typename Segmenter, int MaxLength>
+static void check_frames(const std::string &payload, const char *uid) {
+    Segmenter segmenter(payload, uid);
+    JsonSegmentsIterator iterator;
+    CHECK(segmenter.valid());
+    CHECK(json_segments_iterator_init(&iterator, payload.data(), payload.size(), uid, MaxLength) == 0);
+    CHECK(iterator.total_segments == segmenter.total_segments());
+
+    std::vector<char> expected(json_segments_frame_capacity(uid, iterator.segment_length, iterator.total_segments));
+    cJSON **segments = json_segments_split_string(payload.c_str(), uid, MaxLength);
+    CHECK(segments != nullptr);
+
+    typename Segmenter::Frame frame;
+    int index = 0;
+    int length;
+    while ((length = segmenter.next(frame)) > 0) {
+        CHECK(json_segments_iterator_next(&iterator, expected.data(), expected.size()) == length);
+        CHECK(std::memcmp(expected.data(), frame.data(), static_cast<std::size_t>(length) + 1) == 0);
+        char *printed = cJSON_PrintUnformatted(segments[index++]);
+        CHECK(printed != nullptr && std::strcmp(printed, frame.data()) == 0);
+        cJSON_free(printed);
+    }
+    CHECK(length == 0);
+    CHECK(index == segmenter.total_segments());
+    CHECK(json_segments_iterator_next(&iterator, expected.data(), expected.size()) == 0);
+    json_segments_free_segments_array(segments);
+}
+
+int main() {
+    static const std::size_t lengths[] = { 1, 100, 1000, 16000, 200000 };
+
+    for (std::size_t length : lengths) {
+        std::string payload = make_payload(length);
+        check_frames<json_segments::Segmenter<250, 8, 1024>, 250>(payload, "a1b2c3d4");
+        check_frames<json_segments::Segmenter<1400, 12, 256>, 1400>(payload, "sensor-00042");
+    }
+    std::printf("segmenter tests passed\n");
+    return 0;
+}
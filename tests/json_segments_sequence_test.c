@@ -0,0 +1,80 @@
+// json_segments_sequence_test.c
+//
+// Checks that json_segments_add rejects sequence numbers outside 1..total with
+// JSON_SEGMENTS_ERROR_INVALID_SEGMENT: such a segment is counted as invalid,
+// does not create or fill an entry, and cannot complete a message early.
+//
+// Build:
+//   cc -I. tests/json_segments_sequence_test.c json_segments.c json_segments_escape.c -lcjson -o sequence_test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+static int delivered;
+static char last[64];
+
+static void receive(cJSON *json) {
+    char *printed = cJSON_PrintUnformatted(json);
+
+    delivered++;
+    snprintf(last, sizeof(last), "%s", printed);
+    free(printed);
+}
+
+// Add a segment that must be rejected and check that the table is unchanged.
+static void check_rejected(const char *unique_id, int sequence_number, int total_segments) {
+    int count = all_json_segments_count;
+
+    CHECK(json_segments_add(unique_id, sequence_number, total_segments, "[0]") == JSON_SEGMENTS_ERROR_INVALID_SEGMENT);
+    CHECK(all_json_segments_count == count);
+}
+
+int main(void) {
+    JsonSegmentsStats stats;
+
+    current_json_processing_function = receive;
+    json_segments_stats_reset();
+
+    // Sequence numbers start at 1
+    check_rejected("zero", 0, 2);
+    check_rejected("negative", -1, 2);
+    check_rejected("empty", 1, 0);
+
+    // Two out-of-range segments of a two-segment message must not count as complete
+    check_rejected("m", 5, 2);
+    check_rejected("m", 7, 2);
+    CHECK(delivered == 0);
+    CHECK(json_segments_add("m", 1, 2, "[1,") == JSON_SEGMENTS_OK);
+    CHECK(json_segments_add("m", 2, 2, "2]") == JSON_SEGMENTS_OK);
+    CHECK(delivered == 1 && strcmp(last, "[1,2]") == 0);
+
+    // A segment beyond the total is rejected while the message is partial
+    CHECK(json_segments_add("n", 1, 2, "[3,") == JSON_SEGMENTS_OK);
+    check_rejected("n", 3, 2);
+    CHECK(all_json_segments_count == 1 && all_json_segments[0].received_segments == 1);
+    CHECK(json_segments_add("n", 2, 2, "4]") == JSON_SEGMENTS_OK);
+    CHECK(delivered == 2 && strcmp(last, "[3,4]") == 0);
+    CHECK(all_json_segments_count == 0);
+
+    json_segments_stats_snapshot(&stats);
+#ifndef JSON_SEGMENTS_NO_STATS
+    CHECK(stats.segments_invalid == 6);
+    CHECK(stats.segments_accepted == 4 && stats.messages_merged == 2);
+#endif
+    CHECK(stats.in_flight_uids == 0);
+
+    printf("sequence tests passed\n");
+    return 0;
+}
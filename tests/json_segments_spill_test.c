@@ -0,0 +1,177 @@
+// json_segments_spill_test.c
+//
+// Reassembles messages above the spill threshold in files: the spill function
+// gets the exact message text whatever order the segments arrive in, also when
+// the last segment comes first, and the file is gone once it returns unless
+// the function renamed it. Smaller messages still reach the processing
+// function, segments of the wrong length are rejected, and deleting, timing out
+// and freeing remove the spill files.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+#define SEGMENT_LENGTH 10
+
+typedef struct {
+    int spilled;
+    int processed;
+    char path[256];
+    char text[256];
+    const char *keep;
+} Received;
+
+static time_t virtual_now;
+
+static time_t virtual_clock(void) {
+    return virtual_now;
+}
+
+static void receive_spill(const char *unique_id, size_t unique_id_length, int fd, const char *path, size_t length, void *user_data) {
+    Received *received = user_data;
+    struct stat st;
+
+    CHECK(strlen(unique_id) == unique_id_length);
+    CHECK(length < sizeof(received->text) && pread(fd, received->text, length, 0) == (ssize_t)length);
+    received->text[length] = '\0';
+    CHECK(fstat(fd, &st) == 0 && (size_t)st.st_size == length);
+    snprintf(received->path, sizeof(received->path), "%s", path);
+    received->spilled++;
+    if (received->keep != NULL) {
+        CHECK(rename(path, received->keep) == 0);
+    }
+}
+
+static void receive(cJSON *json, void *user_data) {
+    Received *received = user_data;
+    char *printed = cJSON_PrintUnformatted(json);
+
+    received->processed++;
+    snprintf(received->text, sizeof(received->text), "%s", printed);
+    free(printed);
+}
+
+// Number of files in the spill directory.
+static int count_files(const char *directory) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    int count = 0;
+
+    CHECK(dir != NULL);
+    while ((entry = readdir(dir)) != NULL) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return count;
+}
+
+// Add segment sequence_number of text cut into SEGMENT_LENGTH-byte segments.
+static JsonSegmentsError add(JsonSegmentsContext *context, const char *unique_id, const char *text, int sequence_number) {
+    size_t length = strlen(text);
+    int total_segments = (int)((length + SEGMENT_LENGTH - 1) / SEGMENT_LENGTH);
+    size_t offset = (size_t)(sequence_number - 1) * SEGMENT_LENGTH;
+    size_t segment_length = length - offset < SEGMENT_LENGTH ? length - offset : SEGMENT_LENGTH;
+
+    return json_segments_context_add(context, unique_id, strlen(unique_id), sequence_number, total_segments, text + offset, segment_length);
+}
+
+static void test_spilled(JsonSegmentsContext *context, Received *received, const char *directory) {
+    const char *text = "{\"spilled\":\"a message that is larger than the threshold\",\"n\":[1,2,3]}";
+    int total_segments = (int)((strlen(text) + SEGMENT_LENGTH - 1) / SEGMENT_LENGTH);
+
+    // The last segment first: the size is only known from the next one
+    CHECK(add(context, "big", text, total_segments) == JSON_SEGMENTS_OK);
+    for (int i = 1; i < total_segments; i += 2) {
+        CHECK(add(context, "big", text, i) == JSON_SEGMENTS_OK);
+    }
+    CHECK(count_files(directory) == 1);
+    CHECK(add(context, "big", text, 1) == JSON_SEGMENTS_ERROR_DUPLICATE);
+    CHECK(json_segments_context_add(context, "big", 3, 2, total_segments, "short", 5) == JSON_SEGMENTS_ERROR_INCONSISTENT);
+    for (int i = 2; i < total_segments; i += 2) {
+        CHECK(add(context, "big", text, i) == JSON_SEGMENTS_OK);
+    }
+    CHECK(received->spilled == 1 && received->processed == 0);
+    CHECK(strcmp(received->text, text) == 0);
+    CHECK(access(received->path, F_OK) != 0 && count_files(directory) == 0);
+}
+
+static void test_kept(JsonSegmentsContext *context, Received *received, const char *directory) {
+    const char *text = "[\"renamed by the spill function, so the file stays\"]";
+    char kept[256];
+    int total_segments = (int)((strlen(text) + SEGMENT_LENGTH - 1) / SEGMENT_LENGTH);
+
+    snprintf(kept, sizeof(kept), "%s/kept", directory);
+    received->keep = kept;
+    for (int i = 1; i <= total_segments; i++) {
+        CHECK(add(context, "keep", text, i) == JSON_SEGMENTS_OK);
+    }
+    received->keep = NULL;
+    CHECK(received->spilled == 2 && count_files(directory) == 1);
+    CHECK(unlink(kept) == 0);
+}
+
+static void test_small(JsonSegmentsContext *context, Received *received) {
+    const char *text = "{\"small\":1}";
+
+    CHECK(add(context, "small", text, 2) == JSON_SEGMENTS_OK);
+    CHECK(add(context, "small", text, 1) == JSON_SEGMENTS_OK);
+    CHECK(received->processed == 1 && received->spilled == 2);
+    CHECK(strcmp(received->text, text) == 0);
+}
+
+static void test_removed(JsonSegmentsContext *context, Received *received, const char *directory) {
+    const char *text = "[\"a partial message that is never completed here\"]";
+
+    virtual_now = 1000;
+    CHECK(add(context, "deleted", text, 1) == JSON_SEGMENTS_OK);
+    CHECK(add(context, "timed-out", text, 1) == JSON_SEGMENTS_OK);
+    CHECK(add(context, "freed", text, 2) == JSON_SEGMENTS_OK);
+    CHECK(add(context, "freed", text, 1) == JSON_SEGMENTS_OK);
+    CHECK(count_files(directory) == 3);
+
+    CHECK(json_segments_context_delete_segments(context, "deleted", 7) == JSON_SEGMENTS_OK);
+    CHECK(count_files(directory) == 2);
+
+    virtual_now = 1050;
+    CHECK(add(context, "freed", text, 3) == JSON_SEGMENTS_OK);
+    json_segments_context_check_timeout(context, 30);
+    CHECK(count_files(directory) == 1 && context->segments_count == 1);
+
+    json_segments_context_free(context);
+    CHECK(count_files(directory) == 0);
+    CHECK(received->spilled == 2 && received->processed == 1);
+}
+
+int main(void) {
+    char directory[] = "/tmp/json_segments_spill_test-XXXXXX";
+    JsonSegmentsContext context;
+    Received received = { .keep = NULL };
+
+    CHECK(mkdtemp(directory) != NULL);
+    current_json_segments_clock_function = virtual_clock;
+    json_segments_context_init(&context, receive, &received);
+    json_segments_context_set_spill(&context, directory, 32, receive_spill, &received);
+
+    test_spilled(&context, &received, directory);
+    test_kept(&context, &received, directory);
+    test_small(&context, &received);
+    test_removed(&context, &received, directory);
+
+    CHECK(rmdir(directory) == 0);
+    printf("spill tests passed\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+// json_segments_vector_test.c
+//
+// Writes an array of more than 64 payloads, with empty entries at the start,
+// the end and across the batch boundaries, through a pipe with
+// json_segments_writev and checks the bytes on the other end; parses the same
+// array with json_segments_parse_iovec; and checks that a context with a vector
+// function and an executor delivers complete messages as their ordered
+// segments on the executor, including messages of more than 64 segments, and
+// single-frame messages inline as one segment.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cJSON.h>
+
+#include "json_segments.h"
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                                     \
+        }                                                                                \
+    } while (0)
+
+#define ENTRIES 300
+
+typedef struct {
+    int fd;
+    char *data;
+    size_t length;
+    size_t capacity;
+} Reader;
+
+// Read the pipe until the writer closes it.
+static void *drain(void *argument) {
+    Reader *reader = argument;
+    ssize_t received;
+
+    reader->capacity = 4096;
+    reader->data = malloc(reader->capacity);
+    while ((received = read(reader->fd, reader->data + reader->length, reader->capacity - reader->length)) > 0) {
+        reader->length += (size_t)received;
+        if (reader->length == reader->capacity) {
+            reader->capacity *= 2;
+            reader->data = realloc(reader->data, reader->capacity);
+        }
+    }
+    CHECK(received == 0 && reader->data != NULL);
+    return NULL;
+}
+
+static char *print(cJSON *json) {
+    char *printed = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    return printed;
+}
+
+// A JSON array of numbers cut into pieces of varying length, with runs of empty pieces.
+static size_t make_pieces(char *text, size_t capacity, struct iovec *pieces) {
+    size_t length = 0;
+    size_t offset = 0;
+
+    length += (size_t)snprintf(text, capacity, "[");
+    for (int i = 0; i < 12000; i++) {
+        length += (size_t)snprintf(text + length, capacity - length, "%d%s", i * 7919, i < 11999 ? "," : "]");
+    }
+    for (int i = 0; i < ENTRIES; i++) {
+        int empty = i < 3 || i >= ENTRIES - 3 || (i >= 60 && i < 200 && i % 2 == 0) || (i >= 120 && i < 140);
+        size_t piece = empty || i == ENTRIES - 4 ? 0 : (size_t)(i * 31 % 97 + 1);
+        if (i == ENTRIES - 4 || offset + piece > length) {
+            piece = length - offset;
+        }
+        pieces[i].iov_base = text + offset;
+        pieces[i].iov_len = piece;
+        offset += piece;
+    }
+    CHECK(offset == length);
+    return length;
+}
+
+static void test_writev_and_parse(void) {
+    static char text[160 * 1024];
+    struct iovec pieces[ENTRIES];
+    size_t length = make_pieces(text, sizeof(text), pieces);
+    Reader reader = { .length = 0 };
+    pthread_t thread;
+    int fds[2];
+
+    // The message is larger than the pipe buffer, so writev blocks until the reader catches up
+    CHECK(pipe(fds) == 0);
+    reader.fd = fds[0];
+    CHECK(pthread_create(&thread, NULL, drain, &reader) == 0);
+    CHECK(json_segments_writev(fds[1], pieces, ENTRIES) == 0);
+    CHECK(json_segments_writev(fds[1], pieces, 0) == 0);
+    close(fds[1]);
+    CHECK(pthread_join(thread, NULL) == 0);
+    close(fds[0]);
+    CHECK(reader.length == length && memcmp(reader.data, text, length) == 0);
+    free(reader.data);
+
+    char *expected = print(cJSON_Parse(text));
+    char *parsed = print(json_segments_parse_iovec(pieces, ENTRIES));
+    CHECK(expected != NULL && parsed != NULL && strcmp(expected, parsed) == 0);
+    free(parsed);
+
+    // A single segment is parsed in place
+    struct iovec whole = { .iov_base = text, .iov_len = length };
+    parsed = print(json_segments_parse_iovec(&whole, 1));
+    CHECK(parsed != NULL && strcmp(expected, parsed) == 0);
+    free(parsed);
+    free(expected);
+
+    CHECK(json_segments_parse_iovec(pieces, 0) == NULL);
+    CHECK(json_segments_parse_iovec(pieces, 2) == NULL);
+}
+
+typedef struct {
+    int delivered;
+    int count;
+    size_t length;
+    char unique_id[16];
+    char *text;
+} Delivery;
+
+static void receive_vector(const char *unique_id, size_t unique_id_length, const struct iovec *segments, int count, size_t length,
+                           void *user_data) {
+    Delivery *delivery = user_data;
+    size_t total = 0;
+
+    delivery->delivered++;
+    delivery->count = count;
+    delivery->length = length;
+    snprintf(delivery->unique_id, sizeof(delivery->unique_id), "%.*s", (int)unique_id_length, unique_id);
+    free(delivery->text);
+    delivery->text = print(json_segments_parse_iovec(segments, count));
+    for (int i = 0; i < count; i++) {
+        total += segments[i].iov_len;
+    }
+    CHECK(total == length);
+}
+
+static void receive_json(cJSON *json, void *user_data) {
+    (void)json;
+    (void)user_data;
+    CHECK(!"the vector function replaces the processing function");
+}
+
+typedef struct {
+    JsonSegmentsTaskFunction task;
+    void *argument;
+    int count;
+} DeferredExecutor;
+
+static int defer(JsonSegmentsTaskFunction task, void *argument, void *executor_context) {
+    DeferredExecutor *executor = executor_context;
+
+    CHECK(executor->count == 0);
+    executor->task = task;
+    executor->argument = argument;
+    executor->count++;
+    return 0;
+}
+
+// Run the one task submitted since the last call.
+static void run(DeferredExecutor *executor) {
+    CHECK(executor->count == 1);
+    executor->count = 0;
+    executor->task(executor->argument);
+}
+
+static void test_executor_delivery(void) {
+    JsonSegmentsContext context;
+    DeferredExecutor executor = { .count = 0 };
+    Delivery delivery = { .delivered = 0 };
+    char frame[128];
+
+    json_segments_context_init(&context, receive_json, NULL);
+    json_segments_context_set_vector_function(&context, receive_vector, &delivery);
+    json_segments_context_set_executor(&context, defer, &executor);
+
+    // Reverse order: the segments still arrive in sequence order
+    CHECK(json_segments_context_add(&context, "three", 5, 3, 3, "3]", 2) == JSON_SEGMENTS_OK);
+    CHECK(json_segments_context_add(&context, "three", 5, 2, 3, "2,", 2) == JSON_SEGMENTS_OK);
+    CHECK(json_segments_context_add(&context, "three", 5, 1, 3, "[1,", 3) == JSON_SEGMENTS_OK);
+    CHECK(delivery.delivered == 0 && context.segments_count == 0);
+    run(&executor);
+    CHECK(delivery.delivered == 1 && delivery.count == 3 && delivery.length == 7);
+    CHECK(strcmp(delivery.unique_id, "three") == 0 && strcmp(delivery.text, "[1,2,3]") == 0);
+
+    // More segments than fit the stack array
+    char expected[512];
+    size_t expected_length = 0;
+    for (int i = 100; i >= 1; i--) {
+        char segment[8];
+        int length = snprintf(segment, sizeof(segment), i == 1 ? "[%d" : i == 100 ? ",%d]" : ",%d", i);
+        CHECK(json_segments_context_add(&context, "many", 4, i, 100, segment, (size_t)length) == JSON_SEGMENTS_OK);
+    }
+    for (int i = 1; i <= 100; i++) {
+        expected_length += (size_t)snprintf(expected + expected_length, sizeof(expected) - expected_length, "%c%d", i == 1 ? '[' : ',', i);
+    }
+    strcpy(expected + expected_length, "]");
+    run(&executor);
+    CHECK(delivery.delivered == 2 && delivery.count == 100 && delivery.length == expected_length + 1);
+    CHECK(strcmp(delivery.unique_id, "many") == 0 && strcmp(delivery.text, expected) == 0);
+
+    // A single-frame message is one segment, delivered on the calling thread
+    int frame_length = json_segments_write_frame(frame, sizeof(frame), "one", 1, 1, "{\"a\":1}", 7);
+    CHECK(frame_length > 0);
+    CHECK(json_segments_context_parse_raw(&context, frame, (size_t)frame_length) == JSON_SEGMENTS_OK);
+    CHECK(executor.count == 0);
+    CHECK(delivery.delivered == 3 && delivery.count == 1 && strcmp(delivery.unique_id, "one") == 0);
+    CHECK(strcmp(delivery.text, "{\"a\":1}") == 0);
+
+    free(delivery.text);
+    json_segments_context_free(&context);
+}
+
+int main(void) {
+    test_writev_and_parse();
+    test_executor_delivery();
+
+    printf("vector tests passed\n");
+    return 0;
+}